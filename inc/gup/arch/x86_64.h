@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_ARCH_X86_64_H
+#define GUP_ARCH_X86_64_H 1
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "gup/state.h"
+
+/*
+ * Machine instruction flags
+ *
+ * @MC_F_ENTRY: Label is a function entry point
+ * @MC_F_LOOP: Label is the head of a loop
+ * @MC_F_EXTERN: Call to an extern function [16 byte aligned stack]
+ */
+#define MC_F_ENTRY  (1 << 0)
+#define MC_F_LOOP   (1 << 1)
+#define MC_F_IMM    (1 << 2)
+#define MC_F_EXTERN (1 << 3)
+
+/*
+ * Machine registers, register operands at or above
+ * MC_VREG_BASE name virtual registers until they are
+ * assigned by mc_regalloc().
+ */
+typedef enum {
+    MC_REG_NONE,
+    MC_RAX,
+    MC_RCX,
+    MC_RDX,
+    MC_RBX,
+    MC_RSP,
+    MC_RBP,
+    MC_RSI,
+    MC_RDI,
+    MC_R8,
+    MC_R9,
+    MC_R10,
+    MC_R11,
+    MC_R12,
+    MC_R13,
+    MC_R14,
+    MC_R15,
+    MC_REG_MAX
+} mc_reg_t;
+
+#define MC_VREG_BASE 64
+#define MC_VREG(N) (MC_VREG_BASE + (N))
+
+/*
+ * Represents valid machine instructions
+ *
+ * @MC_NOP: Deleted instruction, emits nothing
+ * @MC_LABEL: A label
+ * @MC_JMP: jmp <sym>
+ * @MC_CALL: call <sym>
+ * @MC_RET: ret
+ * @MC_MOVRET: mov <dst>, <imm> [dst is rax or rdx]
+ * @MC_XORRET: xor <dst>, <dst> [32 bits]
+ * @MC_STORE: mov <size> [rel <sym> + <off>], <imm>
+ * @MC_ASM: Inline assembly
+ * @MC_MOVI: <dst> = <imm>
+ * @MC_MOV: <dst> = <src>
+ * @MC_LOAD: <dst> = zero extended <size> [rel <sym> + <off>]
+ * @MC_STORER: mov <size> [rel <sym> + <off>], <src>
+ * @MC_ADD: <dst> += <src|imm>
+ * @MC_SUB: <dst> -= <src|imm>
+ * @MC_IMUL: <dst> *= <src|imm>
+ * @MC_AND: <dst> &= <src|imm>
+ * @MC_SHL: <dst> <<= <imm>
+ * @MC_SHR: <dst> >>= <imm>
+ * @MC_ZEXT: Truncate <dst> to <size>, zero extended
+ * @MC_DIV: <dst> /= <src> [clobbers rax, rdx]
+ * @MC_MOD: <dst> %= <src> [clobbers rax, rdx]
+ * @MC_MULHI: <dst> = high half of <dst> * <src|imm> [clobbers rax, rdx]
+ * @MC_SETCC: <dst> = <dst> <cond> <src|imm> ? 1 : 0
+ * @MC_MOVRETR: mov <dst>, <src> [dst is rax or rdx]
+ * @MC_PUSH: push <src>
+ * @MC_POP: pop <dst>
+ * @MC_SUBRSP: sub rsp, <imm>
+ * @MC_ADDRSP: add rsp, <imm>
+ * @MC_SPILL: mov qword [rsp + <off>], <src>
+ * @MC_RELOAD: mov <dst>, qword [rsp + <off>]
+ * @MC_DEC: <dst> -= 1, setting the flags
+ * @MC_CMP: Set the flags by <dst> - <src|imm>
+ * @MC_JCC: j<cond> <sym>, on the flags of the instruction before
+ * @MC_BT: Set the carry flag to bit <dst> of <imm> [clobbers r11]
+ * @MC_JTAB: Jump through entry <dst> of the table <sym> [clobbers <dst>, r11]
+ * @MC_CASE: Table entry jumping to <sym> [follows MC_JTAB or MC_CASE]
+ *
+ * Register operands are 64 bits wide and hold values
+ * zero extended from the width they were computed at.
+ */
+typedef enum {
+    MC_NOP,
+    MC_LABEL,
+    MC_JMP,
+    MC_CALL,
+    MC_RET,
+    MC_MOVRET,
+    MC_XORRET,
+    MC_STORE,
+    MC_ASM,
+    MC_MOVI,
+    MC_MOV,
+    MC_LOAD,
+    MC_STORER,
+    MC_ADD,
+    MC_SUB,
+    MC_IMUL,
+    MC_AND,
+    MC_SHL,
+    MC_SHR,
+    MC_ZEXT,
+    MC_DIV,
+    MC_MOD,
+    MC_MULHI,
+    MC_SETCC,
+    MC_MOVRETR,
+    MC_PUSH,
+    MC_POP,
+    MC_SUBRSP,
+    MC_ADDRSP,
+    MC_SPILL,
+    MC_RELOAD,
+    MC_DEC,
+    MC_CMP,
+    MC_JCC,
+    MC_BT,
+    MC_JTAB,
+    MC_CASE
+} mc_op_t;
+
+/*
+ * A single machine instruction
+ *
+ * @op: Instruction [MC_*]
+ * @size: Operand size
+ * @flags: Instruction flags [MC_F_*]
+ * @cond: Condition [MC_SETCC and MC_JCC, IR_COND_*]
+ * @dst: Destination register [MC_REG_* or MC_VREG()]
+ * @src: Source register [MC_REG_* or MC_VREG()]
+ * @sym: Label, target, or assembly text
+ * @imm: Immediate operand [MC_F_IMM for arithmetic]
+ * @off: Offset from @sym
+ */
+struct mc_insn {
+    uint8_t op;
+    uint8_t size;
+    uint16_t flags;
+    uint8_t cond;
+    uint32_t dst;
+    uint32_t src;
+    const char *sym;
+    ssize_t imm;
+    size_t off;
+};
+
+/*
+ * A buffered stream of machine instructions for
+ * the function being emitted.
+ *
+ * @insns: Instruction array
+ * @count: Number of instructions
+ * @cap: Capacity of the instruction array
+ */
+struct mc_buf {
+    struct mc_insn *insns;
+    size_t count;
+    size_t cap;
+};
+
+/*
+ * Run the peephole optimizer over a machine
+ * instruction stream.
+ *
+ * @state: Compiler state
+ * @buf: Instruction stream
+ *
+ * Returns zero on success
+ */
+int mc_peephole(struct gup_state *state, struct mc_buf *buf);
+
+/*
+ * Assign a machine register or a stack slot to every
+ * virtual register of a machine instruction stream,
+ * saving the callee-saved registers it hands out and
+ * aligning the stack for calls to extern functions.
+ *
+ * @state: Compiler state
+ * @buf: Instruction stream
+ *
+ * Returns zero on success
+ */
+int mc_regalloc(struct gup_state *state, struct mc_buf *buf);
+
+#endif  /* !GUP_ARCH_X86_64_H */
@@ -21,11 +21,40 @@ struct gup_state;
  * @AST_OP_ASM: Inline assembly
  * @AST_OP_RETVOID: Return void
  * @AST_OP_RETIMM: Return immediate
+ * @AST_OP_CALL: Call [symbol, right is the first AST_OP_ARG]
  * @AST_OP_STRUCT: Structure
  * @AST_OP_VAR: Variable
  * @AST_OP_BREAK: Loop break
  * @AST_OP_CONTINUE: Loop continue
  * @AST_OP_NUMBER: Is a number
+ * @AST_OP_RETVAL: Return the value of an expression [right, left is the second value]
+ * @AST_OP_FIELD: Field of a struct instance [symbol, left is the access path]
+ * @AST_OP_ADD: left + right
+ * @AST_OP_SUB: left - right
+ * @AST_OP_MUL: left * right
+ * @AST_OP_DIV: left / right
+ * @AST_OP_MOD: left % right
+ * @AST_OP_LT: left < right
+ * @AST_OP_LTE: left <= right
+ * @AST_OP_GT: left > right
+ * @AST_OP_GTE: left >= right
+ * @AST_OP_EQ: left == right
+ * @AST_OP_NE: left != right
+ * @AST_OP_PARAM: Parameter of the function being compiled [v is the index]
+ * @AST_OP_ARG: Argument of a call [left, right is the next argument]
+ * @AST_OP_UNPACK: Assign the values of a call [right] to a chain of
+ *                 AST_OP_ASSIGN targets [left, linked through right]
+ * @AST_OP_BECOME: Call in place of returning [right is the AST_OP_CALL]
+ * @AST_OP_IF: Conditional block [right is the condition, v the AST_HINT_*]
+ * @AST_OP_ELSE: Alternative of a conditional [right is the condition of an
+ *               'else if', v the AST_HINT_*]
+ * @AST_OP_MATCH: Match statement [right is the subject]
+ * @AST_OP_ARM: Arm of a match [left is the first AST_OP_NUMBER, linked
+ *              through right, NULL for the default arm]
+ *
+ * An AST_OP_LOOP counted down from a number of iterations
+ * holds it in right, and its label in str. The end of a
+ * conditional is an AST_OP_IF epilogue.
  */
 typedef enum {
     AST_OP_NONE,
@@ -41,8 +70,40 @@ typedef enum {
     AST_OP_CONTINUE,
     AST_OP_ASSIGN,
     AST_OP_NUMBER,
+    AST_OP_RETVAL,
+    AST_OP_FIELD,
+    AST_OP_ADD,
+    AST_OP_SUB,
+    AST_OP_MUL,
+    AST_OP_DIV,
+    AST_OP_MOD,
+    AST_OP_LT,
+    AST_OP_LTE,
+    AST_OP_GT,
+    AST_OP_GTE,
+    AST_OP_EQ,
+    AST_OP_NE,
+    AST_OP_PARAM,
+    AST_OP_ARG,
+    AST_OP_UNPACK,
+    AST_OP_BECOME,
+    AST_OP_IF,
+    AST_OP_ELSE,
+    AST_OP_MATCH,
+    AST_OP_ARM,
 } ast_op_t;
 
+/*
+ * Branch hints of a conditional
+ *
+ * @AST_HINT_NONE: No hint given
+ * @AST_HINT_LIKELY: Block is expected to run
+ * @AST_HINT_UNLIKELY: Block is expected to be skipped
+ */
+#define AST_HINT_NONE       0
+#define AST_HINT_LIKELY     1
+#define AST_HINT_UNLIKELY   2
+
 /*
  * Represents a single node within an abstract syntax
  * tree.
@@ -52,6 +113,8 @@ typedef enum {
  * @left: Left leaf
  * @right: Right leaf
  * @symbol: Symbol this node refers to
+ * @align: Requested alignment [0 if natural]
+ * @unroll: Requested unroll factor of a loop [0 if none]
  * @epilogue: Set if end of block
  */
 struct ast_node {
@@ -60,6 +123,8 @@ struct ast_node {
     struct ast_node *left;
     struct ast_node *right;
     struct symbol *symbol;
+    size_t align;
+    uint32_t unroll;
     uint8_t epilogue : 1;
     union {
         char *str;
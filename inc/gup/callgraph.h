@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_CALLGRAPH_H
+#define GUP_CALLGRAPH_H 1
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gup/pass.h"
+
+/* Static estimate of how many times a loop body runs */
+#define CALLGRAPH_LOOP_WEIGHT 10
+
+/* A function is hot with at least 1/n of the calls of the hottest one */
+#define CALLGRAPH_HOT_SHARE 10
+
+/*
+ * A call from one function to another
+ *
+ * @callee: Index of the called node
+ * @weight: Estimated or measured number of calls
+ */
+struct callgraph_edge {
+    size_t callee;
+    uint64_t weight;
+};
+
+/*
+ * A function within the call graph
+ *
+ * @func: Function this node stands for
+ * @calls: Outgoing calls, one per callee
+ * @call_count: Number of outgoing calls
+ * @weight: Sum of the weights of all incoming calls
+ * @size: Estimated size of the function in bytes
+ */
+struct callgraph_node {
+    struct gup_func *func;
+    struct callgraph_edge *calls;
+    size_t call_count;
+    uint64_t weight;
+    size_t size;
+};
+
+/*
+ * The call graph of a translation unit, calls to
+ * functions outside of the unit are not recorded.
+ *
+ * @nodes: One node per function, in unit order
+ * @node_count: Number of nodes
+ */
+struct callgraph {
+    struct callgraph_node *nodes;
+    size_t node_count;
+};
+
+/*
+ * Build the call graph of a translation unit. Call counts
+ * come from the profile if one was given, otherwise calls
+ * within loops are weighted by their loop depth.
+ *
+ * @state: Compiler state
+ * @unit: Unit to build the graph of
+ * @res: Graph is written here
+ *
+ * Returns zero on success
+ */
+int callgraph_build(struct gup_state *state, struct gup_unit *unit, struct callgraph *res);
+
+/*
+ * Find the node of a function by name
+ *
+ * @cg: Graph to search
+ * @name: Function name
+ *
+ * Returns -1 if not found
+ */
+ssize_t callgraph_find(const struct callgraph *cg, const char *name);
+
+/*
+ * Returns true if a node is called at least 1/n as
+ * often as the most called node [CALLGRAPH_HOT_SHARE].
+ *
+ * @cg: Call graph
+ * @node: Index of the node to check
+ */
+bool callgraph_hot(const struct callgraph *cg, size_t node);
+
+/*
+ * Release a call graph
+ *
+ * @cg: Graph to release
+ */
+void callgraph_release(struct callgraph *cg);
+
+#endif  /* !GUP_CALLGRAPH_H */
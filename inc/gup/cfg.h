@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_CFG_H
+#define GUP_CFG_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gup/ir.h"
+
+/* Maximum successors of a single block */
+#define CFG_MAX_SUCC 2
+
+/*
+ * A node within the control flow graph, one per
+ * basic block of the IR function.
+ *
+ * @succ: Successor block indices
+ * @succ_count: Number of successors
+ * @pred_count: Number of predecessors
+ * @reachable: Set if reachable from the entry block
+ */
+struct cfg_node {
+    size_t succ[CFG_MAX_SUCC];
+    uint8_t succ_count;
+    size_t pred_count;
+    bool reachable;
+};
+
+/*
+ * A control flow graph over an IR function
+ *
+ * @ir: Function the graph describes
+ * @nodes: Graph nodes [indexed like ir->blocks]
+ * @node_count: Number of graph nodes
+ * @label_block: Block each label starts [indexed by label]
+ */
+struct cfg {
+    struct ir_func *ir;
+    struct cfg_node *nodes;
+    size_t node_count;
+    size_t *label_block;
+};
+
+/*
+ * Build the control flow graph of a function and
+ * compute which blocks are reachable.
+ *
+ * @ir: Function to build graph of
+ * @res: Graph is written here
+ *
+ * Returns zero on success
+ */
+int cfg_build(struct ir_func *ir, struct cfg *res);
+
+/*
+ * Release a control flow graph
+ *
+ * @cfg: Graph to release
+ */
+void cfg_release(struct cfg *cfg);
+
+#endif  /* !GUP_CFG_H */
@@ -18,4 +18,34 @@
  */
 int cg_compile_node(struct gup_state *state, struct ast_node *node);
 
+/*
+ * Signal the end of a function body. When optimizing the
+ * pass pipeline runs over it and it is held back until
+ * the end of the unit, otherwise it is emitted.
+ *
+ * @state: Compiler state
+ *
+ * Returns zero on success
+ */
+int cg_end_func(struct gup_state *state);
+
+/*
+ * Drop a function that could not be parsed to
+ * completion.
+ *
+ * @state: Compiler state
+ */
+void cg_discard_func(struct gup_state *state);
+
+/*
+ * Signal the end of the translation unit, runs the unit
+ * passes and emits every held back function and struct
+ * instance before writing out each section.
+ *
+ * @state: Compiler state
+ *
+ * Returns zero on success
+ */
+int cg_end_unit(struct gup_state *state);
+
 #endif  /* !GUP_CODEGEN_H */
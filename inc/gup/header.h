@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_HEADER_H
+#define GUP_HEADER_H 1
+
+#include "gup/state.h"
+
+/*
+ * Write a C header declaring every struct and every
+ * public function of the unit. Structs are written with
+ * their padding spelled out and checked against the gup
+ * layout with static assertions, so a header that no
+ * longer matches the code fails to compile.
+ *
+ * @state: Compiler state
+ * @path: Path of the header to write
+ *
+ * Returns zero on success
+ */
+int header_write(struct gup_state *state, const char *path);
+
+#endif  /* !GUP_HEADER_H */
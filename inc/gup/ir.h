@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_IR_H
+#define GUP_IR_H 1
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "gup/types.h"
+
+/* Absent virtual register / label */
+#define IR_VREG_NONE    0
+#define IR_LABEL_NONE   UINT32_MAX
+
+/*
+ * Instruction flags
+ *
+ * @IR_F_GLOBAL: ENTRY of a public function
+ * @IR_F_EXTERN: CALL to an extern function
+ * @IR_F_HOT: ENTRY of a function placed within .text.hot
+ * @IR_F_COLD: ENTRY of a function placed within .text.unlikely
+ */
+#define IR_F_GLOBAL     (1 << 0)
+#define IR_F_EXTERN     (1 << 1)
+#define IR_F_HOT        (1 << 2)
+#define IR_F_COLD       (1 << 3)
+
+/*
+ * Label flags
+ *
+ * @IR_LABEL_LOOP: Label is the head of a loop
+ * @IR_LABEL_COLD: Label starts a block that is unlikely to run
+ */
+#define IR_LABEL_LOOP   (1 << 0)
+#define IR_LABEL_COLD   (1 << 1)
+
+typedef uint32_t ir_vreg_t;
+
+/*
+ * Represents valid IR opcodes
+ *
+ * @IR_NOP: Does nothing, dropped when lowered
+ * @IR_ENTRY: Function entry point
+ * @IR_LABEL: Starts a basic block
+ * @IR_JMP: Unconditional jump to a label
+ * @IR_CALL: Call a function symbol
+ * @IR_RET: Return, with an optional value
+ * @IR_ASM: Inline assembly
+ * @IR_MOV: Move a value into a virtual register
+ * @IR_STORE: Store a value to [sym + off]
+ * @IR_SETRET: Set return value <off> without returning
+ * @IR_LOAD: Load [sym + off] into a virtual register
+ * @IR_ADD: dst = a + b
+ * @IR_SUB: dst = a - b
+ * @IR_MUL: dst = a * b
+ * @IR_DIV: dst = a / b
+ * @IR_MOD: dst = a % b
+ * @IR_AND: dst = a & b
+ * @IR_SHL: dst = a << b
+ * @IR_SHR: dst = a >> b
+ * @IR_MULHI: dst = (a * b) >> 64
+ * @IR_CMP: dst = 1 if a <cond> b holds, otherwise 0 [IR_COND_* in flags]
+ * @IR_PARAM: dst = parameter <off>, only ever right after the entry
+ * @IR_ARG: Pass a as argument <off> of the call that follows
+ * @IR_RESULT: dst = return value <off> of the call just before
+ * @IR_TAIL: Call a function symbol in place of returning, what it
+ *           returns is returned by this function
+ * @IR_BR: Jump to a label if a <cond> b holds [IR_COND_* in flags]
+ * @IR_DECJNZ: Decrement a in place [dst is a], jump to a label unless
+ *             it reached zero
+ * @IR_BT: Jump to a label if bit a of the constant b is set [a below 64]
+ * @IR_JTAB: Jump through entry a of the IR_CASE table that follows, the
+ *           label names the table [a is clobbered, dst is a]
+ * @IR_CASE: Entry of a jump table, the label it jumps to
+ *
+ * The arguments of a call directly precede it and its
+ * results directly follow it. A function returns its
+ * first value through IR_RET, any further values are
+ * set by IR_SETRET just before.
+ *
+ * Arithmetic is unsigned and wraps at the width of the
+ * instruction.
+ */
+typedef enum {
+    IR_NOP,
+    IR_ENTRY,
+    IR_LABEL,
+    IR_JMP,
+    IR_CALL,
+    IR_RET,
+    IR_ASM,
+    IR_MOV,
+    IR_STORE,
+    IR_SETRET,
+    IR_LOAD,
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_MOD,
+    IR_AND,
+    IR_SHL,
+    IR_SHR,
+    IR_MULHI,
+    IR_CMP,
+    IR_PARAM,
+    IR_ARG,
+    IR_RESULT,
+    IR_TAIL,
+    IR_BR,
+    IR_DECJNZ,
+    IR_BT,
+    IR_JTAB,
+    IR_CASE,
+    IR_OP_MAX
+} ir_op_t;
+
+/*
+ * Conditions of IR_CMP and IR_BR, all unsigned
+ */
+typedef enum {
+    IR_COND_EQ,
+    IR_COND_LT,
+    IR_COND_LE,
+    IR_COND_GT,
+    IR_COND_GE,
+    IR_COND_NE
+} ir_cond_t;
+
+/*
+ * Represents the kind of an instruction operand
+ */
+typedef enum {
+    IR_VAL_NONE,
+    IR_VAL_IMM,
+    IR_VAL_VREG
+} ir_valtype_t;
+
+/*
+ * An instruction operand
+ *
+ * @type: Operand kind
+ * @imm: Immediate value [IR_VAL_IMM]
+ * @vreg: Virtual register [IR_VAL_VREG]
+ */
+struct ir_val {
+    ir_valtype_t type;
+    union {
+        uint64_t imm;
+        ir_vreg_t vreg;
+    };
+};
+
+/*
+ * A single IR instruction
+ *
+ * @op: Opcode [IR_*]
+ * @width: Operation width
+ * @flags: Instruction flags [IR_F_*, IR_COND_* for CMP and BR]
+ * @label: Label index [LABEL, JMP, BR, DECJNZ]
+ * @dst: Destination virtual register
+ * @a: First operand
+ * @b: Second operand
+ * @sym: Symbol or asm text [ENTRY, CALL, ASM, STORE, LOAD]
+ * @off: Offset from @sym [STORE, LOAD], value index [SETRET, PARAM, ARG, RESULT]
+ */
+struct ir_insn {
+    uint8_t op;
+    uint8_t width;
+    uint16_t flags;
+    uint32_t label;
+    ir_vreg_t dst;
+    struct ir_val a;
+    struct ir_val b;
+    const char *sym;
+    size_t off;
+};
+
+/*
+ * A label within an IR function
+ *
+ * @name: Label name as emitted
+ * @flags: Label flags [IR_LABEL_*]
+ * @unroll: Unroll factor asked for a loop head [0 if none]
+ */
+struct ir_label {
+    const char *name;
+    uint32_t flags;
+    uint32_t unroll;
+};
+
+/*
+ * A basic block, covering instructions [start, end)
+ *
+ * @start: Index of first instruction
+ * @end: Index past the last instruction
+ * @label: Label starting the block [IR_LABEL_NONE if none]
+ */
+struct ir_block {
+    size_t start;
+    size_t end;
+    uint32_t label;
+};
+
+/*
+ * An IR function body
+ *
+ * @insns: Instruction array
+ * @insn_count: Number of instructions
+ * @insn_cap: Capacity of instruction array
+ * @labels: Label array
+ * @label_count: Number of labels
+ * @label_cap: Capacity of label array
+ * @blocks: Basic blocks [see ir_split_blocks()]
+ * @block_count: Number of basic blocks
+ * @vreg_count: Number of virtual registers handed out
+ */
+struct ir_func {
+    struct ir_insn *insns;
+    size_t insn_count;
+    size_t insn_cap;
+    struct ir_label *labels;
+    uint32_t label_count;
+    uint32_t label_cap;
+    struct ir_block *blocks;
+    size_t block_count;
+    ir_vreg_t vreg_count;
+};
+
+/*
+ * Append an instruction to an IR function
+ *
+ * @func: Function to append to
+ * @insn: Instruction to append
+ *
+ * Returns the index of the new instruction, or -1 on failure
+ */
+ssize_t ir_append(struct ir_func *func, const struct ir_insn *insn);
+
+/*
+ * Look up a label by name, creating it if it does
+ * not exist.
+ *
+ * @func: Function the label lives in
+ * @name: Label name [must outlive the function]
+ *
+ * Returns the label index, or IR_LABEL_NONE on failure
+ */
+uint32_t ir_label(struct ir_func *func, const char *name);
+
+/*
+ * Allocate a new virtual register
+ *
+ * @func: Function to allocate within
+ */
+ir_vreg_t ir_vreg_new(struct ir_func *func);
+
+/*
+ * Split a function into basic blocks, the result is
+ * written to func->blocks.
+ *
+ * @func: Function to split
+ *
+ * Returns zero on success
+ */
+int ir_split_blocks(struct ir_func *func);
+
+/*
+ * Returns true if an instruction ends a basic block
+ *
+ * @insn: Instruction to check
+ */
+bool ir_is_terminator(const struct ir_insn *insn);
+
+/*
+ * Returns true if an instruction may jump to its label
+ *
+ * @insn: Instruction to check
+ */
+bool ir_is_branch(const struct ir_insn *insn);
+
+/*
+ * Returns the condition that holds whenever another
+ * does not, such as IR_COND_GE for IR_COND_LT.
+ *
+ * @cond: Condition to invert
+ */
+ir_cond_t ir_cond_invert(ir_cond_t cond);
+
+/*
+ * Returns the condition that holds with the operands
+ * swapped, such as IR_COND_GT for IR_COND_LT.
+ *
+ * @cond: Condition to swap
+ */
+ir_cond_t ir_cond_swap(ir_cond_t cond);
+
+/*
+ * Write a textual representation of an IR function
+ *
+ * @fp: File to write to
+ * @name: Function name
+ * @func: Function to dump
+ */
+void ir_dump(FILE *fp, const char *name, const struct ir_func *func);
+
+/*
+ * Release the memory held by an IR function
+ *
+ * @func: Function to release
+ */
+void ir_release(struct ir_func *func);
+
+#endif  /* !GUP_IR_H */
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_LAYOUT_H
+#define GUP_LAYOUT_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "gup/symbol.h"
+#include "gup/ast.h"
+
+/* Round a value up to a power of two alignment */
+#define ALIGN_UP(V, A) (((V) + (A) - 1) & ~((A) - 1))
+
+/* Alignment given by the cacheline attribute */
+#define LAYOUT_CACHELINE 64
+
+struct gup_state;
+
+/*
+ * A single field within a struct layout
+ *
+ * @node: Field node from the struct definition
+ * @off: Offset from the start of the struct
+ * @size: Size of the field in bytes
+ */
+struct layout_field {
+    struct ast_node *node;
+    size_t off;
+    size_t size;
+};
+
+/*
+ * The memory layout of a struct, every field is placed
+ * at its natural alignment.
+ *
+ * @size: Size in bytes, a multiple of @align
+ * @align: Alignment in bytes
+ * @field_count: Number of fields
+ * @fields: Fields in declaration order
+ */
+struct layout {
+    size_t size;
+    size_t align;
+    size_t field_count;
+    struct layout_field fields[];
+};
+
+/*
+ * Compute the layout of a struct, the result is saved
+ * in the layout of the symbol.
+ *
+ * @state: Compiler state
+ * @sym: Struct symbol to lay out
+ * @align: Requested alignment [0 if natural]
+ *
+ * Returns zero on success
+ */
+int layout_struct(struct gup_state *state, struct symbol *sym, size_t align);
+
+/*
+ * Copy a layout with a stricter alignment, the size is
+ * padded out to the new alignment.
+ *
+ * @state: Compiler state
+ * @layout: Layout to copy
+ * @align: Requested alignment
+ *
+ * Returns NULL on failure
+ */
+struct layout *layout_align(struct gup_state *state, const struct layout *layout,
+    size_t align);
+
+/*
+ * Look up a field of a layout by name
+ *
+ * @layout: Layout to search
+ * @name: Field name
+ *
+ * Returns NULL if not found
+ */
+const struct layout_field *layout_field(const struct layout *layout, const char *name);
+
+/*
+ * Write a value into the initial contents of a struct
+ * instance, the value is stored little endian.
+ *
+ * @state: Compiler state
+ * @sym: Instance to write to
+ * @off: Offset within the instance
+ * @width: Width of the value
+ * @v: Value to write
+ *
+ * Returns zero on success
+ */
+int layout_store(struct gup_state *state, struct symbol *sym, size_t off,
+    gup_type_t width, uint64_t v);
+
+/*
+ * Print the fields, padding, size and alignment of a
+ * layout.
+ *
+ * @fp: File to print to
+ * @name: Name to print the layout under
+ * @layout: Layout to print
+ */
+void layout_dump(FILE *fp, const char *name, const struct layout *layout);
+
+#endif  /* !GUP_LAYOUT_H */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_MATCH_H
+#define GUP_MATCH_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gup/state.h"
+
+/* Most values tested one after another at a leaf of a compare tree */
+#define MATCH_TREE_LEAF 3
+
+/* Most arms dispatched with a bit test each */
+#define MATCH_BT_ARMS 3
+
+/* Fewest values, and most entries, of a jump table */
+#define MATCH_TABLE_MIN 4
+#define MATCH_TABLE_MAX 1024
+
+/* Least percentage of the entries of a jump table that are values */
+#define MATCH_TABLE_DENSITY 40
+
+/*
+ * Ways of dispatching a match
+ *
+ * @MATCH_TREE: Binary tree of compares, linear at the leaves
+ * @MATCH_BITTEST: One bit test per arm against a mask of its values
+ * @MATCH_TABLE: Indirect jump through a table of every value
+ */
+typedef enum {
+    MATCH_TREE,
+    MATCH_BITTEST,
+    MATCH_TABLE,
+    MATCH_KIND_MAX
+} match_kind_t;
+
+/*
+ * Append the dispatch of a match to the function being
+ * compiled. The way of dispatching is chosen by the
+ * branches taken on the longest path through it.
+ *
+ * @state: Compiler state
+ * @match: Match to dispatch, its cases are sorted by value
+ *
+ * Returns zero on success
+ */
+int match_dispatch(struct gup_state *state, struct gup_match *match);
+
+#endif  /* !GUP_MATCH_H */
@@ -9,6 +9,8 @@
 #include <sys/types.h>
 #include <stdbool.h>
 #include "gup/state.h"
+#include "gup/layout.h"
+#include "gup/ir.h"
 
 /*
  * Valid machine register sizes
@@ -28,8 +30,35 @@ typedef enum {
  * @state: Compiler state
  * @name: Name of function to generate
  * @is_global: If true, function is global
+ * @section: Section to place the function in [SECTION_TEXT*]
  */
-int mu_cg_funcp(struct gup_state *state, const char *name, bool is_global);
+int mu_cg_funcp(struct gup_state *state, const char *name, bool is_global,
+    bin_section_t section);
+
+/*
+ * End the function started by mu_cg_funcp(), writing
+ * out any instructions held back for the machine passes.
+ *
+ * @state: Compiler state
+ */
+int mu_cg_flush(struct gup_state *state);
+
+/*
+ * Emit top level assembly into .text
+ *
+ * @state: Compiler state
+ * @asm_str: Assembly to emit
+ */
+int mu_cg_textasm(struct gup_state *state, const char *asm_str);
+
+/*
+ * Write out the output of every section, each section
+ * appears once in the order text, hot text, unlikely
+ * text, rodata, data, bss.
+ *
+ * @state: Compiler state
+ */
+int mu_cg_finish(struct gup_state *state);
 
 /*
  * Inject inline assembly
@@ -49,6 +78,61 @@ int mu_cg_asm(struct gup_state *state, const char *asm_str);
  */
 int mu_cg_retimm(struct gup_state *state, regsize_t regsize, ssize_t imm);
 
+/*
+ * Load a return value register without returning, used
+ * for the values after the first and where an inlined
+ * function returned.
+ *
+ * @state: Compiler state
+ * @idx: Index of the return value
+ * @regsize: Register size
+ * @imm: Immediate value to return
+ */
+int mu_cg_setret(struct gup_state *state, size_t idx, regsize_t regsize, ssize_t imm);
+
+/*
+ * Load a return value register from a virtual register
+ * without returning.
+ *
+ * @state: Compiler state
+ * @idx: Index of the return value
+ * @regsize: Register size
+ * @vreg: Virtual register holding the value
+ */
+int mu_cg_movret(struct gup_state *state, size_t idx, regsize_t regsize, ir_vreg_t vreg);
+
+/*
+ * Copy a parameter out of the register it was passed in
+ * with respect to the platform ABI.
+ *
+ * @state: Compiler state
+ * @idx: Index of the parameter
+ * @type: Parameter type
+ * @vreg: Virtual register to copy into
+ */
+int mu_cg_param(struct gup_state *state, size_t idx, gup_type_t type, ir_vreg_t vreg);
+
+/*
+ * Load the register an argument is passed in with
+ * respect to the platform ABI.
+ *
+ * @state: Compiler state
+ * @idx: Index of the argument
+ * @val: Value of the argument
+ */
+int mu_cg_arg(struct gup_state *state, size_t idx, const struct ir_val *val);
+
+/*
+ * Copy a return value of the call just made out of the
+ * register it was returned in.
+ *
+ * @state: Compiler state
+ * @idx: Index of the return value
+ * @type: Type of the return value
+ * @vreg: Virtual register to copy into
+ */
+int mu_cg_result(struct gup_state *state, size_t idx, gup_type_t type, ir_vreg_t vreg);
+
 /*
  * Return a void value
  *
@@ -61,8 +145,17 @@ int mu_cg_retvoid(struct gup_state *state);
  *
  * @state: Compiler state
  * @label: Label to call
+ * @is_extern: If true, the callee is an extern C function
  */
-int mu_cg_call(struct gup_state *state, const char *label);
+int mu_cg_call(struct gup_state *state, const char *label, bool is_extern);
+
+/*
+ * Declare a function defined outside of the unit
+ *
+ * @state: Compiler state
+ * @name: Name of the function
+ */
+int mu_cg_extern(struct gup_state *state, const char *name);
 
 /*
  * Emit a jump to a label
@@ -73,20 +166,83 @@ int mu_cg_call(struct gup_state *state, const char *label);
 int mu_cg_jmp(struct gup_state *state, const char *label);
 
 /*
- * Emit a struct
+ * Emit a compare of the operands of an IR_BR and a jump
+ * to a label if its condition holds.
  *
  * @state: Compiler state
- * @name: Name suffix
- * @node: Root of struct
+ * @insn: IR_BR instruction [a must be a virtual register]
+ * @label: Label to jump to
  */
-int mu_cg_struct(struct gup_state *state, const char *name, struct ast_node *node);
+int mu_cg_br(struct gup_state *state, const struct ir_insn *insn, const char *label);
+
+/*
+ * Emit a decrement of a counter and a jump to a label
+ * unless the counter reached zero.
+ *
+ * @state: Compiler state
+ * @vreg: Counter
+ * @label: Label to jump to
+ */
+int mu_cg_decjnz(struct gup_state *state, ir_vreg_t vreg, const char *label);
+
+/*
+ * Emit a jump to a label if bit a of the constant b
+ * of an IR_BT is set.
+ *
+ * @state: Compiler state
+ * @insn: IR_BT instruction [a must be a virtual register]
+ * @label: Label to jump to
+ */
+int mu_cg_bt(struct gup_state *state, const struct ir_insn *insn, const char *label);
+
+/*
+ * Emit an indirect jump through a table of entries
+ * emitted right after by mu_cg_case().
+ *
+ * @state: Compiler state
+ * @vreg: Index into the table [clobbered]
+ * @table: Name of the table
+ */
+int mu_cg_jtab(struct gup_state *state, ir_vreg_t vreg, const char *table);
+
+/*
+ * Emit the next entry of the last jump table
+ *
+ * @state: Compiler state
+ * @label: Label the entry jumps to
+ */
+int mu_cg_case(struct gup_state *state, const char *label);
+
+/*
+ * Name the fields of a struct instance so that inline
+ * assembly may refer to them.
+ *
+ * @state: Compiler state
+ * @name: Instance name
+ * @layout: Layout of the struct
+ */
+int mu_cg_struct(struct gup_state *state, const char *name, const struct layout *layout);
+
+/*
+ * Emit a struct instance as a single aligned object,
+ * within .data if it has initial contents and reserved
+ * within .bss otherwise.
+ *
+ * @state: Compiler state
+ * @name: Instance name
+ * @layout: Layout of the struct
+ * @data: Initial contents [NULL if zeroed]
+ */
+int mu_cg_object(struct gup_state *state, const char *name, const struct layout *layout,
+    const uint8_t *data);
 
 /*
  * Emit a loop start
  *
  * @state: Compiler state
+ * @name: Label of loop head
  */
-int mu_cg_loopstart(struct gup_state *state);
+int mu_cg_loopstart(struct gup_state *state, const char *name);
 
 /*
  * Emit a label
@@ -100,13 +256,56 @@ int mu_cg_label(struct gup_state *state, const char *name);
  * Write a value of a specific size to a label
  *
  * @state: Compiler state
- * @size: Operation size
+ * @type: Type of value written
  * @name: Label name
+ * @off: Offset from label
  * @v: Value to write
  */
 int mu_cg_setlabel(
-    struct gup_state *state, regsize_t size,
-    const char *name, size_t v
+    struct gup_state *state, gup_type_t type,
+    const char *name, size_t off, size_t v
 );
 
+/*
+ * Write a virtual register of a specific size to a label
+ *
+ * @state: Compiler state
+ * @type: Type of value written
+ * @name: Label name
+ * @off: Offset from label
+ * @vreg: Virtual register holding the value
+ */
+int mu_cg_storereg(
+    struct gup_state *state, gup_type_t type,
+    const char *name, size_t off, ir_vreg_t vreg
+);
+
+/*
+ * Lower an IR instruction that computes a value into a
+ * virtual register [IR_MOV, IR_LOAD and arithmetic].
+ *
+ * @state: Compiler state
+ * @insn: Instruction to lower
+ */
+int mu_cg_op(struct gup_state *state, const struct ir_insn *insn);
+
+/*
+ * Estimate the encoded size of an IR instruction once
+ * lowered, used for statistics and cost models.
+ *
+ * @insn: Instruction to estimate
+ *
+ * Returns the size in bytes
+ */
+size_t mu_insn_size(const struct ir_insn *insn);
+
+/*
+ * Machine pass: peephole optimization of the buffered
+ * instruction stream of the current function.
+ *
+ * @state: Compiler state
+ * @func: Function being emitted
+ */
+int mu_pass_peephole(struct gup_state *state, struct gup_func *func);
+
 #endif  /* !GUP_MU_H */
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_PASS_H
+#define GUP_PASS_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "gup/ir.h"
+#include "gup/state.h"
+
+/* Highest supported optimization level */
+#define PASS_MAX_LEVEL 2
+
+/* Default size budget of the inliner [bytes] */
+#define PASS_INLINE_LIMIT 16
+
+/* Default size budget of an unrolled loop body [bytes] */
+#define PASS_UNROLL_LIMIT 64
+
+/*
+ * Function summary flags computed by the 'funcinfo'
+ * analysis pass
+ *
+ * @FUNC_HAS_CALL: Function calls another function
+ * @FUNC_HAS_ASM: Function contains inline assembly
+ * @FUNC_HAS_LOOP: Function contains a loop
+ */
+#define FUNC_HAS_CALL   (1 << 0)
+#define FUNC_HAS_ASM    (1 << 1)
+#define FUNC_HAS_LOOP   (1 << 2)
+
+/*
+ * Represents valid pass kinds
+ *
+ * @PASS_ANALYSIS: Computes information, never modifies the function
+ * @PASS_TRANSFORM: May modify the function
+ * @PASS_MACHINE: Runs on the backend instruction stream
+ * @PASS_UNIT: Runs once over the whole translation unit
+ */
+typedef enum {
+    PASS_ANALYSIS,
+    PASS_TRANSFORM,
+    PASS_MACHINE,
+    PASS_UNIT
+} pass_kind_t;
+
+/*
+ * Represents a function retained for optimization
+ *
+ * @symbol: Function symbol
+ * @ir: Function body
+ * @emitted: Number of instructions already lowered [-O0]
+ * @flags: Summary flags [FUNC_*]
+ * @group: Top level assembly statements within .text before this function
+ * @params: Virtual register holding each parameter
+ */
+struct gup_func {
+    struct symbol *symbol;
+    struct ir_func ir;
+    size_t emitted;
+    uint32_t flags;
+    size_t group;
+    ir_vreg_t params[SYMBOL_MAX_PARAMS];
+};
+
+/*
+ * A call count read from the profile
+ *
+ * @caller: Name of the calling function
+ * @callee: Name of the called function
+ * @count: Number of calls measured
+ */
+struct gup_count {
+    const char *caller;
+    const char *callee;
+    uint64_t count;
+};
+
+/*
+ * Represents the translation unit, functions are held
+ * here until the end of the unit when optimizing.
+ *
+ * Top level assembly within .text may depend on where
+ * it is placed, so it splits the functions into groups
+ * and functions are only ever reordered within their
+ * group. Assembly statement N follows group N.
+ *
+ * @objects: Struct instances in emission order
+ * @object_count: Number of struct instances
+ * @funcs: Functions in emission order
+ * @func_count: Number of functions
+ * @text_asm: Top level assembly within .text
+ * @text_asm_count: Number of top level assembly statements
+ * @top_asm: Every top level assembly statement, in any section
+ * @top_asm_count: Number of entries within @top_asm
+ * @counts: Call counts of the profile, read on first use
+ * @count_len: Number of entries within @counts
+ * @counts_read: Set once the profile has been read
+ */
+struct gup_unit {
+    struct symbol **objects;
+    size_t object_count;
+    struct gup_func **funcs;
+    size_t func_count;
+    const char **text_asm;
+    size_t text_asm_count;
+    const char **top_asm;
+    size_t top_asm_count;
+    struct gup_count *counts;
+    size_t count_len;
+    bool counts_read;
+};
+
+/*
+ * Represents a single pass within the pipeline
+ *
+ * @name: Name used on the command line
+ * @kind: Pass kind
+ * @level: Lowest optimization level this pass runs at
+ * @run: Pass entry, returns zero on success [@func is NULL for unit passes]
+ */
+struct gup_pass {
+    const char *name;
+    pass_kind_t kind;
+    uint8_t level;
+    int(*run)(struct gup_state *state, struct gup_func *func);
+};
+
+/*
+ * Run the pass pipeline over a retained function
+ *
+ * @state: Compiler state
+ * @func: Function to optimize
+ *
+ * Returns zero on success
+ */
+int pass_run(struct gup_state *state, struct gup_func *func);
+
+/*
+ * Run the machine passes over the instructions the
+ * backend holds for a function.
+ *
+ * @state: Compiler state
+ * @func: Function being emitted
+ *
+ * Returns zero on success
+ */
+int pass_run_machine(struct gup_state *state, struct gup_func *func);
+
+/*
+ * Run the unit passes over the translation unit held
+ * by the compiler state.
+ *
+ * @state: Compiler state
+ *
+ * Returns zero on success
+ */
+int pass_run_unit(struct gup_state *state);
+
+/*
+ * Force a pass on or off regardless of the optimization
+ * level, the pseudo pass "verify" controls the verifier.
+ *
+ * @name: Name of pass
+ * @enable: If true, enable the pass
+ *
+ * Returns zero on success
+ */
+int pass_toggle(const char *name, bool enable);
+
+/*
+ * Enable or disable per-pass timing
+ *
+ * @enable: If true, passes are timed
+ */
+void pass_set_timing(bool enable);
+
+/*
+ * Enable or disable the statistics report
+ *
+ * @enable: If true, statistics are reported
+ */
+void pass_set_stats(bool enable);
+
+/*
+ * Add to a named statistic
+ *
+ * @pass: Name of pass the statistic belongs to
+ * @what: Description of the statistic [static string]
+ * @v: Value to add
+ */
+void pass_stat(const char *pass, const char *what, size_t v);
+
+/*
+ * Write the per-pass timing and statistics report
+ *
+ * @fp: File to write report to
+ */
+void pass_report(FILE *fp);
+
+/*
+ * Pass entry points
+ */
+int pass_cold_blocks(struct gup_state *state, struct gup_func *func);
+int pass_unreachable(struct gup_state *state, struct gup_func *func);
+int pass_unroll(struct gup_state *state, struct gup_func *func);
+int pass_strength(struct gup_state *state, struct gup_func *func);
+int pass_static_init(struct gup_state *state, struct gup_func *func);
+int pass_store_merge(struct gup_state *state, struct gup_func *func);
+int pass_ipcp(struct gup_state *state, struct gup_func *func);
+int pass_tail_call(struct gup_state *state, struct gup_func *func);
+int pass_inline(struct gup_state *state, struct gup_func *func);
+int pass_dead_func(struct gup_state *state, struct gup_func *func);
+int pass_func_split(struct gup_state *state, struct gup_func *func);
+int pass_data_order(struct gup_state *state, struct gup_func *func);
+int pass_func_order(struct gup_state *state, struct gup_func *func);
+
+#endif  /* !GUP_PASS_H */
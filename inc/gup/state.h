@@ -7,25 +7,115 @@
 #define GUP_STATE_H 1
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include "gup/ptrbox.h"
 #include "gup/token.h"
 #include "gup/symbol.h"
+#include "gup/ir.h"
+
+struct gup_func;
+struct gup_unit;
 
 #define MAX_SCOPE_DEPTH 8
 #define ASMOUT_DEFAULT "gupgen.asm"
 
+/*
+ * Dump flags
+ *
+ * @GUP_DUMP_IR: Dump the IR of each function
+ * @GUP_DUMP_LAYOUT: Dump the layout of each struct
+ * @GUP_DUMP_MATCH: Dump how each match is dispatched
+ */
+#define GUP_DUMP_IR     (1 << 0)
+#define GUP_DUMP_LAYOUT (1 << 1)
+#define GUP_DUMP_MATCH  (1 << 2)
+
 /*
  * Represents valid program sections
  */
 typedef enum {
     SECTION_NONE,
     SECTION_TEXT,
+    SECTION_TEXT_HOT,
+    SECTION_TEXT_UNLIKELY,
+    SECTION_RODATA,
     SECTION_DATA,
     SECTION_BSS,
     SECTION_MAX
 } bin_section_t;
 
+/*
+ * A loop being compiled, its head is 'L.<id>' and
+ * its exit 'L.<id>.1'. A counted loop continues at
+ * 'L.<id>.2', where its counter is stepped.
+ *
+ * @id: Number of the loop
+ * @name: Label given to the loop [NULL if none]
+ * @counter: Iterations left [IR_VREG_NONE if not counted]
+ * @continued: Set if a 'continue' names the loop
+ */
+struct gup_loop {
+    size_t id;
+    const char *name;
+    ir_vreg_t counter;
+    bool continued;
+};
+
+/*
+ * A conditional being compiled, every arm of an
+ * 'if'/'else if' chain joins at 'L.<id>.1'. An arm
+ * that does not hold jumps ahead to 'L.<next>.2'.
+ *
+ * @id: Number of the conditional
+ * @next: Number of the arm being compiled
+ * @hint: Hint of the arm being compiled [AST_HINT_*]
+ * @joined: Set if an arm jumps to the end
+ * @has_else: Set once the final 'else' is open
+ */
+struct gup_cond {
+    size_t id;
+    size_t next;
+    uint8_t hint;
+    bool joined;
+    bool has_else;
+};
+
+/*
+ * A value a match arm is taken for
+ *
+ * @value: Value of the subject
+ * @arm: Index of the arm
+ */
+struct gup_case {
+    uint64_t value;
+    size_t arm;
+};
+
+/*
+ * A match being compiled. Arm <k> starts at 'L.<id>.c<k>',
+ * the default arm at 'L.<id>.2', and every arm jumps to
+ * 'L.<id>.1' at its end. The dispatch is only known once
+ * every arm is, it is then moved ahead of the arms.
+ *
+ * @id: Number of the match
+ * @subject: Value being matched
+ * @start: Index of the first instruction of the arms
+ * @cases: Values of every arm so far
+ * @case_count: Number of values
+ * @arm_count: Number of arms, not counting the default
+ * @has_default: Set if there is a default arm
+ */
+struct gup_match {
+    size_t id;
+    struct ir_val subject;
+    size_t start;
+    struct gup_case *cases;
+    size_t case_count;
+    size_t arm_count;
+    bool has_default;
+};
+
 /*
  * Represents the compiler state
  *
@@ -38,11 +128,27 @@ typedef enum {
  * @g_symtab: Global symbol table
  * @this_func: This function [NULL if not in func]
  * @have_return: Set if this function has a return statement
- * @loop_count: Number of loops present in program
+ * @loop_count: Number of loops, conditionals and matches present in program
+ * @loop_depth: Number of loops enclosing the current statement
+ * @loop_stack: Loops enclosing the current statement, innermost last
+ * @cond_depth: Number of conditionals enclosing the current statement
+ * @cond_stack: Conditionals enclosing the current statement, innermost last
+ * @match_depth: Number of matches enclosing the current statement
+ * @match_stack: Matches enclosing the current statement, innermost last
  * @scope_depth: How deep in '{}' [scope] are we?
  * @scope_stack: Used to keep track of scopes
  * @cur_section: Current section
  * @out_fp: Output file pointer
+ * @opt_level: Optimization level [-O]
+ * @cur_func: Function being compiled
+ * @dump_flags: What to dump [GUP_DUMP_*]
+ * @entry: Name of the program entry function
+ * @unit: Translation unit
+ * @profile: Path of the call count profile [NULL if none]
+ * @inline_limit: Largest function body inlined without 'inline' [bytes]
+ * @header: Path of the C header to write [NULL if none]
+ * @align_loops: Alignment of loop heads [bytes, 0 if none]
+ * @unroll_limit: Largest loop body unrolled without a hint [bytes]
  */
 struct gup_state {
     int in_fd;
@@ -55,10 +161,26 @@ struct gup_state {
     struct symbol *this_func;
     uint8_t have_return : 1;
     size_t loop_count;
+    size_t loop_depth;
+    struct gup_loop loop_stack[MAX_SCOPE_DEPTH];
+    size_t cond_depth;
+    struct gup_cond cond_stack[MAX_SCOPE_DEPTH];
+    size_t match_depth;
+    struct gup_match match_stack[MAX_SCOPE_DEPTH];
     size_t scope_depth;
     tt_t scope_stack[MAX_SCOPE_DEPTH];
     bin_section_t cur_section;
     FILE *out_fp;
+    uint8_t opt_level;
+    struct gup_func *cur_func;
+    uint32_t dump_flags;
+    const char *entry;
+    struct gup_unit *unit;
+    const char *profile;
+    size_t inline_limit;
+    const char *header;
+    size_t align_loops;
+    size_t unroll_limit;
 };
 
 /*
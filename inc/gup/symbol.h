@@ -9,32 +9,65 @@
 #include <sys/queue.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include "gup/ast.h"
 #include "gup/types.h"
 
+struct layout;
+
 typedef int32_t symid_t;
 
+/* Most parameters passed in registers [system V] */
+#define SYMBOL_MAX_PARAMS 6
+
+/* Most values returned in registers [rax:rdx] */
+#define SYMBOL_MAX_RETS 2
+
 /*
  * Returns valid symbol types
  *
  * @SYMBOL_TYPE_NONE: No type
  * @SYMBOL_TYPE_FUNC: Is a function
  * @SYMBOL_TYPE_STRUCT: Is a struct
+ * @SYMBOL_TYPE_INSTANCE: Is an instance of a struct
  */
 typedef enum {
     SYMBOL_TYPE_NONE,
     SYMBOL_TYPE_FUNC,
-    SYMBOL_TYPE_STRUCT
+    SYMBOL_TYPE_STRUCT,
+    SYMBOL_TYPE_INSTANCE
 } symtype_t;
 
+/*
+ * A parameter of a function
+ *
+ * @name: Parameter name
+ * @type: Parameter type
+ */
+struct symbol_param {
+    char *name;
+    gup_type_t type;
+};
+
 /*
  * Represents a program symbol
  *
  * @name: Symbol name (strdup'd)
  * @type: Symbol type
- * @data_type: Data type of symbol
+ * @data_type: Data type of symbol [first return value of functions]
  * @is_pub: If set, is public
- * @tree: Tree associated with this node
+ * @is_hot: If set, is frequently used
+ * @is_cold: If set, is rarely used [functions]
+ * @is_inline: If set, calls are always inlined [functions]
+ * @is_noinline: If set, calls are never inlined [functions]
+ * @is_extern: If set, defined outside of the unit with the C ABI [functions]
+ * @tree: Tree associated with this node [fields of the struct for instances]
+ * @layout: Memory layout [structs and instances]
+ * @data: Initial contents [instances, NULL if zeroed]
+ * @params: Parameters [functions]
+ * @param_count: Number of parameters
+ * @ret_types: Type of each return value [functions]
+ * @ret_count: Number of return values, zero if void
  * @link: Queue link
  */
 struct symbol {
@@ -43,7 +76,18 @@ struct symbol {
     gup_type_t data_type;
     symid_t id;
     uint8_t is_pub : 1;
+    uint8_t is_hot : 1;
+    uint8_t is_cold : 1;
+    uint8_t is_inline : 1;
+    uint8_t is_noinline : 1;
+    uint8_t is_extern : 1;
     struct ast_node *tree;
+    struct layout *layout;
+    uint8_t *data;
+    struct symbol_param params[SYMBOL_MAX_PARAMS];
+    uint8_t param_count;
+    gup_type_t ret_types[SYMBOL_MAX_RETS];
+    uint8_t ret_count;
     TAILQ_ENTRY(symbol) link;
 };
 
@@ -93,6 +137,17 @@ struct symbol *symbol_from_id(struct symbol_table *tbl, symid_t id);
  */
 struct symbol *symbol_from_name(struct symbol_table *tbl, const char *name);
 
+/*
+ * Returns true if a call to @callee may take the place
+ * of returning from @caller, that is @caller returns
+ * nothing or exactly what @callee returns and @callee
+ * is not an extern function.
+ *
+ * @caller: Function the call is in
+ * @callee: Function being called
+ */
+bool symbol_can_tail(const struct symbol *caller, const struct symbol *callee);
+
 /*
  * Initialize a symbol table
  *
@@ -19,8 +19,10 @@ typedef enum {
     TT_MINUS,       /* '-' */
     TT_SLASH,       /* '/' */
     TT_STAR,        /* '*' */
+    TT_PERCENT,     /* '%' */
     TT_EQUALS,      /* '=' */
     TT_EQUALITY,    /* '==' */
+    TT_NEQ,         /* '!=' */
     TT_LT,          /* '<' */
     TT_LTE,         /* '<=' */
     TT_GT,          /* '>' */
@@ -47,6 +49,25 @@ typedef enum {
     TT_BREAK,       /* 'break' */
     TT_CONTINUE,    /* 'continue' */
     TT_DOT,         /* '.' */
+    TT_COMMA,       /* ',' */
+    TT_ALIGN,       /* 'align' */
+    TT_CACHELINE,   /* 'cacheline' */
+    TT_HOT,         /* 'hot' */
+    TT_COLD,        /* 'cold' */
+    TT_INLINE,      /* 'inline' */
+    TT_NOINLINE,    /* 'noinline' */
+    TT_EXTERN,      /* 'extern' */
+    TT_BECOME,      /* 'become' */
+    TT_COLON,       /* ':' */
+    TT_LABEL,       /* '<IDENT> */
+    TT_UNROLL,      /* 'unroll' */
+    TT_IF,          /* 'if' */
+    TT_ELSE,        /* 'else' */
+    TT_LIKELY,      /* 'likely' */
+    TT_UNLIKELY,    /* 'unlikely' */
+    TT_MATCH,       /* 'match' */
+    TT_ARROW,       /* '=>' */
+    TT_ARM,         /* <MATCH ARM> */
 } tt_t;
 
 /*
@@ -6,6 +6,8 @@
 #ifndef GUP_TYPES_H
 #define GUP_TYPES_H 1
 
+#include <stddef.h>
+
 typedef enum {
     GUP_TYPE_BAD,
     GUP_TYPE_VOID,
@@ -16,4 +18,26 @@ typedef enum {
     GUP_TYPE_MAX
 } gup_type_t;
 
+/*
+ * Returns the size of a type in bytes
+ *
+ * @type: Type to get size of
+ */
+static inline size_t
+gup_type_size(gup_type_t type)
+{
+    switch (type) {
+    case GUP_TYPE_U8:
+        return 1;
+    case GUP_TYPE_U16:
+        return 2;
+    case GUP_TYPE_U32:
+        return 4;
+    case GUP_TYPE_U64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
 #endif  /* !GUP_TYPES_H */
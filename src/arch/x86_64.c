@@ -4,29 +4,68 @@
  */
 
 #include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include "gup/arch/x86_64.h"
+#include "gup/layout.h"
+#include "gup/trace.h"
+#include "gup/pass.h"
 #include "gup/mu.h"
 
-/*
- * Return value registers according to the system V
- * ABI
- */
-static const char *retregs[] = {
-    [MACH_REGSIZE_64] = "rax",
-    [MACH_REGSIZE_32] = "eax",
-    [MACH_REGSIZE_16] = "ah",
-    [MACH_REGSIZE_8]  = "al"
+/* Register names by width */
+static const char *reg64[] = {
+    [MC_REG_NONE] = "?",
+    [MC_RAX] = "rax", [MC_RCX] = "rcx", [MC_RDX] = "rdx", [MC_RBX] = "rbx",
+    [MC_RSP] = "rsp", [MC_RBP] = "rbp", [MC_RSI] = "rsi", [MC_RDI] = "rdi",
+    [MC_R8] = "r8", [MC_R9] = "r9", [MC_R10] = "r10", [MC_R11] = "r11",
+    [MC_R12] = "r12", [MC_R13] = "r13", [MC_R14] = "r14", [MC_R15] = "r15"
 };
 
-/* Size directives */
-static const char *asmszdir[] = {
-    [GUP_TYPE_BAD] = "bad",
-    [GUP_TYPE_VOID] = "bad",
-    [GUP_TYPE_U8] = "db",
-    [GUP_TYPE_U16] = "dw",
-    [GUP_TYPE_U32] = "dd",
-    [GUP_TYPE_U64] = "dq"
+static const char *reg32[] = {
+    [MC_REG_NONE] = "?",
+    [MC_RAX] = "eax", [MC_RCX] = "ecx", [MC_RDX] = "edx", [MC_RBX] = "ebx",
+    [MC_RSP] = "esp", [MC_RBP] = "ebp", [MC_RSI] = "esi", [MC_RDI] = "edi",
+    [MC_R8] = "r8d", [MC_R9] = "r9d", [MC_R10] = "r10d", [MC_R11] = "r11d",
+    [MC_R12] = "r12d", [MC_R13] = "r13d", [MC_R14] = "r14d", [MC_R15] = "r15d"
+};
+
+static const char *reg16[] = {
+    [MC_REG_NONE] = "?",
+    [MC_RAX] = "ax", [MC_RCX] = "cx", [MC_RDX] = "dx", [MC_RBX] = "bx",
+    [MC_RSP] = "sp", [MC_RBP] = "bp", [MC_RSI] = "si", [MC_RDI] = "di",
+    [MC_R8] = "r8w", [MC_R9] = "r9w", [MC_R10] = "r10w", [MC_R11] = "r11w",
+    [MC_R12] = "r12w", [MC_R13] = "r13w", [MC_R14] = "r14w", [MC_R15] = "r15w"
+};
+
+static const char *reg8[] = {
+    [MC_REG_NONE] = "?",
+    [MC_RAX] = "al", [MC_RCX] = "cl", [MC_RDX] = "dl", [MC_RBX] = "bl",
+    [MC_RSP] = "spl", [MC_RBP] = "bpl", [MC_RSI] = "sil", [MC_RDI] = "dil",
+    [MC_R8] = "r8b", [MC_R9] = "r9b", [MC_R10] = "r10b", [MC_R11] = "r11b",
+    [MC_R12] = "r12b", [MC_R13] = "r13b", [MC_R14] = "r14b", [MC_R15] = "r15b"
+};
+
+/* Arithmetic mnemonics */
+static const char *arithop[] = {
+    [MC_ADD] = "add",
+    [MC_SUB] = "sub",
+    [MC_IMUL] = "imul",
+    [MC_AND] = "and",
+    [MC_SHL] = "shl",
+    [MC_SHR] = "shr"
+};
+
+/* setcc and jcc suffixes by condition, comparisons are unsigned */
+static const char *ccname[] = {
+    [IR_COND_EQ] = "e",
+    [IR_COND_LT] = "b",
+    [IR_COND_LE] = "be",
+    [IR_COND_GT] = "a",
+    [IR_COND_GE] = "ae",
+    [IR_COND_NE] = "ne"
 };
 
 /* Size directives */
@@ -39,14 +78,75 @@ static const char *asmop[] = {
     [GUP_TYPE_U64] = "qword"
 };
 
-/* Section list */
+/* Section list, NASM takes sections it does not know for data */
 static const char *sectab[] = {
     [SECTION_NONE] = "none",
     [SECTION_TEXT] = ".text",
+    [SECTION_TEXT_HOT] = ".text.hot progbits alloc exec nowrite align=16",
+    [SECTION_TEXT_UNLIKELY] = ".text.unlikely progbits alloc exec nowrite align=16",
+    [SECTION_RODATA] = ".rodata",
     [SECTION_DATA] = ".data",
     [SECTION_BSS]  = ".bss"
 };
 
+/*
+ * Instructions of the function being emitted, held
+ * until registers are assigned.
+ */
+static struct mc_buf mcbuf;
+static bool mc_buffering = false;
+
+/* Jump table the entries being written belong to */
+static const char *mc_jtab;
+
+/* Text section of the function being emitted */
+static bin_section_t mc_text = SECTION_TEXT;
+
+/*
+ * Output of each section, written out one section after
+ * another by mu_cg_finish(). Anything emitted outside of
+ * a section [SECTION_NONE] comes first.
+ */
+static FILE *secbuf[SECTION_MAX];
+static char *secdata[SECTION_MAX];
+static size_t seclen[SECTION_MAX];
+
+/*
+ * Returns the stream that collects the output of a
+ * section, falls back to the output file if the stream
+ * cannot be created.
+ *
+ * @state: Compiler state
+ * @section: Section to get the stream of
+ */
+static FILE *
+mc_section_fp(struct gup_state *state, bin_section_t section)
+{
+    if (section >= SECTION_MAX) {
+        return state->out_fp;
+    }
+
+    if (secbuf[section] == NULL) {
+        secbuf[section] = open_memstream(&secdata[section], &seclen[section]);
+        if (secbuf[section] == NULL) {
+            return state->out_fp;
+        }
+    }
+
+    return secbuf[section];
+}
+
+/*
+ * Returns the stream of the current section
+ *
+ * @state: Compiler state
+ */
+static inline FILE *
+mc_out(struct gup_state *state)
+{
+    return mc_section_fp(state, state->cur_section);
+}
+
 static void
 cg_assert_section(struct gup_state *state, bin_section_t section)
 {
@@ -54,217 +154,1178 @@ cg_assert_section(struct gup_state *state, bin_section_t section)
         return;
     }
 
-    if (state->cur_section != section) {
+    state->cur_section = section;
+}
+
+/* Register names by register size */
+static const char **regsz[] = {
+    [MACH_REGSIZE_64] = reg64,
+    [MACH_REGSIZE_32] = reg32,
+    [MACH_REGSIZE_16] = reg16,
+    [MACH_REGSIZE_8]  = reg8
+};
+
+/*
+ * Argument and return value registers according to
+ * the system V ABI
+ */
+static const mc_reg_t argregs[] = {
+    MC_RDI, MC_RSI, MC_RDX, MC_RCX, MC_R8, MC_R9
+};
+
+static const mc_reg_t retregs[] = {
+    MC_RAX, MC_RDX
+};
+
+#define ARGREG_COUNT (sizeof(argregs) / sizeof(argregs[0]))
+#define RETREG_COUNT (sizeof(retregs) / sizeof(retregs[0]))
+
+/*
+ * Returns the name of a register at a given width
+ *
+ * @reg: Register [MC_REG_*]
+ * @type: Width of the access
+ */
+static const char *
+mc_regname(uint32_t reg, gup_type_t type)
+{
+    if (reg >= MC_REG_MAX) {
+        reg = MC_REG_NONE;
+    }
+
+    switch (type) {
+    case GUP_TYPE_U8:
+        return reg8[reg];
+    case GUP_TYPE_U16:
+        return reg16[reg];
+    case GUP_TYPE_U32:
+        return reg32[reg];
+    default:
+        return reg64[reg];
+    }
+}
+
+/*
+ * Format the memory operand of a machine instruction
+ *
+ * @insn: Instruction [sym + off]
+ * @buf: Buffer to write to
+ * @len: Length of @buf
+ */
+static const char *
+mc_mem(const struct mc_insn *insn, char *buf, size_t len)
+{
+    if (insn->off == 0) {
+        snprintf(buf, len, "%s [rel %s]", asmop[insn->size], insn->sym);
+    } else {
+        snprintf(buf, len, "%s [rel %s + %zu]", asmop[insn->size], insn->sym, insn->off);
+    }
+
+    return buf;
+}
+
+/*
+ * Write the source operand of an arithmetic instruction
+ *
+ * @fp: Stream to write to
+ * @insn: Instruction to write the source of
+ */
+static void
+mc_print_src(FILE *fp, const struct mc_insn *insn)
+{
+    if (insn->flags & MC_F_IMM) {
+        fprintf(fp, "%zd", insn->imm);
+        return;
+    }
+
+    fprintf(fp, "%s", reg64[insn->src]);
+}
+
+/*
+ * Write a single machine instruction to the output
+ *
+ * @state: Compiler state
+ * @insn: Instruction to write
+ */
+static void
+mc_print(struct gup_state *state, const struct mc_insn *insn)
+{
+    FILE *fp = mc_out(state);
+    char mem[256];
+
+    switch (insn->op) {
+    case MC_LABEL:
+        /* Padding before a loop head runs once, on entry */
+        if ((insn->flags & MC_F_LOOP) && state->align_loops > 1) {
+            fprintf(fp, "align %zu\n", state->align_loops);
+        }
+
+        fprintf(fp, "%s:\n", insn->sym);
+        break;
+    case MC_JMP:
+        fprintf(fp, "\tjmp %s\n", insn->sym);
+        break;
+    case MC_CALL:
+        fprintf(fp, "\tcall %s\n", insn->sym);
+        break;
+    case MC_RET:
+        fprintf(fp, "\tret\n");
+        break;
+    case MC_MOVRET:
         fprintf(
-            state->out_fp,
-            "section %s\n",
-            sectab[section]
+            fp,
+            "\tmov %s, %zd\n",
+            regsz[insn->size][insn->dst],
+            insn->imm
         );
+        break;
+    case MC_XORRET:
+        fprintf(fp, "\txor %s, %s\n", reg32[insn->dst], reg32[insn->dst]);
+        break;
+    case MC_STORE:
+        /* There is no store of a 64-bit immediate, it goes through r11 */
+        if (insn->size == GUP_TYPE_U64 && (int64_t)insn->imm != (int32_t)insn->imm) {
+            fprintf(fp, "\tmov r11, %zu\n", (size_t)insn->imm);
+            fprintf(fp, "\tmov %s, r11\n", mc_mem(insn, mem, sizeof(mem)));
+            break;
+        }
+
+        if (insn->off == 0) {
+            fprintf(
+                fp,
+                "\tmov %s [rel %s], %zu\n",
+                asmop[insn->size],
+                insn->sym,
+                (size_t)insn->imm
+            );
+            break;
+        }
+
+        fprintf(
+            fp,
+            "\tmov %s [rel %s + %zu], %zu\n",
+            asmop[insn->size],
+            insn->sym,
+            insn->off,
+            (size_t)insn->imm
+        );
+        break;
+    case MC_ASM:
+        fprintf(fp, "\t%s\n", insn->sym);
+        break;
+    case MC_MOVI:
+        /* Writes to a 32-bit register clear the upper half */
+        if (insn->imm == 0) {
+            fprintf(fp, "\txor %s, %s\n", reg32[insn->dst], reg32[insn->dst]);
+        } else if ((size_t)insn->imm <= UINT32_MAX) {
+            fprintf(fp, "\tmov %s, %zu\n", reg32[insn->dst], (size_t)insn->imm);
+        } else {
+            fprintf(fp, "\tmov %s, %zu\n", reg64[insn->dst], (size_t)insn->imm);
+        }
+        break;
+    case MC_MOV:
+        if (insn->dst != insn->src) {
+            fprintf(fp, "\tmov %s, %s\n", reg64[insn->dst], reg64[insn->src]);
+        }
+        break;
+    case MC_LOAD:
+        if (insn->size == GUP_TYPE_U8 || insn->size == GUP_TYPE_U16) {
+            fprintf(fp, "\tmovzx %s, %s\n", reg32[insn->dst], mc_mem(insn, mem, sizeof(mem)));
+            break;
+        }
+
+        fprintf(
+            fp,
+            "\tmov %s, %s\n",
+            mc_regname(insn->dst, insn->size),
+            mc_mem(insn, mem, sizeof(mem))
+        );
+        break;
+    case MC_STORER:
+        fprintf(
+            fp,
+            "\tmov %s, %s\n",
+            mc_mem(insn, mem, sizeof(mem)),
+            mc_regname(insn->src, insn->size)
+        );
+        break;
+    case MC_IMUL:
+        if (insn->flags & MC_F_IMM) {
+            fprintf(fp, "\timul %s, %s, %zd\n", reg64[insn->dst], reg64[insn->dst], insn->imm);
+            break;
+        }
+        /* Fallthrough */
+    case MC_ADD:
+    case MC_SUB:
+    case MC_AND:
+    case MC_SHL:
+    case MC_SHR:
+        fprintf(fp, "\t%s %s, ", arithop[insn->op], reg64[insn->dst]);
+        mc_print_src(fp, insn);
+        fprintf(fp, "\n");
+        break;
+    case MC_ZEXT:
+        if (insn->size == GUP_TYPE_U32) {
+            fprintf(fp, "\tmov %s, %s\n", reg32[insn->dst], reg32[insn->dst]);
+            break;
+        }
+
+        fprintf(
+            fp,
+            "\tmovzx %s, %s\n",
+            reg32[insn->dst],
+            mc_regname(insn->dst, insn->size)
+        );
+        break;
+    case MC_DIV:
+    case MC_MOD:
+        fprintf(fp, "\tmov rax, %s\n", reg64[insn->dst]);
+        fprintf(fp, "\txor edx, edx\n");
+        fprintf(fp, "\tdiv %s\n", reg64[insn->src]);
+        fprintf(fp, "\tmov %s, %s\n", reg64[insn->dst], insn->op == MC_DIV ? "rax" : "rdx");
+        break;
+    case MC_MULHI:
+        fprintf(fp, "\tmov rax, ");
+        mc_print_src(fp, insn);
+        fprintf(fp, "\n\tmul %s\n", reg64[insn->dst]);
+        fprintf(fp, "\tmov %s, rdx\n", reg64[insn->dst]);
+        break;
+    case MC_SETCC:
+        fprintf(fp, "\tcmp %s, ", reg64[insn->dst]);
+        mc_print_src(fp, insn);
+        fprintf(fp, "\n\tset%s %s\n", ccname[insn->cond], reg8[insn->dst]);
+        fprintf(fp, "\tmovzx %s, %s\n", reg32[insn->dst], reg8[insn->dst]);
+        break;
+    case MC_PUSH:
+        fprintf(fp, "\tpush %s\n", reg64[insn->src]);
+        break;
+    case MC_POP:
+        fprintf(fp, "\tpop %s\n", reg64[insn->dst]);
+        break;
+    case MC_SUBRSP:
+        fprintf(fp, "\tsub rsp, %zd\n", insn->imm);
+        break;
+    case MC_ADDRSP:
+        fprintf(fp, "\tadd rsp, %zd\n", insn->imm);
+        break;
+    case MC_SPILL:
+        fprintf(fp, "\tmov qword [rsp + %zu], %s\n", insn->off, reg64[insn->src]);
+        break;
+    case MC_RELOAD:
+        fprintf(fp, "\tmov %s, qword [rsp + %zu]\n", reg64[insn->dst], insn->off);
+        break;
+    case MC_DEC:
+        fprintf(fp, "\tdec %s\n", reg64[insn->dst]);
+        break;
+    case MC_CMP:
+        /* Comparing against zero is shorter as a test */
+        if ((insn->flags & MC_F_IMM) && insn->imm == 0) {
+            fprintf(fp, "\ttest %s, %s\n", reg64[insn->dst], reg64[insn->dst]);
+            break;
+        }
+
+        fprintf(fp, "\tcmp %s, ", reg64[insn->dst]);
+        mc_print_src(fp, insn);
+        fprintf(fp, "\n");
+        break;
+    case MC_JCC:
+        fprintf(fp, "\tj%s %s\n", ccname[insn->cond], insn->sym);
+        break;
+    case MC_BT:
+        fprintf(fp, "\tmov r11, %zu\n", (size_t)insn->imm);
+        fprintf(fp, "\tbt r11, %s\n", reg64[insn->dst]);
+        break;
+    case MC_JTAB:
+        /* Entries are offsets from the anchor, the table needs no relocations */
+        fprintf(fp, "%s.a:\n", insn->sym);
+        fprintf(fp, "\tlea r11, [rel %s]\n", insn->sym);
+        fprintf(fp, "\tmovsxd %s, dword [r11 + %s*4]\n", reg64[insn->dst], reg64[insn->dst]);
+        fprintf(fp, "\tlea r11, [rel %s.a]\n", insn->sym);
+        fprintf(fp, "\tadd r11, %s\n", reg64[insn->dst]);
+        fprintf(fp, "\tjmp r11\n");
+        fprintf(mc_section_fp(state, SECTION_RODATA), "align 4\n%s:\n", insn->sym);
+        mc_jtab = insn->sym;
+        break;
+    case MC_CASE:
+        fprintf(
+            mc_section_fp(state, SECTION_RODATA),
+            "\tdd %s - %s.a\n",
+            insn->sym,
+            mc_jtab
+        );
+        break;
+    case MC_MOVRETR:
+        /* Values are held zero extended, so eax covers the narrow widths */
+        if (insn->size == MACH_REGSIZE_64) {
+            fprintf(fp, "\tmov %s, %s\n", reg64[insn->dst], reg64[insn->src]);
+        } else {
+            fprintf(fp, "\tmov %s, %s\n", reg32[insn->dst], reg32[insn->src]);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Emit a machine instruction, either to the output or
+ * to the buffer of the current function.
+ *
+ * @state: Compiler state
+ * @insn: Instruction to emit
+ */
+static int
+mc_emit(struct gup_state *state, const struct mc_insn *insn)
+{
+    struct mc_insn *insns;
+    size_t new_cap;
+
+    if (!mc_buffering) {
+        mc_print(state, insn);
+        return 0;
+    }
 
-        state->cur_section = section;
+    if (mcbuf.count >= mcbuf.cap) {
+        new_cap = (mcbuf.cap == 0) ? 64 : mcbuf.cap * 2;
+        insns = realloc(mcbuf.insns, new_cap * sizeof(*insns));
+        if (insns == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        mcbuf.insns = insns;
+        mcbuf.cap = new_cap;
     }
+
+    mcbuf.insns[mcbuf.count++] = *insn;
+    return 0;
 }
 
 int
-mu_cg_funcp(struct gup_state *state, const char *name, bool is_global)
+mu_cg_funcp(struct gup_state *state, const char *name, bool is_global,
+    bin_section_t section)
 {
+    struct mc_insn insn = { .op = MC_LABEL, .flags = MC_F_ENTRY, .sym = name };
+
     if (state == NULL || name == NULL) {
         errno = -EINVAL;
         return -1;
     }
 
+    if (section != SECTION_TEXT_HOT && section != SECTION_TEXT_UNLIKELY) {
+        section = SECTION_TEXT;
+    }
+
     if (is_global) {
-        fprintf(state->out_fp, "[global %s]\n", name);
+        fprintf(mc_section_fp(state, SECTION_NONE), "[global %s]\n", name);
     }
 
-    cg_assert_section(state, SECTION_TEXT);
-    fprintf(
-        state->out_fp,
-        "%s:\n",
-        name
-    );
-    return 0;
+    mc_text = section;
+    cg_assert_section(state, mc_text);
+
+    /* Hold the body back for the machine passes and registers */
+    mcbuf.count = 0;
+    mc_buffering = true;
+    return mc_emit(state, &insn);
+}
+
+int
+mu_cg_flush(struct gup_state *state)
+{
+    int error = 0;
+
+    if (state == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (!mc_buffering) {
+        return 0;
+    }
+
+    cg_assert_section(state, mc_text);
+    if ((error = mc_regalloc(state, &mcbuf)) == 0) {
+        for (size_t i = 0; i < mcbuf.count; ++i) {
+            mc_print(state, &mcbuf.insns[i]);
+        }
+    }
+
+    mcbuf.count = 0;
+    mc_buffering = false;
+    return error;
+}
+
+int
+mu_pass_peephole(struct gup_state *state, struct gup_func *func)
+{
+    if (!mc_buffering) {
+        return 0;
+    }
+
+    return mc_peephole(state, &mcbuf);
 }
 
 int
 mu_cg_asm(struct gup_state *state, const char *asm_str)
 {
+    struct mc_insn insn = { .op = MC_ASM, .sym = asm_str };
+
     if (state == NULL || asm_str == NULL) {
         errno = -EINVAL;
         return -1;
     }
 
-    fprintf(
-        state->out_fp,
-        "\t%s\n",
-        asm_str
-    );
+    return mc_emit(state, &insn);
+}
+
+int
+mu_cg_textasm(struct gup_state *state, const char *asm_str)
+{
+    if (state == NULL || asm_str == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
 
-    return 0;
+    cg_assert_section(state, SECTION_TEXT);
+    return mu_cg_asm(state, asm_str);
 }
 
 int
 mu_cg_retimm(struct gup_state *state, regsize_t regsize, ssize_t imm)
 {
+    struct mc_insn insn = {
+        .op = MC_MOVRET,
+        .size = regsize,
+        .dst = MC_RAX,
+        .imm = imm
+    };
+
     if (state == NULL || regsize >= MACH_REGSIZE_MAX) {
         errno = -EINVAL;
         return -1;
     }
 
-    fprintf(
-        state->out_fp,
-        "\tmov %s, %zd\n"
-        "\tret\n",
-        retregs[regsize],
-        imm
-    );
+    if (mc_emit(state, &insn) < 0) {
+        return -1;
+    }
 
-    return 0;
+    insn.op = MC_RET;
+    return mc_emit(state, &insn);
+}
+
+int
+mu_cg_setret(struct gup_state *state, size_t idx, regsize_t regsize, ssize_t imm)
+{
+    struct mc_insn insn = { .op = MC_MOVRET, .size = regsize, .imm = imm };
+
+    if (state == NULL || idx >= RETREG_COUNT || regsize >= MACH_REGSIZE_MAX) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    insn.dst = retregs[idx];
+    return mc_emit(state, &insn);
+}
+
+int
+mu_cg_movret(struct gup_state *state, size_t idx, regsize_t regsize, ir_vreg_t vreg)
+{
+    struct mc_insn insn = { .op = MC_MOVRETR, .size = regsize, .src = MC_VREG(vreg) };
+
+    if (state == NULL || idx >= RETREG_COUNT || regsize >= MACH_REGSIZE_MAX ||
+        vreg == IR_VREG_NONE) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    insn.dst = retregs[idx];
+    return mc_emit(state, &insn);
+}
+
+static int mc_setreg(struct gup_state *state, uint32_t reg, const struct ir_val *val);
+
+/*
+ * Copy a register the ABI hands a value over in to a
+ * virtual register, the bits past the width of the value
+ * are not defined by the ABI and so are cleared.
+ *
+ * @state: Compiler state
+ * @reg: Register holding the value
+ * @type: Type of the value
+ * @vreg: Virtual register to copy into
+ */
+static int
+mc_copy_abi(struct gup_state *state, mc_reg_t reg, gup_type_t type, ir_vreg_t vreg)
+{
+    struct mc_insn insn = { .op = MC_MOV, .dst = MC_VREG(vreg), .src = reg };
+
+    if (mc_emit(state, &insn) < 0) {
+        return -1;
+    }
+
+    if (type >= GUP_TYPE_U64) {
+        return 0;
+    }
+
+    insn = (struct mc_insn){ .op = MC_ZEXT, .size = type, .dst = MC_VREG(vreg) };
+    return mc_emit(state, &insn);
+}
+
+int
+mu_cg_param(struct gup_state *state, size_t idx, gup_type_t type, ir_vreg_t vreg)
+{
+    if (state == NULL || idx >= ARGREG_COUNT || vreg == IR_VREG_NONE) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    return mc_copy_abi(state, argregs[idx], type, vreg);
+}
+
+int
+mu_cg_arg(struct gup_state *state, size_t idx, const struct ir_val *val)
+{
+    if (state == NULL || idx >= ARGREG_COUNT || val == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    return mc_setreg(state, argregs[idx], val);
+}
+
+int
+mu_cg_result(struct gup_state *state, size_t idx, gup_type_t type, ir_vreg_t vreg)
+{
+    if (state == NULL || idx >= RETREG_COUNT || vreg == IR_VREG_NONE) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    return mc_copy_abi(state, retregs[idx], type, vreg);
 }
 
 int
 mu_cg_retvoid(struct gup_state *state)
 {
+    struct mc_insn insn = { .op = MC_RET };
+
     if (state == NULL) {
         errno = -EINVAL;
         return -1;
     }
 
-    fprintf(
-        state->out_fp,
-        "\tret\n"
-    );
-
-    return 0;
+    return mc_emit(state, &insn);
 }
 
 int
-mu_cg_call(struct gup_state *state, const char *label)
+mu_cg_call(struct gup_state *state, const char *label, bool is_extern)
 {
+    struct mc_insn insn = { .op = MC_CALL, .sym = label };
+
     if (state == NULL || label == NULL) {
         errno = -EINVAL;
         return -1;
     }
 
-    fprintf(
-        state->out_fp,
-        "\tcall %s\n",
-        label
-    );
+    if (is_extern) {
+        insn.flags |= MC_F_EXTERN;
+    }
+
+    return mc_emit(state, &insn);
+}
 
+int
+mu_cg_extern(struct gup_state *state, const char *name)
+{
+    if (state == NULL || name == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    fprintf(mc_section_fp(state, SECTION_NONE), "[extern %s]\n", name);
     return 0;
 }
 
 int
 mu_cg_jmp(struct gup_state *state, const char *label)
 {
+    struct mc_insn insn = { .op = MC_JMP, .sym = label };
+
     if (state == NULL || label == NULL) {
         errno = -EINVAL;
         return -1;
     }
 
-    fprintf(
-        state->out_fp,
-        "\tjmp %s\n",
-        label
-    );
+    return mc_emit(state, &insn);
+}
+
+/*
+ * Name the fields of a struct instance, each field name
+ * expands to an offset from the instance so inline
+ * assembly may still refer to fields by name.
+ *
+ * @state: Compiler state
+ * @name: Instance name
+ * @prefix: Field path so far
+ * @base: Offset of @layout within the instance
+ * @layout: Layout to name the fields of
+ */
+static void
+cg_struct_fields(struct gup_state *state, const char *name, const char *prefix,
+    size_t base, const struct layout *layout)
+{
+    const struct layout_field *field;
+    char path[256];
+
+    for (size_t i = 0; i < layout->field_count; ++i) {
+        field = &layout->fields[i];
+        snprintf(path, sizeof(path), "%s.%s", prefix, field->node->str);
+
+        if (field->node->type == AST_OP_STRUCT) {
+            cg_struct_fields(
+                state, name, path,
+                base + field->off,
+                field->node->symbol->layout
+            );
+            continue;
+        }
 
+        fprintf(
+            mc_section_fp(state, SECTION_NONE),
+            "%%define %s (%s + %zu)\n",
+            path,
+            name,
+            base + field->off
+        );
+    }
+}
+
+int
+mu_cg_struct(struct gup_state *state, const char *name, const struct layout *layout)
+{
+    if (state == NULL || name == NULL || layout == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    cg_struct_fields(state, name, name, 0, layout);
     return 0;
 }
 
 int
-mu_cg_struct(struct gup_state *state, const char *name, struct ast_node *node)
+mu_cg_object(struct gup_state *state, const char *name, const struct layout *layout,
+    const uint8_t *data)
 {
-    if (state == NULL || node == NULL) {
+    if (state == NULL || name == NULL || layout == NULL) {
         errno = -EINVAL;
         return -1;
     }
 
+    /* Zeroed objects only need reserving */
+    if (data == NULL) {
+        cg_assert_section(state, SECTION_BSS);
+        if (layout->align > 1) {
+            fprintf(mc_out(state), "alignb %zu\n", layout->align);
+        }
+
+        fprintf(mc_out(state), "%s: resb %zu\n", name, layout->size);
+        return 0;
+    }
+
     cg_assert_section(state, SECTION_DATA);
-    node = node->right;
+    if (layout->align > 1) {
+        fprintf(mc_out(state), "align %zu, db 0\n", layout->align);
+    }
 
-    while (node != NULL) {
-        if (node->str == NULL) {
-            node = node->right;
-            continue;
-        }
+    fprintf(mc_out(state), "%s:", name);
+    for (size_t i = 0; i < layout->size; ++i) {
+        fprintf(
+            mc_out(state),
+            (i % 16 == 0) ? "\n\tdb %u" : ", %u",
+            data[i]
+        );
+    }
+
+    fprintf(mc_out(state), "\n");
+    return 0;
+}
 
-        /* Is this a structure field? */
-        if (node->type == AST_OP_STRUCT) {
-            if (mu_cg_struct(state, name, node->left) < 0)
-                return -1;
+int
+mu_cg_finish(struct gup_state *state)
+{
+    if (state == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
 
-            node = node->right;
+    for (bin_section_t i = 0; i < SECTION_MAX; ++i) {
+        if (secbuf[i] == NULL) {
             continue;
         }
 
-        if (node->data_type < GUP_TYPE_MAX) {
-            fprintf(
-                state->out_fp,
-                "%s.%s: %s 0\n",
-                name,
-                node->str,
-                asmszdir[node->data_type]
-            );
+        fclose(secbuf[i]);
+        if (seclen[i] > 0 && i != SECTION_NONE) {
+            fprintf(state->out_fp, "section %s\n", sectab[i]);
         }
-        node = node->right;
+
+        fwrite(secdata[i], 1, seclen[i], state->out_fp);
+        free(secdata[i]);
+        secbuf[i] = NULL;
+        secdata[i] = NULL;
+        seclen[i] = 0;
     }
 
+    state->cur_section = SECTION_NONE;
     return 0;
 }
 
 int
-mu_cg_loopstart(struct gup_state *state)
+mu_cg_loopstart(struct gup_state *state, const char *name)
 {
-    if (state == NULL) {
+    struct mc_insn insn = { .op = MC_LABEL, .flags = MC_F_LOOP, .sym = name };
+
+    if (state == NULL || name == NULL) {
         return -1;
     }
 
-    cg_assert_section(state, SECTION_TEXT);
-    fprintf(
-        state->out_fp,
-        "L.%zu:\n",
-        state->loop_count++
-    );
-
-    return 0;
+    cg_assert_section(state, mc_text);
+    return mc_emit(state, &insn);
 }
 
 int
 mu_cg_label(struct gup_state *state, const char *name)
 {
+    struct mc_insn insn = { .op = MC_LABEL, .sym = name };
+
     if (state == NULL || name == NULL) {
         return -1;
     }
 
-    cg_assert_section(state, SECTION_TEXT);
-    fprintf(
-        state->out_fp,
-        "%s:\n",
-        name
-    );
-
-    return 0;
+    cg_assert_section(state, mc_text);
+    return mc_emit(state, &insn);
 }
 
-int mu_cg_setlabel(struct gup_state *state, regsize_t size, const char *name,
-    size_t v)
+int mu_cg_setlabel(struct gup_state *state, gup_type_t type, const char *name,
+    size_t off, size_t v)
 {
+    struct mc_insn insn = {
+        .op = MC_STORE,
+        .size = type,
+        .sym = name,
+        .imm = v,
+        .off = off
+    };
+
     if (state == NULL || name == NULL) {
         return -1;
     }
 
-    if (size >= MACH_REGSIZE_MAX) {
+    if (type >= GUP_TYPE_MAX) {
+        return -1;
+    }
+
+    return mc_emit(state, &insn);
+}
+
+int
+mu_cg_storereg(struct gup_state *state, gup_type_t type, const char *name,
+    size_t off, ir_vreg_t vreg)
+{
+    struct mc_insn insn = {
+        .op = MC_STORER,
+        .size = type,
+        .src = MC_VREG(vreg),
+        .sym = name,
+        .off = off
+    };
+
+    if (state == NULL || name == NULL || vreg == IR_VREG_NONE) {
+        return -1;
+    }
+
+    if (type >= GUP_TYPE_MAX) {
+        return -1;
+    }
+
+    return mc_emit(state, &insn);
+}
+
+/*
+ * Load an IR operand into a register
+ *
+ * @state: Compiler state
+ * @reg: Register to load
+ * @val: Operand to load
+ */
+static int
+mc_setreg(struct gup_state *state, uint32_t reg, const struct ir_val *val)
+{
+    struct mc_insn insn = { .dst = reg };
+
+    switch (val->type) {
+    case IR_VAL_IMM:
+        insn.op = MC_MOVI;
+        insn.imm = val->imm;
+        break;
+    case IR_VAL_VREG:
+        insn.op = MC_MOV;
+        insn.src = MC_VREG(val->vreg);
+        break;
+    default:
+        errno = -EINVAL;
+        return -1;
+    }
+
+    return mc_emit(state, &insn);
+}
+
+/*
+ * Set the source operand of an arithmetic instruction,
+ * an immediate that cannot be encoded is first moved
+ * into r11.
+ *
+ * @state: Compiler state
+ * @insn: Instruction to set the source of
+ * @val: Source operand
+ */
+static int
+mc_setsrc(struct gup_state *state, struct mc_insn *insn, const struct ir_val *val)
+{
+    bool encodable;
+
+    if (val->type == IR_VAL_VREG) {
+        insn->src = MC_VREG(val->vreg);
+        return 0;
+    }
+
+    /* Only 'mov rax, imm64' takes a full immediate */
+    switch (insn->op) {
+    case MC_DIV:
+    case MC_MOD:
+        encodable = false;
+        break;
+    case MC_MULHI:
+        encodable = true;
+        break;
+    default:
+        encodable = (int64_t)val->imm == (int32_t)val->imm;
+        break;
+    }
+
+    if (encodable) {
+        insn->flags |= MC_F_IMM;
+        insn->imm = val->imm;
+        return 0;
+    }
+
+    insn->src = MC_R11;
+    return mc_setreg(state, MC_R11, val);
+}
+
+int
+mu_cg_op(struct gup_state *state, const struct ir_insn *insn)
+{
+    struct mc_insn mc = { 0 };
+
+    if (state == NULL || insn == NULL || insn->dst == IR_VREG_NONE) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    mc.dst = MC_VREG(insn->dst);
+    if (insn->op == IR_LOAD) {
+        mc.op = MC_LOAD;
+        mc.size = insn->width;
+        mc.sym = insn->sym;
+        mc.off = insn->off;
+        return mc_emit(state, &mc);
+    }
+
+    /* Two operand form, the first operand is copied to the destination */
+    if (mc_setreg(state, mc.dst, &insn->a) < 0) {
         return -1;
     }
 
-    fprintf(
-        state->out_fp,
-        "\tmov %s [rel %s], %zu\n",
-        asmop[size],
-        name,
-        v
-    );
+    switch (insn->op) {
+    case IR_MOV:
+        return 0;
+    case IR_ADD:
+        mc.op = MC_ADD;
+        break;
+    case IR_SUB:
+        mc.op = MC_SUB;
+        break;
+    case IR_MUL:
+        mc.op = MC_IMUL;
+        break;
+    case IR_AND:
+        mc.op = MC_AND;
+        if (insn->b.type != IR_VAL_IMM) {
+            break;
+        }
+
+        /* Masking to a narrower type is a zero extension */
+        switch (insn->b.imm) {
+        case UINT8_MAX:
+            mc.size = GUP_TYPE_U8;
+            break;
+        case UINT16_MAX:
+            mc.size = GUP_TYPE_U16;
+            break;
+        case UINT32_MAX:
+            mc.size = GUP_TYPE_U32;
+            break;
+        default:
+            break;
+        }
+
+        if (mc.size != 0) {
+            mc.op = MC_ZEXT;
+            return mc_emit(state, &mc);
+        }
+        break;
+    case IR_SHL:
+        mc.op = MC_SHL;
+        break;
+    case IR_SHR:
+        mc.op = MC_SHR;
+        break;
+    case IR_DIV:
+        mc.op = MC_DIV;
+        break;
+    case IR_MOD:
+        mc.op = MC_MOD;
+        break;
+    case IR_MULHI:
+        mc.op = MC_MULHI;
+        break;
+    case IR_CMP:
+        mc.op = MC_SETCC;
+        mc.cond = insn->flags;
+        break;
+    default:
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((mc.op == MC_SHL || mc.op == MC_SHR) && insn->b.type != IR_VAL_IMM) {
+        trace_error(state, "[CG] shift by a register is not supported\n");
+        return -1;
+    }
+
+    if (mc_setsrc(state, &mc, &insn->b) < 0) {
+        return -1;
+    }
+
+    if (mc_emit(state, &mc) < 0) {
+        return -1;
+    }
+
+    /* Bits carried past the width are cleared again */
+    switch (mc.op) {
+    case MC_ADD:
+    case MC_SUB:
+    case MC_IMUL:
+    case MC_SHL:
+        if (insn->width >= GUP_TYPE_U64) {
+            break;
+        }
+
+        mc = (struct mc_insn){ .op = MC_ZEXT, .size = insn->width, .dst = mc.dst };
+        return mc_emit(state, &mc);
+    default:
+        break;
+    }
 
     return 0;
 }
+
+int
+mu_cg_br(struct gup_state *state, const struct ir_insn *insn, const char *label)
+{
+    struct mc_insn mc = { .op = MC_CMP };
+    struct mc_insn jcc = { .op = MC_JCC, .cond = insn->flags, .sym = label };
+
+    if (state == NULL || label == NULL || insn->a.type != IR_VAL_VREG) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    mc.dst = MC_VREG(insn->a.vreg);
+    if (mc_setsrc(state, &mc, &insn->b) < 0) {
+        return -1;
+    }
+
+    if (mc_emit(state, &mc) < 0) {
+        return -1;
+    }
+
+    return mc_emit(state, &jcc);
+}
+
+int
+mu_cg_decjnz(struct gup_state *state, ir_vreg_t vreg, const char *label)
+{
+    struct mc_insn dec = { .op = MC_DEC, .dst = MC_VREG(vreg) };
+    struct mc_insn jcc = { .op = MC_JCC, .cond = IR_COND_NE, .sym = label };
+
+    if (state == NULL || label == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (mc_emit(state, &dec) < 0) {
+        return -1;
+    }
+
+    return mc_emit(state, &jcc);
+}
+
+int
+mu_cg_bt(struct gup_state *state, const struct ir_insn *insn, const char *label)
+{
+    struct mc_insn bt = { .op = MC_BT };
+    struct mc_insn jcc = { .op = MC_JCC, .cond = IR_COND_LT, .sym = label };
+
+    if (state == NULL || label == NULL || insn->a.type != IR_VAL_VREG ||
+        insn->b.type != IR_VAL_IMM) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* The bit lands in the carry flag, jc is jb */
+    bt.dst = MC_VREG(insn->a.vreg);
+    bt.imm = insn->b.imm;
+    if (mc_emit(state, &bt) < 0) {
+        return -1;
+    }
+
+    return mc_emit(state, &jcc);
+}
+
+int
+mu_cg_jtab(struct gup_state *state, ir_vreg_t vreg, const char *table)
+{
+    struct mc_insn insn = { .op = MC_JTAB, .dst = MC_VREG(vreg), .sym = table };
+
+    if (state == NULL || table == NULL || vreg == IR_VREG_NONE) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    return mc_emit(state, &insn);
+}
+
+int
+mu_cg_case(struct gup_state *state, const char *label)
+{
+    struct mc_insn insn = { .op = MC_CASE, .sym = label };
+
+    if (state == NULL || label == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    return mc_emit(state, &insn);
+}
+
+size_t
+mu_insn_size(const struct ir_insn *insn)
+{
+    /* mov [rel x], imm by width, including the ModRM and disp32 */
+    static const size_t storesz[] = {
+        [GUP_TYPE_U8] = 7,
+        [GUP_TYPE_U16] = 9,
+        [GUP_TYPE_U32] = 10,
+        [GUP_TYPE_U64] = 11
+    };
+
+    /* mov <retreg>, imm by width */
+    static const size_t movsz[] = {
+        [GUP_TYPE_U8] = 2,
+        [GUP_TYPE_U16] = 4,
+        [GUP_TYPE_U32] = 5,
+        [GUP_TYPE_U64] = 7
+    };
+
+    if (insn == NULL) {
+        return 0;
+    }
+
+    switch (insn->op) {
+    case IR_JMP:
+        return 2;
+    case IR_BR:
+        /* cmp with an imm8 and a short jcc */
+        return 6;
+    case IR_DECJNZ:
+        /* dec and a short jnz */
+        return 5;
+    case IR_BT:
+        /* mov r11, imm64, bt and a short jc */
+        return 16;
+    case IR_JTAB:
+        /* Two lea, movsxd, add and an indirect jmp */
+        return 24;
+    case IR_CASE:
+        /* One entry of the table */
+        return 4;
+    case IR_CALL:
+    case IR_TAIL:
+        return 5;
+    case IR_RET:
+        if (insn->a.type == IR_VAL_NONE || insn->width >= GUP_TYPE_MAX) {
+            return 1;
+        }
+        if (insn->a.type == IR_VAL_VREG) {
+            return 4;
+        }
+        return movsz[insn->width] + 1;
+    case IR_SETRET:
+        if (insn->width >= GUP_TYPE_MAX) {
+            return 0;
+        }
+        if (insn->a.type == IR_VAL_VREG) {
+            return 3;
+        }
+        return movsz[insn->width];
+    case IR_STORE:
+        if (insn->width >= GUP_TYPE_MAX) {
+            return 0;
+        }
+        if (insn->a.type == IR_VAL_VREG) {
+            return 7;
+        }
+        return storesz[insn->width];
+    case IR_LOAD:
+        return 7;
+    case IR_MOV:
+        return insn->a.type == IR_VAL_IMM ? 5 : 3;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_SHL:
+        /* mov, op and the zero extension below 64 bits */
+        return (insn->width < GUP_TYPE_U64) ? 10 : 7;
+    case IR_AND:
+    case IR_SHR:
+        return 7;
+    case IR_DIV:
+    case IR_MOD:
+        /* mov, xor edx, div, mov, and r11 for the divisor */
+        return (insn->b.type == IR_VAL_IMM) ? 17 : 11;
+    case IR_MULHI:
+        return 19;
+    case IR_CMP:
+        return 14;
+    case IR_PARAM:
+    case IR_RESULT:
+        /* mov and the zero extension below 64 bits */
+        return (insn->width < GUP_TYPE_U64) ? 6 : 3;
+    case IR_ARG:
+        return insn->a.type == IR_VAL_IMM ? 5 : 3;
+    default:
+        /* Labels and inline assembly have no known size */
+        return 0;
+    }
+}
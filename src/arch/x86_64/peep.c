@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "gup/arch/x86_64.h"
+#include "gup/pass.h"
+
+/*
+ * Bound on rewrite rounds, keeps jump cycles such as
+ * L.0: jmp L.1 / L.1: jmp L.0 from threading forever.
+ */
+#define PEEP_MAX_ROUNDS 16
+
+/*
+ * A peephole rule, applied at every instruction of the
+ * stream until no rule fires.
+ *
+ * @name: Rule name [reported with -fstats]
+ * @apply: Returns true if the stream was rewritten at @i
+ */
+struct peep_rule {
+    const char *name;
+    bool(*apply)(struct mc_buf *buf, size_t i);
+};
+
+/*
+ * Returns the index of the next live instruction at or
+ * after @i, skipping deleted ones.
+ *
+ * @buf: Instruction stream
+ * @i: Index to start at
+ */
+static size_t
+peep_next(struct mc_buf *buf, size_t i)
+{
+    while (i < buf->count && buf->insns[i].op == MC_NOP) {
+        ++i;
+    }
+
+    return i;
+}
+
+/*
+ * Returns the index of the first instruction that is
+ * not a label at or after @i.
+ *
+ * @buf: Instruction stream
+ * @i: Index to start at
+ */
+static size_t
+peep_past_labels(struct mc_buf *buf, size_t i)
+{
+    for (i = peep_next(buf, i); i < buf->count; i = peep_next(buf, i + 1)) {
+        if (buf->insns[i].op != MC_LABEL) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/*
+ * Find the index of a label within the stream
+ *
+ * @buf: Instruction stream
+ * @name: Label to find
+ *
+ * Returns buf->count if not found
+ */
+static size_t
+peep_find_label(struct mc_buf *buf, const char *name)
+{
+    for (size_t i = 0; i < buf->count; ++i) {
+        if (buf->insns[i].op != MC_LABEL) {
+            continue;
+        }
+
+        if (strcmp(buf->insns[i].sym, name) == 0) {
+            return i;
+        }
+    }
+
+    return buf->count;
+}
+
+/*
+ * jmp L
+ * L:           ->  L:
+ */
+static bool
+peep_jmp_next(struct mc_buf *buf, size_t i)
+{
+    struct mc_insn *insn = &buf->insns[i];
+
+    if (insn->op != MC_JMP) {
+        return false;
+    }
+
+    for (i = peep_next(buf, i + 1); i < buf->count; i = peep_next(buf, i + 1)) {
+        if (buf->insns[i].op != MC_LABEL) {
+            break;
+        }
+
+        if (strcmp(buf->insns[i].sym, insn->sym) == 0) {
+            insn->op = MC_NOP;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * jmp L1           jmp L2
+ * ...          ->  ...
+ * L1: jmp L2       L1: jmp L2
+ *
+ * The same holds for conditional jumps.
+ */
+static bool
+peep_jmp_thread(struct mc_buf *buf, size_t i)
+{
+    struct mc_insn *insn = &buf->insns[i];
+    struct mc_insn *target;
+    size_t j;
+
+    if (insn->op != MC_JMP && insn->op != MC_JCC) {
+        return false;
+    }
+
+    if ((j = peep_find_label(buf, insn->sym)) == buf->count) {
+        return false;
+    }
+
+    if ((j = peep_past_labels(buf, j)) == buf->count) {
+        return false;
+    }
+
+    target = &buf->insns[j];
+    if (target->op != MC_JMP || target == insn) {
+        return false;
+    }
+
+    if (strcmp(target->sym, insn->sym) == 0) {
+        return false;
+    }
+
+    insn->sym = target->sym;
+    return true;
+}
+
+/*
+ * call X       ->  jmp X
+ * ret
+ *
+ * Not for extern functions, the stack is only aligned
+ * for them by functions that call them.
+ */
+static bool
+peep_tail_call(struct mc_buf *buf, size_t i)
+{
+    struct mc_insn *insn = &buf->insns[i];
+    size_t j;
+
+    if (insn->op != MC_CALL || (insn->flags & MC_F_EXTERN)) {
+        return false;
+    }
+
+    /* A label in between means the ret is reached another way */
+    j = peep_next(buf, i + 1);
+    if (j == buf->count || buf->insns[j].op != MC_RET) {
+        return false;
+    }
+
+    insn->op = MC_JMP;
+    buf->insns[j].op = MC_NOP;
+    return true;
+}
+
+/*
+ * mov al, 0    ->  xor eax, eax
+ * ret              ret
+ *
+ * The flags are dead at the return so the shorter
+ * zeroing idiom is safe.
+ */
+static bool
+peep_zero_ret(struct mc_buf *buf, size_t i)
+{
+    struct mc_insn *insn = &buf->insns[i];
+    size_t j;
+
+    if (insn->op != MC_MOVRET || insn->imm != 0) {
+        return false;
+    }
+
+    j = peep_next(buf, i + 1);
+    if (j == buf->count || buf->insns[j].op != MC_RET) {
+        return false;
+    }
+
+    insn->op = MC_XORRET;
+    return true;
+}
+
+/*
+ * jmp L / ret
+ * <dead>       ->  jmp L / ret
+ * L2:              L2:
+ *
+ * Inline assembly may hold its own labels, so it is
+ * never treated as dead.
+ */
+static bool
+peep_dead_code(struct mc_buf *buf, size_t i)
+{
+    struct mc_insn *insn = &buf->insns[i];
+    size_t j;
+
+    if (insn->op != MC_JMP && insn->op != MC_RET) {
+        return false;
+    }
+
+    j = peep_next(buf, i + 1);
+    if (j == buf->count) {
+        return false;
+    }
+
+    switch (buf->insns[j].op) {
+    case MC_LABEL:
+    case MC_ASM:
+        return false;
+    default:
+        buf->insns[j].op = MC_NOP;
+        return true;
+    }
+}
+
+/*
+ * Drop labels that no jump, call or inline assembly
+ * within the function refers to.
+ */
+static bool
+peep_dead_label(struct mc_buf *buf, size_t i)
+{
+    struct mc_insn *insn = &buf->insns[i];
+    struct mc_insn *user;
+
+    if (insn->op != MC_LABEL || (insn->flags & MC_F_ENTRY)) {
+        return false;
+    }
+
+    for (size_t j = 0; j < buf->count; ++j) {
+        user = &buf->insns[j];
+        switch (user->op) {
+        case MC_JMP:
+        case MC_JCC:
+        case MC_CALL:
+        case MC_CASE:
+            if (strcmp(user->sym, insn->sym) == 0)
+                return false;
+            break;
+        case MC_ASM:
+            if (strstr(user->sym, insn->sym) != NULL)
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+
+    insn->op = MC_NOP;
+    return true;
+}
+
+/*
+ * The rule table, rules are tried in this order at
+ * each instruction.
+ */
+static const struct peep_rule peeptab[] = {
+    { "jmp-thread", peep_jmp_thread },
+    { "jmp-next", peep_jmp_next },
+    { "tail-call", peep_tail_call },
+    { "zero-ret", peep_zero_ret },
+    { "dead-code", peep_dead_code },
+    { "dead-label", peep_dead_label }
+};
+
+#define PEEP_COUNT (sizeof(peeptab) / sizeof(peeptab[0]))
+
+/*
+ * Squeeze deleted instructions out of the stream
+ *
+ * @buf: Instruction stream
+ */
+static void
+peep_compact(struct mc_buf *buf)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < buf->count; ++i) {
+        if (buf->insns[i].op != MC_NOP) {
+            buf->insns[n++] = buf->insns[i];
+        }
+    }
+
+    buf->count = n;
+}
+
+int
+mc_peephole(struct gup_state *state, struct mc_buf *buf)
+{
+    size_t hits[PEEP_COUNT] = { 0 };
+    bool changed = true;
+
+    for (size_t round = 0; changed && round < PEEP_MAX_ROUNDS; ++round) {
+        changed = false;
+        for (size_t i = 0; i < buf->count; ++i) {
+            if (buf->insns[i].op == MC_NOP) {
+                continue;
+            }
+
+            for (size_t r = 0; r < PEEP_COUNT; ++r) {
+                if (!peeptab[r].apply(buf, i)) {
+                    continue;
+                }
+
+                ++hits[r];
+                changed = true;
+                if (buf->insns[i].op == MC_NOP) {
+                    break;
+                }
+            }
+        }
+
+        peep_compact(buf);
+    }
+
+    for (size_t r = 0; r < PEEP_COUNT; ++r) {
+        pass_stat("peephole", peeptab[r].name, hits[r]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,834 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/arch/x86_64.h"
+#include "gup/trace.h"
+#include "gup/pass.h"
+
+/*
+ * Registers handed out to virtual registers, in order
+ * of preference. The caller-saved registers come first
+ * as they need not be saved. rax and rdx are taken by
+ * division and the return value, r11 holds immediates
+ * that do not fit an instruction and reloaded sources.
+ */
+static const mc_reg_t pool[] = {
+    MC_RCX, MC_RSI, MC_RDI, MC_R8, MC_R9, MC_R10,
+    MC_RBX, MC_R12, MC_R13, MC_R14, MC_R15
+};
+
+#define POOL_COUNT (sizeof(pool) / sizeof(pool[0]))
+
+/* Holds a reloaded destination once anything spills */
+#define RA_SCRATCH MC_R10
+
+/* Registers arguments are passed in [system V] */
+static const mc_reg_t argregs[] = {
+    MC_RDI, MC_RSI, MC_RDX, MC_RCX, MC_R8, MC_R9
+};
+
+#define ARGREG_COUNT (sizeof(argregs) / sizeof(argregs[0]))
+
+/*
+ * Interval flags
+ *
+ * @RA_CROSS_CALL: Live across a call, caller-saved registers are lost
+ * @RA_CROSS_ASM: Live across inline assembly, any register may be lost
+ */
+#define RA_CROSS_CALL (1 << 0)
+#define RA_CROSS_ASM  (1 << 1)
+
+/*
+ * The live interval of a virtual register, covering
+ * instructions [start, end].
+ *
+ * @vreg: Virtual register
+ * @start: First instruction the register appears in
+ * @end: Last instruction the register is live in
+ * @flags: Interval flags [RA_*]
+ * @reg: Assigned machine register [MC_REG_NONE if spilled]
+ * @slot: Stack slot if spilled [-1 if not]
+ */
+struct ra_interval {
+    uint32_t vreg;
+    size_t start;
+    size_t end;
+    uint8_t flags;
+    mc_reg_t reg;
+    ssize_t slot;
+};
+
+/*
+ * A range [start, end] over which a machine register
+ * holds a value of its own, a parameter not yet copied
+ * out or an argument not yet passed.
+ *
+ * @reg: Machine register
+ * @start: Instruction the register is set at
+ * @end: Last instruction the register is read at
+ * @set: Set if an instruction within the stream set the register
+ */
+struct ra_fixed {
+    mc_reg_t reg;
+    size_t start;
+    size_t end;
+    bool set;
+};
+
+/*
+ * State of a single allocation
+ *
+ * @ivs: Intervals in order of their start
+ * @iv_count: Number of intervals
+ * @ivmap: Virtual register to interval index
+ * @fixed: Ranges machine registers are held over
+ * @fixed_count: Number of fixed ranges
+ * @slot_count: Number of stack slots handed out
+ * @spills: Number of intervals spilled
+ * @used: Set for every pool register handed out
+ * @realign: Set if the stack is aligned for calls to extern functions
+ */
+struct ra_state {
+    struct ra_interval *ivs;
+    size_t iv_count;
+    ssize_t *ivmap;
+    struct ra_fixed *fixed;
+    size_t fixed_count;
+    size_t slot_count;
+    size_t spills;
+    bool used[POOL_COUNT];
+    bool realign;
+};
+
+/*
+ * Returns true if a register operand names a virtual
+ * register.
+ *
+ * @reg: Operand to check
+ */
+static inline bool
+ra_is_vreg(uint32_t reg)
+{
+    return reg >= MC_VREG_BASE;
+}
+
+/*
+ * Returns true if an instruction reads its destination
+ * before writing it.
+ *
+ * @insn: Instruction to check
+ */
+static inline bool
+ra_reads_dst(const struct mc_insn *insn)
+{
+    switch (insn->op) {
+    case MC_MOVI:
+    case MC_MOV:
+    case MC_LOAD:
+    case MC_RELOAD:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/*
+ * Returns true if an instruction writes its destination,
+ * compares only set the flags.
+ *
+ * @insn: Instruction to check
+ */
+static inline bool
+ra_writes_dst(const struct mc_insn *insn)
+{
+    switch (insn->op) {
+    case MC_CMP:
+    case MC_BT:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/*
+ * Returns true if a register survives a call under
+ * the system V ABI.
+ *
+ * @reg: Register to check
+ */
+static inline bool
+ra_callee_saved(mc_reg_t reg)
+{
+    switch (reg) {
+    case MC_RBX:
+    case MC_RBP:
+    case MC_R12:
+    case MC_R13:
+    case MC_R14:
+    case MC_R15:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Returns the index of a label within the stream, or
+ * buf->count if it is not defined there. The entry is
+ * never found, a jump to it is a tail call that enters
+ * the function anew.
+ *
+ * @buf: Instruction stream
+ * @name: Label to find
+ */
+static size_t
+ra_find_label(const struct mc_buf *buf, const char *name)
+{
+    for (size_t i = 0; i < buf->count; ++i) {
+        if (buf->insns[i].op != MC_LABEL || (buf->insns[i].flags & MC_F_ENTRY))
+            continue;
+        if (strcmp(buf->insns[i].sym, name) == 0)
+            return i;
+    }
+
+    return buf->count;
+}
+
+/*
+ * Extend the interval of a virtual register to cover
+ * an instruction, creating it on first sight.
+ *
+ * @ra: Allocation state
+ * @reg: Register operand
+ * @i: Index of the instruction
+ */
+static void
+ra_touch(struct ra_state *ra, uint32_t reg, size_t i)
+{
+    struct ra_interval *iv;
+    uint32_t vreg;
+
+    if (!ra_is_vreg(reg)) {
+        return;
+    }
+
+    vreg = reg - MC_VREG_BASE;
+    if (ra->ivmap[vreg] < 0) {
+        ra->ivmap[vreg] = ra->iv_count;
+        iv = &ra->ivs[ra->iv_count++];
+        iv->vreg = vreg;
+        iv->start = i;
+        iv->reg = MC_REG_NONE;
+        iv->slot = -1;
+        iv->flags = 0;
+    }
+
+    ra->ivs[ra->ivmap[vreg]].end = i;
+}
+
+/*
+ * Compute the live interval of every virtual register.
+ * A value live at the head of a loop stays live until
+ * the jump back to it.
+ *
+ * @ra: Allocation state
+ * @buf: Instruction stream
+ */
+static void
+ra_intervals(struct ra_state *ra, const struct mc_buf *buf)
+{
+    const struct mc_insn *insn;
+    struct ra_interval *iv;
+    bool changed = true;
+    size_t head;
+
+    for (size_t i = 0; i < buf->count; ++i) {
+        insn = &buf->insns[i];
+        ra_touch(ra, insn->src, i);
+        ra_touch(ra, insn->dst, i);
+    }
+
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < buf->count; ++i) {
+            insn = &buf->insns[i];
+            if (insn->op != MC_JMP && insn->op != MC_JCC) {
+                continue;
+            }
+
+            if ((head = ra_find_label(buf, insn->sym)) >= i) {
+                continue;
+            }
+
+            for (size_t j = 0; j < ra->iv_count; ++j) {
+                iv = &ra->ivs[j];
+                if (iv->start < head && iv->end >= head && iv->end < i) {
+                    iv->end = i;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < buf->count; ++i) {
+        insn = &buf->insns[i];
+        if (insn->op != MC_CALL && insn->op != MC_ASM) {
+            continue;
+        }
+
+        for (size_t j = 0; j < ra->iv_count; ++j) {
+            iv = &ra->ivs[j];
+            if (iv->start < i && iv->end > i) {
+                iv->flags |= (insn->op == MC_CALL) ? RA_CROSS_CALL : RA_CROSS_ASM;
+            }
+        }
+    }
+}
+
+static bool ra_leaves(const struct mc_buf *buf, const struct mc_insn *insn);
+
+/*
+ * Compute the ranges the argument registers are held
+ * over. Parameters are held from the entry until they
+ * are copied out, arguments from being set until the
+ * call, or the tail call, that passes them.
+ *
+ * @ra: Allocation state
+ * @buf: Instruction stream
+ */
+static void
+ra_fixed_ranges(struct ra_state *ra, const struct mc_buf *buf)
+{
+    const struct mc_insn *insn;
+    ssize_t open[MC_REG_MAX];
+    struct ra_fixed *f;
+
+    memset(open, 0xFF, sizeof(open));
+    for (size_t r = 0; r < ARGREG_COUNT; ++r) {
+        open[argregs[r]] = ra->fixed_count;
+        ra->fixed[ra->fixed_count++] = (struct ra_fixed){ .reg = argregs[r] };
+    }
+
+    for (size_t i = 0; i < buf->count; ++i) {
+        insn = &buf->insns[i];
+        if (insn->src < MC_REG_MAX && open[insn->src] >= 0) {
+            ra->fixed[open[insn->src]].end = i;
+        }
+
+        /* Whatever was set up for the call is read by it */
+        if (insn->op == MC_CALL || ra_leaves(buf, insn)) {
+            for (size_t r = 0; r < ARGREG_COUNT; ++r) {
+                if (open[argregs[r]] < 0) {
+                    continue;
+                }
+
+                f = &ra->fixed[open[argregs[r]]];
+                if (f->set) {
+                    f->end = i;
+                }
+                open[argregs[r]] = -1;
+            }
+        }
+
+        if (insn->dst == MC_REG_NONE || insn->dst >= MC_REG_MAX) {
+            continue;
+        }
+
+        for (size_t r = 0; r < ARGREG_COUNT; ++r) {
+            if (argregs[r] != insn->dst) {
+                continue;
+            }
+
+            open[insn->dst] = ra->fixed_count;
+            f = &ra->fixed[ra->fixed_count++];
+            *f = (struct ra_fixed){ .reg = insn->dst, .start = i, .end = i, .set = true };
+        }
+    }
+}
+
+/*
+ * Returns true if an interval may live in a register
+ *
+ * @ra: Allocation state
+ * @iv: Interval to check
+ * @reg: Register to check
+ * @reserve: Set if the scratch register is held back
+ */
+static bool
+ra_allowed(const struct ra_state *ra, const struct ra_interval *iv, mc_reg_t reg,
+    bool reserve)
+{
+    const struct ra_fixed *f;
+
+    if (iv->flags & RA_CROSS_ASM) {
+        return false;
+    }
+
+    if ((iv->flags & RA_CROSS_CALL) && !ra_callee_saved(reg)) {
+        return false;
+    }
+
+    /* Sharing a single instruction is a copy in or out */
+    for (size_t i = 0; i < ra->fixed_count; ++i) {
+        f = &ra->fixed[i];
+        if (f->reg == reg && iv->start < f->end && f->start < iv->end)
+            return false;
+    }
+
+    return !reserve || reg != RA_SCRATCH;
+}
+
+/*
+ * Give an interval a stack slot of its own
+ *
+ * @ra: Allocation state
+ * @iv: Interval to spill
+ */
+static inline void
+ra_spill(struct ra_state *ra, struct ra_interval *iv)
+{
+    iv->reg = MC_REG_NONE;
+    iv->slot = ra->slot_count++;
+    ++ra->spills;
+}
+
+/*
+ * Linear scan over the intervals in order of their start
+ * [Poletto & Sarkar]. Under pressure, whichever of the
+ * new interval and the active ones ends last is spilled.
+ *
+ * @ra: Allocation state
+ * @reserve: Hold back the scratch register for reloads
+ */
+static int
+ra_scan(struct ra_state *ra, bool reserve)
+{
+    struct ra_interval *iv, *victim;
+    size_t *active, nactive = 0, vi;
+    bool busy[MC_REG_MAX] = { false };
+
+    if ((active = malloc((ra->iv_count + 1) * sizeof(*active))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    ra->slot_count = 0;
+    ra->spills = 0;
+    memset(ra->used, 0, sizeof(ra->used));
+    for (size_t i = 0; i < ra->iv_count; ++i) {
+        iv = &ra->ivs[i];
+        iv->reg = MC_REG_NONE;
+        iv->slot = -1;
+
+        /* Expire what ended, a copy may land in the register it reads */
+        for (size_t j = 0; j < nactive;) {
+            if (ra->ivs[active[j]].end <= iv->start) {
+                busy[ra->ivs[active[j]].reg] = false;
+                active[j] = active[--nactive];
+                continue;
+            }
+            ++j;
+        }
+
+        for (size_t r = 0; r < POOL_COUNT; ++r) {
+            if (!busy[pool[r]] && ra_allowed(ra, iv, pool[r], reserve)) {
+                iv->reg = pool[r];
+                busy[pool[r]] = true;
+                ra->used[r] = true;
+                break;
+            }
+        }
+
+        if (iv->reg != MC_REG_NONE) {
+            active[nactive++] = i;
+            continue;
+        }
+
+        /* Out of registers, take one from the interval that ends last */
+        victim = NULL;
+        vi = 0;
+        for (size_t j = 0; j < nactive; ++j) {
+            if (!ra_allowed(ra, iv, ra->ivs[active[j]].reg, reserve)) {
+                continue;
+            }
+
+            if (victim == NULL || ra->ivs[active[j]].end > victim->end) {
+                victim = &ra->ivs[active[j]];
+                vi = j;
+            }
+        }
+
+        if (victim == NULL || victim->end <= iv->end) {
+            ra_spill(ra, iv);
+            continue;
+        }
+
+        iv->reg = victim->reg;
+        ra_spill(ra, victim);
+        active[vi] = i;
+    }
+
+    free(active);
+    return 0;
+}
+
+/*
+ * Append an instruction to a stream being rebuilt
+ *
+ * @out: Stream to append to
+ * @insn: Instruction to append
+ */
+static int
+ra_append(struct mc_buf *out, const struct mc_insn *insn)
+{
+    struct mc_insn *insns;
+    size_t new_cap;
+
+    if (out->count >= out->cap) {
+        new_cap = (out->cap == 0) ? 64 : out->cap * 2;
+        insns = realloc(out->insns, new_cap * sizeof(*insns));
+        if (insns == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        out->insns = insns;
+        out->cap = new_cap;
+    }
+
+    out->insns[out->count++] = *insn;
+    return 0;
+}
+
+/*
+ * Append the code that undoes the frame, ahead of
+ * every way out of the function.
+ *
+ * @ra: Allocation state
+ * @out: Stream being rebuilt
+ */
+static int
+ra_epilogue(struct ra_state *ra, struct mc_buf *out)
+{
+    struct mc_insn insn = { .op = MC_ADDRSP };
+
+    if (ra->realign) {
+        insn = (struct mc_insn){ .op = MC_MOV, .dst = MC_RSP, .src = MC_RBP };
+        if (ra_append(out, &insn) < 0) {
+            return -1;
+        }
+
+        insn = (struct mc_insn){ .op = MC_POP, .dst = MC_RBP };
+        if (ra_append(out, &insn) < 0) {
+            return -1;
+        }
+    } else if (ra->slot_count > 0) {
+        insn.imm = ra->slot_count * sizeof(uint64_t);
+        if (ra_append(out, &insn) < 0) {
+            return -1;
+        }
+    }
+
+    for (size_t r = POOL_COUNT; r-- > 0;) {
+        if (!ra->used[r] || !ra_callee_saved(pool[r])) {
+            continue;
+        }
+
+        insn = (struct mc_insn){ .op = MC_POP, .dst = pool[r] };
+        if (ra_append(out, &insn) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Append the code that sets up the frame, saving the
+ * callee-saved registers handed out and making room
+ * for the stack slots.
+ *
+ * Functions calling extern functions align the stack
+ * to 16 bytes themselves, as gup functions may be
+ * entered with any alignment. The old stack pointer
+ * is kept in rbp, which is never handed out.
+ *
+ * @ra: Allocation state
+ * @out: Stream being rebuilt
+ */
+static int
+ra_prologue(struct ra_state *ra, struct mc_buf *out)
+{
+    struct mc_insn insn;
+    size_t size;
+
+    for (size_t r = 0; r < POOL_COUNT; ++r) {
+        if (!ra->used[r] || !ra_callee_saved(pool[r])) {
+            continue;
+        }
+
+        insn = (struct mc_insn){ .op = MC_PUSH, .src = pool[r] };
+        if (ra_append(out, &insn) < 0) {
+            return -1;
+        }
+
+        pass_stat("regalloc", "callee-saved registers used", 1);
+    }
+
+    size = ra->slot_count * sizeof(uint64_t);
+    if (ra->realign) {
+        insn = (struct mc_insn){ .op = MC_PUSH, .src = MC_RBP };
+        if (ra_append(out, &insn) < 0) {
+            return -1;
+        }
+
+        insn = (struct mc_insn){ .op = MC_MOV, .dst = MC_RBP, .src = MC_RSP };
+        if (ra_append(out, &insn) < 0) {
+            return -1;
+        }
+
+        insn = (struct mc_insn){ .op = MC_AND, .flags = MC_F_IMM, .dst = MC_RSP, .imm = -16 };
+        if (ra_append(out, &insn) < 0) {
+            return -1;
+        }
+
+        size = (size + 15) & ~(size_t)15;
+        pass_stat("regalloc", "stacks aligned", 1);
+    }
+
+    if (size == 0) {
+        return 0;
+    }
+
+    insn = (struct mc_insn){ .op = MC_SUBRSP, .imm = size };
+    return ra_append(out, &insn);
+}
+
+/*
+ * Returns true if the frame must be undone before an
+ * instruction, that is a return or a tail call out of
+ * the function.
+ *
+ * @buf: Original instruction stream
+ * @insn: Instruction to check
+ */
+static bool
+ra_leaves(const struct mc_buf *buf, const struct mc_insn *insn)
+{
+    switch (insn->op) {
+    case MC_RET:
+        return true;
+    case MC_JMP:
+        return ra_find_label(buf, insn->sym) == buf->count;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Returns true if the last instruction of the stream
+ * may fall through past its end. Jump table entries are
+ * written elsewhere and do not count.
+ *
+ * @buf: Instruction stream
+ */
+static bool
+ra_falls_off(const struct mc_buf *buf)
+{
+    size_t i = buf->count;
+
+    while (i > 0 && buf->insns[i - 1].op == MC_CASE) {
+        --i;
+    }
+
+    if (i == 0) {
+        return true;
+    }
+
+    switch (buf->insns[i - 1].op) {
+    case MC_RET:
+    case MC_JMP:
+    case MC_JTAB:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/*
+ * Rewrite the stream with machine registers, reloading
+ * spilled sources into r11 and spilled destinations into
+ * the scratch register.
+ *
+ * @ra: Allocation state
+ * @buf: Instruction stream, rewritten in place
+ */
+static int
+ra_rewrite(struct ra_state *ra, struct mc_buf *buf)
+{
+    struct mc_buf out = { 0 };
+    struct mc_insn insn, tmp, *last;
+    struct ra_interval *src, *dst;
+    bool frame, store;
+    size_t reloads = 0;
+
+    frame = ra->slot_count > 0 || ra->realign;
+    for (size_t r = 0; r < POOL_COUNT; ++r) {
+        frame |= ra->used[r] && ra_callee_saved(pool[r]);
+    }
+
+    for (size_t i = 0; i < buf->count; ++i) {
+        insn = buf->insns[i];
+        src = ra_is_vreg(insn.src) ? &ra->ivs[ra->ivmap[insn.src - MC_VREG_BASE]] : NULL;
+        dst = ra_is_vreg(insn.dst) ? &ra->ivs[ra->ivmap[insn.dst - MC_VREG_BASE]] : NULL;
+        store = false;
+
+        if (frame && ra_leaves(buf, &insn) && ra_epilogue(ra, &out) < 0) {
+            goto fail;
+        }
+
+        if (src != NULL && src->slot >= 0) {
+            tmp = (struct mc_insn){ .op = MC_RELOAD, .dst = MC_R11 };
+            tmp.off = src->slot * sizeof(uint64_t);
+            if (ra_append(&out, &tmp) < 0) {
+                goto fail;
+            }
+
+            insn.src = MC_R11;
+            ++reloads;
+        } else if (src != NULL) {
+            insn.src = src->reg;
+        }
+
+        if (dst != NULL && dst->slot >= 0) {
+            tmp = (struct mc_insn){ .op = MC_RELOAD, .dst = RA_SCRATCH };
+            tmp.off = dst->slot * sizeof(uint64_t);
+            last = (out.count > 0) ? &out.insns[out.count - 1] : NULL;
+
+            /* Still held in the scratch register right after spilling it */
+            if (ra_reads_dst(&insn) && (last == NULL || last->op != MC_SPILL ||
+                last->off != tmp.off)) {
+                if (ra_append(&out, &tmp) < 0) {
+                    goto fail;
+                }
+                ++reloads;
+            }
+
+            insn.dst = RA_SCRATCH;
+            store = ra_writes_dst(&insn);
+        } else if (dst != NULL) {
+            insn.dst = dst->reg;
+        }
+
+        if (ra_append(&out, &insn) < 0) {
+            goto fail;
+        }
+
+        if (store) {
+            tmp = (struct mc_insn){ .op = MC_SPILL, .src = RA_SCRATCH };
+            tmp.off = dst->slot * sizeof(uint64_t);
+            if (ra_append(&out, &tmp) < 0) {
+                goto fail;
+            }
+        }
+
+        /* The frame is set up right past the entry */
+        if (frame && i == 0 && ra_prologue(ra, &out) < 0) {
+            goto fail;
+        }
+    }
+
+    /* Falling off the end still undoes the frame */
+    if (frame && buf->count > 0 && ra_falls_off(buf)) {
+        if (ra_epilogue(ra, &out) < 0) {
+            goto fail;
+        }
+    }
+
+    free(buf->insns);
+    *buf = out;
+    pass_stat("regalloc", "reloads", reloads);
+    return 0;
+fail:
+    free(out.insns);
+    return -1;
+}
+
+/*
+ * Parameters live through the body and values may live
+ * across the calls of a statement, inline assembly and
+ * loops. The argument registers are only handed out where
+ * they hold no parameter or argument of their own. A
+ * first scan uses every register, and if
+ * anything spills the scan is redone with the scratch
+ * register held back for reloads.
+ */
+int
+mc_regalloc(struct gup_state *state, struct mc_buf *buf)
+{
+    struct ra_state ra = { 0 };
+    struct mc_insn *insn;
+    uint32_t nvreg = 0;
+    int error = -1;
+
+    for (size_t i = 0; i < buf->count; ++i) {
+        insn = &buf->insns[i];
+        if (ra_is_vreg(insn->dst) && insn->dst - MC_VREG_BASE >= nvreg) {
+            nvreg = insn->dst - MC_VREG_BASE + 1;
+        }
+
+        if (ra_is_vreg(insn->src) && insn->src - MC_VREG_BASE >= nvreg) {
+            nvreg = insn->src - MC_VREG_BASE + 1;
+        }
+
+        if (insn->op == MC_CALL && (insn->flags & MC_F_EXTERN)) {
+            ra.realign = true;
+        }
+    }
+
+    if (nvreg == 0 && !ra.realign) {
+        return 0;
+    }
+
+    /* A function may only need its stack aligned, keep it non-empty */
+    ra.ivs = calloc(nvreg + 1, sizeof(*ra.ivs));
+    ra.ivmap = malloc((nvreg + 1) * sizeof(*ra.ivmap));
+    ra.fixed = malloc((buf->count + ARGREG_COUNT) * sizeof(*ra.fixed));
+    if (ra.ivs == NULL || ra.ivmap == NULL || ra.fixed == NULL) {
+        errno = -ENOMEM;
+        goto done;
+    }
+
+    memset(ra.ivmap, 0xFF, nvreg * sizeof(*ra.ivmap));
+    ra_intervals(&ra, buf);
+    ra_fixed_ranges(&ra, buf);
+    if (ra_scan(&ra, false) < 0) {
+        goto done;
+    }
+
+    if (ra.spills > 0 && ra_scan(&ra, true) < 0) {
+        goto done;
+    }
+
+    if (ra_rewrite(&ra, buf) < 0) {
+        goto done;
+    }
+
+    trace_debug("[regalloc] %zu values, %zu spilled\n", ra.iv_count, ra.spills);
+    pass_stat("regalloc", "values allocated", ra.iv_count - ra.spills);
+    pass_stat("regalloc", "values spilled", ra.spills);
+    error = 0;
+done:
+    free(ra.ivs);
+    free(ra.ivmap);
+    free(ra.fixed);
+    return error;
+}
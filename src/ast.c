@@ -26,6 +26,8 @@ ast_node_alloc(struct gup_state *state, ast_op_t type, struct ast_node **res)
     node->left = NULL;
     node->right = NULL;
     node->symbol = NULL;
+    node->align = 0;
+    node->epilogue = 0;
     node->str = NULL;
     *res = node;
     return 0;
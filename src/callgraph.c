@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include "gup/callgraph.h"
+#include "gup/trace.h"
+#include "gup/mu.h"
+
+/* Deepest loop nesting told apart by the static estimate */
+#define CALLGRAPH_MAX_DEPTH 4
+
+/*
+ * Compute the loop nesting depth of each instruction of
+ * a function. A loop spans from its head label to the
+ * last jump back to it.
+ *
+ * @ir: Function to scan
+ * @depth: Depth of each instruction is written here
+ */
+static void
+callgraph_depth(const struct ir_func *ir, size_t *depth)
+{
+    const struct ir_insn *insn;
+    size_t end;
+
+    memset(depth, 0, ir->insn_count * sizeof(*depth));
+    for (size_t i = 0; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        if (insn->op != IR_LABEL) {
+            continue;
+        }
+
+        if (!(ir->labels[insn->label].flags & IR_LABEL_LOOP)) {
+            continue;
+        }
+
+        end = i;
+        for (size_t j = i + 1; j < ir->insn_count; ++j) {
+            if (ir_is_branch(&ir->insns[j]) && ir->insns[j].label == insn->label) {
+                end = j;
+            }
+        }
+
+        for (size_t j = i; j <= end; ++j) {
+            ++depth[j];
+        }
+    }
+}
+
+/*
+ * Add to the weight of a call, creating it if needed
+ *
+ * @node: Calling node
+ * @callee: Index of the called node
+ * @weight: Weight to add
+ */
+static int
+callgraph_call(struct callgraph_node *node, size_t callee, uint64_t weight)
+{
+    struct callgraph_edge *calls;
+
+    for (size_t i = 0; i < node->call_count; ++i) {
+        if (node->calls[i].callee == callee) {
+            node->calls[i].weight += weight;
+            return 0;
+        }
+    }
+
+    calls = realloc(node->calls, (node->call_count + 1) * sizeof(*calls));
+    if (calls == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    node->calls = calls;
+    node->calls[node->call_count].callee = callee;
+    node->calls[node->call_count].weight = weight;
+    ++node->call_count;
+    return 0;
+}
+
+/*
+ * Read the call counts of the profile into the unit.
+ * Each line of the profile holds a call count as
+ * '<caller> <callee> <count>', lines starting with '#'
+ * are comments. The profile is read once per unit.
+ *
+ * @state: Compiler state
+ * @unit: Unit to read the profile into
+ */
+static int
+callgraph_read_profile(struct gup_state *state, struct gup_unit *unit)
+{
+    char line[512], caller[256], callee[256];
+    struct gup_count *counts, *ent;
+    uint64_t count;
+    FILE *fp;
+
+    if (unit->counts_read) {
+        return 0;
+    }
+
+    if ((fp = fopen(state->profile, "r")) == NULL) {
+        trace_error(state, "cannot open profile \"%s\"\n", state->profile);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+
+        if (sscanf(line, "%255s %255s %" SCNu64, caller, callee, &count) != 3) {
+            continue;
+        }
+
+        counts = realloc(unit->counts, (unit->count_len + 1) * sizeof(*counts));
+        if (counts == NULL) {
+            fclose(fp);
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        unit->counts = counts;
+        ent = &unit->counts[unit->count_len];
+        ent->caller = ptrbox_strdup(&state->ptrbox, caller);
+        ent->callee = ptrbox_strdup(&state->ptrbox, callee);
+        ent->count = count;
+        if (ent->caller == NULL || ent->callee == NULL) {
+            fclose(fp);
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        ++unit->count_len;
+    }
+
+    fclose(fp);
+    unit->counts_read = true;
+    return 0;
+}
+
+/*
+ * Replace the estimated call counts with the counts of
+ * the profile. Calls the profile does not list were
+ * never made.
+ *
+ * @state: Compiler state
+ * @unit: Unit the graph belongs to
+ * @cg: Graph to apply the profile to
+ */
+static int
+callgraph_profile(struct gup_state *state, struct gup_unit *unit, struct callgraph *cg)
+{
+    const struct gup_count *ent;
+    ssize_t from, to;
+
+    if (callgraph_read_profile(state, unit) < 0) {
+        return -1;
+    }
+
+    /* Measured counts are never mixed with estimates */
+    for (size_t i = 0; i < cg->node_count; ++i) {
+        for (size_t j = 0; j < cg->nodes[i].call_count; ++j) {
+            cg->nodes[i].calls[j].weight = 0;
+        }
+    }
+
+    for (size_t i = 0; i < unit->count_len; ++i) {
+        ent = &unit->counts[i];
+        from = callgraph_find(cg, ent->caller);
+        to = callgraph_find(cg, ent->callee);
+        if (from < 0 || to < 0) {
+            continue;
+        }
+
+        if (callgraph_call(&cg->nodes[from], to, ent->count) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+callgraph_build(struct gup_state *state, struct gup_unit *unit, struct callgraph *res)
+{
+    struct callgraph_node *node;
+    struct ir_insn *insn;
+    struct ir_func *ir;
+    size_t *depth, d;
+    uint64_t weight;
+    ssize_t callee;
+
+    if (state == NULL || unit == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    res->node_count = unit->func_count;
+    res->nodes = calloc(unit->func_count + 1, sizeof(*res->nodes));
+    if (res->nodes == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (size_t i = 0; i < unit->func_count; ++i) {
+        res->nodes[i].func = unit->funcs[i];
+    }
+
+    for (size_t i = 0; i < unit->func_count; ++i) {
+        node = &res->nodes[i];
+        ir = &node->func->ir;
+        if ((depth = malloc((ir->insn_count + 1) * sizeof(*depth))) == NULL) {
+            callgraph_release(res);
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        callgraph_depth(ir, depth);
+        for (size_t j = 0; j < ir->insn_count; ++j) {
+            insn = &ir->insns[j];
+            node->size += mu_insn_size(insn);
+            if (insn->op != IR_CALL && insn->op != IR_TAIL) {
+                continue;
+            }
+
+            if ((callee = callgraph_find(res, insn->sym)) < 0) {
+                continue;
+            }
+
+            weight = 1;
+            d = depth[j] < CALLGRAPH_MAX_DEPTH ? depth[j] : CALLGRAPH_MAX_DEPTH;
+            while (d-- > 0) {
+                weight *= CALLGRAPH_LOOP_WEIGHT;
+            }
+
+            if (callgraph_call(node, callee, weight) < 0) {
+                free(depth);
+                callgraph_release(res);
+                return -1;
+            }
+        }
+
+        free(depth);
+    }
+
+    if (state->profile != NULL && callgraph_profile(state, unit, res) < 0) {
+        callgraph_release(res);
+        return -1;
+    }
+
+    for (size_t i = 0; i < res->node_count; ++i) {
+        node = &res->nodes[i];
+        for (size_t j = 0; j < node->call_count; ++j) {
+            res->nodes[node->calls[j].callee].weight += node->calls[j].weight;
+        }
+    }
+
+    return 0;
+}
+
+ssize_t
+callgraph_find(const struct callgraph *cg, const char *name)
+{
+    if (cg == NULL || name == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < cg->node_count; ++i) {
+        if (strcmp(cg->nodes[i].func->symbol->name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool
+callgraph_hot(const struct callgraph *cg, size_t node)
+{
+    uint64_t weight, max = 0;
+
+    if (cg == NULL || node >= cg->node_count) {
+        return false;
+    }
+
+    for (size_t i = 0; i < cg->node_count; ++i) {
+        if (cg->nodes[i].weight > max) {
+            max = cg->nodes[i].weight;
+        }
+    }
+
+    weight = cg->nodes[node].weight;
+    return weight > 0 && weight * CALLGRAPH_HOT_SHARE >= max;
+}
+
+void
+callgraph_release(struct callgraph *cg)
+{
+    if (cg == NULL || cg->nodes == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < cg->node_count; ++i) {
+        free(cg->nodes[i].calls);
+    }
+
+    free(cg->nodes);
+    cg->nodes = NULL;
+    cg->node_count = 0;
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/cfg.h"
+#include "gup/pass.h"
+#include "gup/mu.h"
+
+#define CFG_NO_BLOCK ((size_t)-1)
+
+/*
+ * Add an edge between two blocks
+ *
+ * @cfg: Graph to add edge to
+ * @from: Source block
+ * @to: Destination block
+ */
+static void
+cfg_edge(struct cfg *cfg, size_t from, size_t to)
+{
+    struct cfg_node *node = &cfg->nodes[from];
+
+    if (to == CFG_NO_BLOCK || node->succ_count >= CFG_MAX_SUCC) {
+        return;
+    }
+
+    node->succ[node->succ_count++] = to;
+    ++cfg->nodes[to].pred_count;
+}
+
+/*
+ * Mark every block reachable from the entry block
+ *
+ * @cfg: Graph to walk
+ */
+static int
+cfg_reach(struct cfg *cfg)
+{
+    struct cfg_node *node;
+    size_t *stack, top = 0;
+
+    if (cfg->node_count == 0) {
+        return 0;
+    }
+
+    /* Each block is pushed at most once */
+    if ((stack = malloc(cfg->node_count * sizeof(*stack))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    stack[top++] = 0;
+    cfg->nodes[0].reachable = true;
+    while (top > 0) {
+        node = &cfg->nodes[stack[--top]];
+        for (uint8_t i = 0; i < node->succ_count; ++i) {
+            if (cfg->nodes[node->succ[i]].reachable) {
+                continue;
+            }
+
+            cfg->nodes[node->succ[i]].reachable = true;
+            stack[top++] = node->succ[i];
+        }
+    }
+
+    free(stack);
+    return 0;
+}
+
+int
+cfg_build(struct ir_func *ir, struct cfg *res)
+{
+    struct ir_block *block;
+    struct ir_insn *last;
+
+    if (ir == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(res, 0, sizeof(*res));
+    res->ir = ir;
+    if (ir_split_blocks(ir) < 0) {
+        return -1;
+    }
+
+    res->node_count = ir->block_count;
+    res->nodes = calloc(ir->block_count + 1, sizeof(*res->nodes));
+    res->label_block = malloc((ir->label_count + 1) * sizeof(*res->label_block));
+    if (res->nodes == NULL || res->label_block == NULL) {
+        cfg_release(res);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < ir->label_count; ++i) {
+        res->label_block[i] = CFG_NO_BLOCK;
+    }
+
+    for (size_t i = 0; i < ir->block_count; ++i) {
+        if (ir->blocks[i].label != IR_LABEL_NONE) {
+            res->label_block[ir->blocks[i].label] = i;
+        }
+    }
+
+    for (size_t i = 0; i < ir->block_count; ++i) {
+        block = &ir->blocks[i];
+        last = &ir->insns[block->end - 1];
+
+        switch (last->op) {
+        case IR_JMP:
+            cfg_edge(res, i, res->label_block[last->label]);
+            break;
+        case IR_BR:
+        case IR_DECJNZ:
+        case IR_BT:
+        case IR_CASE:
+            cfg_edge(res, i, res->label_block[last->label]);
+            if (i + 1 < ir->block_count) {
+                cfg_edge(res, i, i + 1);
+            }
+            break;
+        case IR_RET:
+        case IR_TAIL:
+            break;
+        default:
+            if (i + 1 < ir->block_count) {
+                cfg_edge(res, i, i + 1);
+            }
+            break;
+        }
+    }
+
+    if (cfg_reach(res) < 0) {
+        cfg_release(res);
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+cfg_release(struct cfg *cfg)
+{
+    if (cfg == NULL) {
+        return;
+    }
+
+    free(cfg->nodes);
+    free(cfg->label_block);
+    cfg->nodes = NULL;
+    cfg->label_block = NULL;
+    cfg->node_count = 0;
+}
+
+/*
+ * Returns true if a label is named by inline assembly
+ * within the function, such labels are always kept.
+ *
+ * @ir: Function to scan
+ * @name: Label name
+ */
+static bool
+cfg_asm_refs(struct ir_func *ir, const char *name)
+{
+    for (size_t i = 0; i < ir->insn_count; ++i) {
+        if (ir->insns[i].op != IR_ASM) {
+            continue;
+        }
+
+        if (strstr(ir->insns[i].sym, name) != NULL) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Drop unreachable blocks and labels nothing jumps to,
+ * repeated until neither changes.
+ */
+int
+pass_unreachable(struct gup_state *state, struct gup_func *func)
+{
+    struct ir_func *ir = &func->ir;
+    struct ir_insn *insn;
+    struct cfg cfg;
+    uint8_t *refs;
+    size_t n, dropped, bytes = 0, insns = 0;
+
+    do {
+        if (cfg_build(ir, &cfg) < 0) {
+            return -1;
+        }
+
+        if ((refs = calloc(ir->label_count + 1, 1)) == NULL) {
+            cfg_release(&cfg);
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        /* Only jumps that can execute keep a label alive */
+        for (size_t i = 0; i < ir->block_count; ++i) {
+            if (!cfg.nodes[i].reachable) {
+                continue;
+            }
+
+            for (size_t j = ir->blocks[i].start; j < ir->blocks[i].end; ++j) {
+                if (ir_is_branch(&ir->insns[j])) {
+                    refs[ir->insns[j].label] = 1;
+                }
+            }
+        }
+
+        n = 0;
+        dropped = 0;
+        for (size_t i = 0; i < ir->block_count; ++i) {
+            for (size_t j = ir->blocks[i].start; j < ir->blocks[i].end; ++j) {
+                insn = &ir->insns[j];
+                if (cfg.nodes[i].reachable && (insn->op != IR_LABEL ||
+                    refs[insn->label] ||
+                    cfg_asm_refs(ir, ir->labels[insn->label].name))) {
+                    ir->insns[n++] = *insn;
+                    continue;
+                }
+
+                if (insn->op != IR_LABEL) {
+                    bytes += mu_insn_size(insn);
+                    ++insns;
+                }
+                ++dropped;
+            }
+        }
+
+        ir->insn_count = n;
+        free(refs);
+        cfg_release(&cfg);
+    } while (dropped > 0);
+
+    pass_stat("unreachable", "instructions removed", insns);
+    pass_stat("unreachable", "bytes removed [est]", bytes);
+    return 0;
+}
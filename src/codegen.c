@@ -3,14 +3,21 @@
  * Provided under the BSD-3 clause.
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <errno.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include "gup/types.h"
 #include "gup/trace.h"
 #include "gup/codegen.h"
 #include "gup/symbol.h"
+#include "gup/layout.h"
+#include "gup/pass.h"
+#include "gup/ir.h"
+#include "gup/match.h"
 #include "gup/mu.h"
 
 static inline regsize_t
@@ -31,118 +38,1665 @@ dtype_to_regsize(gup_type_t type)
 }
 
 static int
-cg_compile_struct(struct gup_state *state, const char *name, struct ast_node *node)
+cg_compile_struct(struct gup_state *state, struct ast_node *node)
 {
+    struct symbol *instance;
+
     if (state == NULL || node == NULL) {
         errno = -EINVAL;
         return -1;
     }
 
-    mu_cg_struct(state, name, node);
-    return 0;
+    if ((instance = node->symbol) == NULL || instance->layout == NULL) {
+        trace_error(state, "[AST] struct without layout\n");
+        return -1;
+    }
+
+    return mu_cg_struct(state, instance->name, instance->layout);
+}
+
+/*
+ * Append an instruction to the function being compiled
+ *
+ * @state: Compiler state
+ * @insn: Instruction to append
+ */
+static inline int
+cg_ir(struct gup_state *state, const struct ir_insn *insn)
+{
+    return ir_append(&state->cur_func->ir, insn) < 0 ? -1 : 0;
 }
 
+/*
+ * Append an instruction that defines or jumps to a label
+ * referenced by name.
+ *
+ * @state: Compiler state
+ * @insn: Instruction to append, its label is filled in
+ * @name: Label name
+ * @flags: Label flags [IR_LABEL_*]
+ */
 static int
-cg_compile_assign(struct gup_state *state, struct ast_node *node)
+cg_ir_branch(struct gup_state *state, struct ir_insn *insn, const char *name,
+    uint32_t flags)
+{
+    struct ir_func *ir = &state->cur_func->ir;
+    char *label_name;
+
+    if ((label_name = ptrbox_strdup(&state->ptrbox, name)) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    insn->label = ir_label(ir, label_name);
+    if (insn->label == IR_LABEL_NONE) {
+        return -1;
+    }
+
+    ir->labels[insn->label].flags |= flags;
+    return cg_ir(state, insn);
+}
+
+/*
+ * Append a label or a jump to a label referenced by name
+ *
+ * @state: Compiler state
+ * @op: IR_LABEL or IR_JMP
+ * @name: Label name
+ * @flags: Label flags [IR_LABEL_*]
+ */
+static int
+cg_ir_label(struct gup_state *state, ir_op_t op, const char *name, uint32_t flags)
+{
+    struct ir_insn insn = { .op = op };
+
+    return cg_ir_branch(state, &insn, name, flags);
+}
+
+/*
+ * Resolve a field access path to the field it names and
+ * its offset from the start of the instance.
+ *
+ * @state: Compiler state
+ * @instance: Instance being accessed
+ * @path: First field of the access path
+ * @res: Field is written here
+ * @off_res: Offset is written here
+ */
+static int
+cg_resolve_field(struct gup_state *state, struct symbol *instance,
+    struct ast_node *path, const struct layout_field **res, size_t *off_res)
 {
+    const struct layout *layout = instance->layout;
+    const struct layout_field *field = NULL;
     struct ast_node *cur;
-    char buf[256];
+    size_t off = 0;
+
+    for (cur = path; cur != NULL; cur = cur->left) {
+        if ((field = layout_field(layout, cur->str)) == NULL) {
+            trace_error(state, "no field \"%s\" in \"%s\"\n", cur->str, instance->name);
+            return -1;
+        }
 
-    cur = node;
-    memset(buf, 0, sizeof(buf));
+        off += field->off;
+        if (field->node->type == AST_OP_STRUCT) {
+            layout = field->node->symbol->layout;
+            if (cur->left == NULL) {
+                trace_error(state, "\"%s\" is a struct, not a field\n", cur->str);
+                return -1;
+            }
+            continue;
+        }
 
-    while ((cur = cur->left) != NULL) {
-        strncat(buf, cur->str, sizeof(buf) - 1);
         if (cur->left != NULL) {
-            strncat(buf, ".", sizeof(buf) - 1);
+            trace_error(state, "\"%s\" is not a struct\n", cur->str);
+            return -1;
         }
     }
 
-    cur = node->right;
-    mu_cg_setlabel(state, GUP_TYPE_U8, buf, cur->v);
+    *res = field;
+    *off_res = off;
     return 0;
 }
 
-int
-cg_compile_node(struct gup_state *state, struct ast_node *node)
+/*
+ * Returns a mask of the bits held by a type
+ *
+ * @type: Type to get the mask of
+ */
+static inline uint64_t
+cg_type_mask(gup_type_t type)
+{
+    size_t size = gup_type_size(type);
+
+    if (size == 0 || size >= sizeof(uint64_t)) {
+        return UINT64_MAX;
+    }
+
+    return (1ULL << (size * 8)) - 1;
+}
+
+/*
+ * Returns the IR opcode of a binary expression node, the
+ * condition of comparisons is written to @cond.
+ *
+ * @type: Node type
+ * @cond: Condition is written here [IR_CMP]
+ */
+static ir_op_t
+cg_binop(ast_op_t type, uint16_t *cond)
+{
+    switch (type) {
+    case AST_OP_ADD:
+        return IR_ADD;
+    case AST_OP_SUB:
+        return IR_SUB;
+    case AST_OP_MUL:
+        return IR_MUL;
+    case AST_OP_DIV:
+        return IR_DIV;
+    case AST_OP_MOD:
+        return IR_MOD;
+    case AST_OP_LT:
+        *cond = IR_COND_LT;
+        return IR_CMP;
+    case AST_OP_LTE:
+        *cond = IR_COND_LE;
+        return IR_CMP;
+    case AST_OP_GT:
+        *cond = IR_COND_GT;
+        return IR_CMP;
+    case AST_OP_GTE:
+        *cond = IR_COND_GE;
+        return IR_CMP;
+    case AST_OP_EQ:
+        *cond = IR_COND_EQ;
+        return IR_CMP;
+    case AST_OP_NE:
+        *cond = IR_COND_NE;
+        return IR_CMP;
+    default:
+        return IR_NOP;
+    }
+}
+
+/*
+ * Fold a binary operation over two constants, wrapping
+ * at the width of the expression.
+ *
+ * @op: IR opcode
+ * @cond: Condition [IR_CMP]
+ * @a: Left operand
+ * @b: Right operand [nonzero for IR_DIV and IR_MOD]
+ * @width: Width of the expression
+ */
+static uint64_t
+cg_fold(ir_op_t op, uint16_t cond, uint64_t a, uint64_t b, gup_type_t width)
+{
+    uint64_t v = 0;
+
+    switch (op) {
+    case IR_ADD:
+        v = a + b;
+        break;
+    case IR_SUB:
+        v = a - b;
+        break;
+    case IR_MUL:
+        v = a * b;
+        break;
+    case IR_DIV:
+        v = a / b;
+        break;
+    case IR_MOD:
+        v = a % b;
+        break;
+    case IR_CMP:
+        switch (cond) {
+        case IR_COND_EQ:
+            v = a == b;
+            break;
+        case IR_COND_LT:
+            v = a < b;
+            break;
+        case IR_COND_LE:
+            v = a <= b;
+            break;
+        case IR_COND_GT:
+            v = a > b;
+            break;
+        case IR_COND_GE:
+            v = a >= b;
+            break;
+        case IR_COND_NE:
+            v = a != b;
+            break;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return v & cg_type_mask(width);
+}
+
+/*
+ * Narrow a value held at a wider type than the expression
+ * it is used in, values are held zero extended so a value
+ * of a narrower type is used as it is.
+ *
+ * @state: Compiler state
+ * @from: Type the value is held at
+ * @width: Width of the expression
+ * @val: Value to narrow, updated in place
+ */
+static int
+cg_narrow(struct gup_state *state, gup_type_t from, gup_type_t width, struct ir_val *val)
+{
+    struct ir_insn insn = { .op = IR_AND, .width = width };
+
+    if (gup_type_size(from) <= gup_type_size(width)) {
+        return 0;
+    }
+
+    insn.a = *val;
+    insn.b.type = IR_VAL_IMM;
+    insn.b.imm = cg_type_mask(width);
+    insn.dst = ir_vreg_new(&state->cur_func->ir);
+    val->type = IR_VAL_VREG;
+    val->vreg = insn.dst;
+    return cg_ir(state, &insn);
+}
+
+static int cg_call(struct gup_state *state, struct ast_node *node, ir_op_t op,
+    struct ir_val *res, size_t nres);
+
+/*
+ * Lower an expression, every operation wraps at the
+ * width of the value the expression is written to. An
+ * expression over constants alone is folded and emits
+ * nothing.
+ *
+ * @state: Compiler state
+ * @node: Expression to lower
+ * @width: Width of the expression
+ * @res: Value of the expression is written here
+ */
+static int
+cg_expr(struct gup_state *state, struct ast_node *node, gup_type_t width,
+    struct ir_val *res)
+{
+    struct ir_insn insn = { .width = width };
+    const struct layout_field *field;
+    size_t off;
+
+    /* Only results wrap, so a number is taken as written */
+    if (node->type == AST_OP_NUMBER) {
+        res->type = IR_VAL_IMM;
+        res->imm = node->v;
+        return 0;
+    }
+
+    if (node->type == AST_OP_CALL) {
+        if (cg_call(state, node, IR_CALL, res, 1) < 0) {
+            return -1;
+        }
+
+        return cg_narrow(state, node->symbol->data_type, width, res);
+    }
+
+    if (node->type == AST_OP_PARAM) {
+        if (state->cur_func == NULL || node->v >= state->cur_func->symbol->param_count) {
+            trace_error(state, "[AST] bad parameter %zu\n", node->v);
+            return -1;
+        }
+
+        res->type = IR_VAL_VREG;
+        res->vreg = state->cur_func->params[node->v];
+        return cg_narrow(state, state->cur_func->symbol->params[node->v].type, width, res);
+    }
+
+    if (node->type == AST_OP_FIELD) {
+        if (cg_resolve_field(state, node->symbol, node->left, &field, &off) < 0) {
+            return -1;
+        }
+
+        /* Narrowing a load reads the low bytes of the field */
+        insn.op = IR_LOAD;
+        insn.sym = node->symbol->name;
+        insn.off = off;
+        if (gup_type_size(field->node->data_type) < gup_type_size(width)) {
+            insn.width = field->node->data_type;
+        }
+    } else {
+        if ((insn.op = cg_binop(node->type, &insn.flags)) == IR_NOP) {
+            trace_error(state, "[AST] bad expression node %d\n", node->type);
+            return -1;
+        }
+
+        if (cg_expr(state, node->left, width, &insn.a) < 0) {
+            return -1;
+        }
+
+        if (cg_expr(state, node->right, width, &insn.b) < 0) {
+            return -1;
+        }
+
+        if ((insn.op == IR_DIV || insn.op == IR_MOD) &&
+            insn.b.type == IR_VAL_IMM && insn.b.imm == 0) {
+            trace_error(state, "division by zero\n");
+            return -1;
+        }
+
+        if (insn.a.type == IR_VAL_IMM && insn.b.type == IR_VAL_IMM) {
+            res->type = IR_VAL_IMM;
+            res->imm = cg_fold(insn.op, insn.flags, insn.a.imm, insn.b.imm, width);
+            return 0;
+        }
+    }
+
+    if (state->cur_func == NULL) {
+        trace_error(state, "initializer is not constant\n");
+        return -1;
+    }
+
+    insn.dst = ir_vreg_new(&state->cur_func->ir);
+    res->type = IR_VAL_VREG;
+    res->vreg = insn.dst;
+    return cg_ir(state, &insn);
+}
+
+/*
+ * Lower a call, every argument is computed at the type
+ * of its parameter before any of them is passed.
+ *
+ * @state: Compiler state
+ * @node: Call to lower
+ * @op: IR_CALL, or IR_TAIL to call in place of returning
+ * @res: Return values are written here [NULL if unused]
+ * @nres: Number of return values to take
+ */
+static int
+cg_call(struct gup_state *state, struct ast_node *node, ir_op_t op, struct ir_val *res,
+    size_t nres)
 {
+    struct ir_val args[SYMBOL_MAX_PARAMS];
+    struct ir_insn insn = { 0 };
+    struct ast_node *arg;
     struct symbol *symbol;
-    char label[32];
+    size_t argc = 0;
 
-    if (node == NULL) {
-        errno = -EINVAL;
+    if ((symbol = node->symbol) == NULL) {
         return -1;
     }
 
-    switch (node->type) {
-    case AST_OP_FUNC:
-        if ((symbol = node->symbol) == NULL) {
-            trace_error(state, "[AST] function has no symbol\n");
+    if (symbol->type != SYMBOL_TYPE_FUNC) {
+        trace_error(state, "[AST] %s is not a function\n", symbol->name);
+        return -1;
+    }
+
+    if (state->cur_func == NULL) {
+        trace_error(state, "initializer is not constant\n");
+        return -1;
+    }
+
+    if (nres > symbol->ret_count) {
+        trace_error(state, "[AST] %s returns %u values\n", symbol->name, symbol->ret_count);
+        return -1;
+    }
+
+    for (arg = node->right; arg != NULL; arg = arg->right) {
+        if (argc >= symbol->param_count) {
+            trace_error(state, "[AST] too many arguments to %s\n", symbol->name);
             return -1;
         }
 
-        trace_debug("[AST] detected function %s\n", symbol->name);
-        mu_cg_funcp(state, symbol->name, symbol->is_pub);
-        break;
-    case AST_OP_ASM:
-        if (node->str == NULL) {
+        if (cg_expr(state, arg->left, symbol->params[argc].type, &args[argc]) < 0) {
             return -1;
         }
-        mu_cg_asm(state, node->str);
-        break;
-    case AST_OP_RETVOID:
-        mu_cg_retvoid(state);
-        break;
-    case AST_OP_RETIMM:
-        if ((symbol = state->this_func) == NULL) {
+
+        if (args[argc].type == IR_VAL_IMM) {
+            args[argc].imm &= cg_type_mask(symbol->params[argc].type);
+        }
+
+        ++argc;
+    }
+
+    /* The arguments directly precede the call */
+    for (size_t i = 0; i < argc; ++i) {
+        insn = (struct ir_insn){ .op = IR_ARG, .width = symbol->params[i].type };
+        insn.a = args[i];
+        insn.off = i;
+        if (cg_ir(state, &insn) < 0) {
             return -1;
         }
-        mu_cg_retimm(state, dtype_to_regsize(symbol->data_type), node->v);
-        break;
-    case AST_OP_CALL:
-        if ((symbol = node->symbol) == NULL) {
+    }
+
+    insn = (struct ir_insn){ .op = op, .sym = symbol->name };
+    insn.flags = symbol->is_extern ? IR_F_EXTERN : 0;
+    if (cg_ir(state, &insn) < 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < nres; ++i) {
+        insn = (struct ir_insn){ .op = IR_RESULT, .width = symbol->ret_types[i] };
+        insn.dst = ir_vreg_new(&state->cur_func->ir);
+        insn.off = i;
+        if (cg_ir(state, &insn) < 0) {
             return -1;
         }
 
-        if (symbol->type != SYMBOL_TYPE_FUNC) {
-            trace_error(state, "[AST] %s is not a function\n", symbol->name);
+        res[i].type = IR_VAL_VREG;
+        res[i].vreg = insn.dst;
+    }
+
+    return 0;
+}
+
+/*
+ * Lower a store of a value to the field an assignment
+ * names.
+ *
+ * @state: Compiler state
+ * @node: Assignment
+ * @val: Value to store [NULL to compute the right leaf]
+ */
+static int
+cg_store(struct gup_state *state, struct ast_node *node, const struct ir_val *val)
+{
+    struct ir_insn insn = { .op = IR_STORE };
+    const struct layout_field *field;
+    struct symbol *instance;
+    size_t off;
+
+    if ((instance = node->symbol) == NULL || instance->layout == NULL) {
+        trace_error(state, "[AST] assignment without instance\n");
+        return -1;
+    }
+
+    if (cg_resolve_field(state, instance, node->left->left, &field, &off) < 0) {
+        return -1;
+    }
+
+    /* The value is truncated to the width of the field */
+    insn.width = field->node->data_type;
+    insn.sym = instance->name;
+    insn.off = off;
+    if (val != NULL) {
+        insn.a = *val;
+    } else if (cg_expr(state, node->right, insn.width, &insn.a) < 0) {
+        return -1;
+    }
+
+    if (insn.a.type == IR_VAL_IMM) {
+        insn.a.imm &= cg_type_mask(insn.width);
+    }
+
+    /* Outside of a function this is an initializer */
+    if (state->cur_func == NULL) {
+        return layout_store(state, instance, off, insn.width, insn.a.imm);
+    }
+
+    return cg_ir(state, &insn);
+}
+
+static inline int
+cg_compile_assign(struct gup_state *state, struct ast_node *node)
+{
+    return cg_store(state, node, NULL);
+}
+
+/*
+ * Lower an assignment of every value a call returns
+ *
+ * @state: Compiler state
+ * @node: AST_OP_UNPACK node
+ */
+static int
+cg_compile_unpack(struct gup_state *state, struct ast_node *node)
+{
+    struct ir_val vals[SYMBOL_MAX_RETS];
+    struct ast_node *target;
+    size_t n = 0;
+
+    for (target = node->left; target != NULL; target = target->right) {
+        if (++n > SYMBOL_MAX_RETS) {
+            trace_error(state, "[AST] too many assignment targets\n");
             return -1;
         }
+    }
 
-        mu_cg_call(state, symbol->name);
-        break;
-    case AST_OP_STRUCT:
-        cg_compile_struct(state, node->str, node);
-        break;
-    case AST_OP_LOOP:
-        if (!node->epilogue) {
-            mu_cg_loopstart(state);
-        } else {
-            /* Emit the jump loop */
-            snprintf(label, sizeof(label), "L.%zu", state->loop_count - 1);
-            mu_cg_jmp(state, label);
+    if (cg_call(state, node->right, IR_CALL, vals, n) < 0) {
+        return -1;
+    }
 
-            /* Emit the end label */
-            snprintf(label, sizeof(label), "L.%zu.1", state->loop_count - 1);
-            mu_cg_label(state, label);
+    n = 0;
+    for (target = node->left; target != NULL; target = target->right) {
+        if (cg_store(state, target, &vals[n++]) < 0) {
+            return -1;
         }
-        break;
-    case AST_OP_BREAK:
-        /* Jump out of the loop */
-        snprintf(label, sizeof(label), "L.%zu.1", state->loop_count - 1);
-        mu_cg_jmp(state, label);
-        break;
-    case AST_OP_CONTINUE:
-        snprintf(label, sizeof(label), "L.%zu", state->loop_count - 1);
-        mu_cg_jmp(state, label);
-        break;
-    case AST_OP_ASSIGN:
-        cg_compile_assign(state, node);
-        break;
-    default:
-        trace_error(state, "[AST]: bad node type %d\n", node->type);
+    }
+
+    return 0;
+}
+
+/*
+ * Set up the counter of a counted loop ahead of its head,
+ * a loop that runs no times jumps straight to its exit.
+ *
+ * @state: Compiler state
+ * @loop: Loop being opened
+ * @count: Expression of the number of iterations
+ */
+static int
+cg_loop_count(struct gup_state *state, struct gup_loop *loop, struct ast_node *count)
+{
+    struct ir_insn insn = { .op = IR_MOV, .width = GUP_TYPE_U64 };
+    char label[32];
+
+    if (cg_expr(state, count, GUP_TYPE_U64, &insn.a) < 0) {
         return -1;
     }
 
-    return -1;
+    snprintf(label, sizeof(label), "L.%zu.1", loop->id);
+    if (insn.a.type == IR_VAL_IMM && insn.a.imm == 0) {
+        return cg_ir_label(state, IR_JMP, label, 0);
+    }
+
+    /* The counter is stepped in place, so never share the value */
+    if ((insn.dst = ir_vreg_new(&state->cur_func->ir)) == IR_VREG_NONE) {
+        return -1;
+    }
+
+    loop->counter = insn.dst;
+    if (cg_ir(state, &insn) < 0) {
+        return -1;
+    }
+
+    if (insn.a.type == IR_VAL_IMM) {
+        return 0;
+    }
+
+    insn = (struct ir_insn){ .op = IR_BR, .width = GUP_TYPE_U64, .flags = IR_COND_EQ };
+    insn.a.type = IR_VAL_VREG;
+    insn.a.vreg = loop->counter;
+    insn.b.type = IR_VAL_IMM;
+    insn.b.imm = 0;
+    return cg_ir_branch(state, &insn, label, 0);
+}
+
+/*
+ * Open or close a loop. Each loop gets a number of its
+ * own, which stays on the loop stack until its closing
+ * brace so that nested loops leave it alone. A counted
+ * loop closes with a decrement of its counter and a
+ * jump back while any iterations are left.
+ *
+ * @state: Compiler state
+ * @node: AST_OP_LOOP node
+ */
+static int
+cg_compile_loop(struct gup_state *state, struct ast_node *node)
+{
+    struct ir_func *ir = &state->cur_func->ir;
+    struct ir_insn insn = { .op = IR_DECJNZ, .width = GUP_TYPE_U64 };
+    struct gup_loop *loop;
+    char label[32];
+
+    if (!node->epilogue) {
+        if (state->loop_depth >= MAX_SCOPE_DEPTH) {
+            trace_error(state, "max loop nest level [%d] exceeded\n", MAX_SCOPE_DEPTH);
+            return -1;
+        }
+
+        loop = &state->loop_stack[state->loop_depth++];
+        loop->id = state->loop_count++;
+        loop->name = node->str;
+        loop->counter = IR_VREG_NONE;
+        loop->continued = false;
+        if (node->right != NULL && cg_loop_count(state, loop, node->right) < 0) {
+            return -1;
+        }
+
+        snprintf(label, sizeof(label), "L.%zu", loop->id);
+        if (cg_ir_label(state, IR_LABEL, label, IR_LABEL_LOOP) < 0) {
+            return -1;
+        }
+
+        ir->labels[ir_label(ir, label)].unroll = node->unroll;
+        return 0;
+    }
+
+    if (state->loop_depth == 0) {
+        trace_error(state, "[AST] loop end outside of a loop\n");
+        return -1;
+    }
+
+    loop = &state->loop_stack[--state->loop_depth];
+    snprintf(label, sizeof(label), "L.%zu.2", loop->id);
+    if (loop->continued && cg_ir_label(state, IR_LABEL, label, 0) < 0) {
+        return -1;
+    }
+
+    /* Emit the jump loop */
+    snprintf(label, sizeof(label), "L.%zu", loop->id);
+    if (loop->counter != IR_VREG_NONE) {
+        insn.dst = loop->counter;
+        insn.a.type = IR_VAL_VREG;
+        insn.a.vreg = loop->counter;
+        if (cg_ir_branch(state, &insn, label, 0) < 0) {
+            return -1;
+        }
+    } else if (cg_ir_label(state, IR_JMP, label, 0) < 0) {
+        return -1;
+    }
+
+    /* Emit the end label */
+    snprintf(label, sizeof(label), "L.%zu.1", loop->id);
+    return cg_ir_label(state, IR_LABEL, label, 0);
+}
+
+/*
+ * Jump to the head or the exit of the innermost loop,
+ * or of the enclosing loop with the given label.
+ *
+ * @state: Compiler state
+ * @node: AST_OP_BREAK or AST_OP_CONTINUE [str is the label, if any]
+ */
+static int
+cg_compile_loopjmp(struct gup_state *state, struct ast_node *node)
+{
+    struct gup_loop *loop = NULL;
+    char label[32];
+
+    for (size_t i = state->loop_depth; i-- > 0;) {
+        if (node->str == NULL || (state->loop_stack[i].name != NULL &&
+            strcmp(state->loop_stack[i].name, node->str) == 0)) {
+            loop = &state->loop_stack[i];
+            break;
+        }
+    }
+
+    if (loop == NULL && node->str != NULL) {
+        trace_error(state, "no enclosing loop labeled '%s\n", node->str);
+        return -1;
+    }
+
+    if (loop == NULL) {
+        trace_error(state, "[AST] jump outside of a loop\n");
+        return -1;
+    }
+
+    if (node->type == AST_OP_BREAK) {
+        snprintf(label, sizeof(label), "L.%zu.1", loop->id);
+    } else if (loop->counter != IR_VREG_NONE) {
+        /* The counter is stepped on the way back to the head */
+        snprintf(label, sizeof(label), "L.%zu.2", loop->id);
+        loop->continued = true;
+    } else {
+        snprintf(label, sizeof(label), "L.%zu", loop->id);
+    }
+
+    return cg_ir_label(state, IR_JMP, label, 0);
+}
+
+/*
+ * Jump to a label unless a condition holds. A comparison
+ * is branched on directly, any other value holds when it
+ * is nonzero.
+ *
+ * @state: Compiler state
+ * @node: Expression of the condition
+ * @label: Label to jump to
+ */
+static int
+cg_branch_unless(struct gup_state *state, struct ast_node *node, const char *label)
+{
+    struct ir_insn insn = { .op = IR_BR, .width = GUP_TYPE_U64, .flags = IR_COND_NE };
+    struct ir_val tmp;
+
+    if (cg_binop(node->type, &insn.flags) == IR_CMP) {
+        if (cg_expr(state, node->left, GUP_TYPE_U64, &insn.a) < 0) {
+            return -1;
+        }
+
+        if (cg_expr(state, node->right, GUP_TYPE_U64, &insn.b) < 0) {
+            return -1;
+        }
+    } else {
+        if (cg_expr(state, node, GUP_TYPE_U64, &insn.a) < 0) {
+            return -1;
+        }
+
+        insn.b.type = IR_VAL_IMM;
+        insn.b.imm = 0;
+    }
+
+    insn.flags = ir_cond_invert(insn.flags);
+    if (insn.a.type == IR_VAL_IMM && insn.b.type == IR_VAL_IMM) {
+        if (cg_fold(IR_CMP, insn.flags, insn.a.imm, insn.b.imm, GUP_TYPE_U64) == 0) {
+            return 0;
+        }
+
+        return cg_ir_label(state, IR_JMP, label, 0);
+    }
+
+    /* Only the right hand side may be a constant */
+    if (insn.a.type == IR_VAL_IMM) {
+        tmp = insn.a;
+        insn.a = insn.b;
+        insn.b = tmp;
+        insn.flags = ir_cond_swap(insn.flags);
+    }
+
+    return cg_ir_branch(state, &insn, label, 0);
+}
+
+/*
+ * Open an arm of a conditional, which is skipped when
+ * its condition does not hold. An unlikely arm starts
+ * a cold block of its own.
+ *
+ * @state: Compiler state
+ * @cond: Conditional the arm belongs to
+ * @node: AST_OP_IF or AST_OP_ELSE node
+ */
+static int
+cg_cond_arm(struct gup_state *state, struct gup_cond *cond, struct ast_node *node)
+{
+    char label[32];
+
+    cond->hint = node->v;
+    snprintf(label, sizeof(label), "L.%zu.2", cond->next);
+    if (cg_branch_unless(state, node->right, label) < 0) {
+        return -1;
+    }
+
+    if (cond->hint != AST_HINT_UNLIKELY) {
+        return 0;
+    }
+
+    snprintf(label, sizeof(label), "L.%zu", cond->next);
+    return cg_ir_label(state, IR_LABEL, label, IR_LABEL_COLD);
+}
+
+/*
+ * Open or close a conditional, or move on to its next
+ * arm. A taken arm jumps past the rest to the end of
+ * the conditional, and the 'else' following a likely
+ * arm starts a cold block.
+ *
+ * @state: Compiler state
+ * @node: AST_OP_IF or AST_OP_ELSE node
+ */
+static int
+cg_compile_cond(struct gup_state *state, struct ast_node *node)
+{
+    struct gup_cond *cond;
+    uint32_t flags = 0;
+    char label[32];
+
+    if (node->type == AST_OP_IF && !node->epilogue) {
+        if (state->cond_depth >= MAX_SCOPE_DEPTH) {
+            trace_error(state, "max conditional nest level [%d] exceeded\n",
+                MAX_SCOPE_DEPTH);
+            return -1;
+        }
+
+        cond = &state->cond_stack[state->cond_depth++];
+        cond->id = state->loop_count++;
+        cond->next = cond->id;
+        cond->joined = false;
+        cond->has_else = false;
+        return cg_cond_arm(state, cond, node);
+    }
+
+    if (state->cond_depth == 0) {
+        trace_error(state, "[AST] conditional end outside of a conditional\n");
+        return -1;
+    }
+
+    cond = &state->cond_stack[state->cond_depth - 1];
+    if (node->type == AST_OP_ELSE) {
+        snprintf(label, sizeof(label), "L.%zu.1", cond->id);
+        if (cg_ir_label(state, IR_JMP, label, 0) < 0) {
+            return -1;
+        }
+
+        cond->joined = true;
+        if (node->right == NULL && cond->hint == AST_HINT_LIKELY) {
+            flags = IR_LABEL_COLD;
+        }
+
+        snprintf(label, sizeof(label), "L.%zu.2", cond->next);
+        if (cg_ir_label(state, IR_LABEL, label, flags) < 0) {
+            return -1;
+        }
+
+        if (node->right == NULL) {
+            cond->has_else = true;
+            return 0;
+        }
+
+        cond->next = state->loop_count++;
+        return cg_cond_arm(state, cond, node);
+    }
+
+    --state->cond_depth;
+    snprintf(label, sizeof(label), "L.%zu.2", cond->next);
+    if (!cond->has_else && cg_ir_label(state, IR_LABEL, label, 0) < 0) {
+        return -1;
+    }
+
+    snprintf(label, sizeof(label), "L.%zu.1", cond->id);
+    if (cond->joined && cg_ir_label(state, IR_LABEL, label, 0) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Move the instructions appended since an index ahead
+ * of those appended before it, from an earlier one on.
+ *
+ * @ir: Function to rearrange
+ * @start: Index the moved instructions land at
+ * @mid: Index of the first instruction to move
+ */
+static int
+cg_hoist(struct ir_func *ir, size_t start, size_t mid)
+{
+    size_t n = ir->insn_count - mid;
+    struct ir_insn *tmp;
+
+    if (n == 0 || mid == start) {
+        return 0;
+    }
+
+    if ((tmp = malloc(n * sizeof(*tmp))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    memcpy(tmp, &ir->insns[mid], n * sizeof(*tmp));
+    memmove(&ir->insns[start + n], &ir->insns[start], (mid - start) * sizeof(*tmp));
+    memcpy(&ir->insns[start], tmp, n * sizeof(*tmp));
+    free(tmp);
+    return 0;
+}
+
+/*
+ * Open or close a match. The arms are lowered as they
+ * come, the dispatch once all of their values are known,
+ * and it is then moved ahead of them.
+ *
+ * @state: Compiler state
+ * @node: AST_OP_MATCH node
+ */
+static int
+cg_compile_match(struct gup_state *state, struct ast_node *node)
+{
+    struct ir_func *ir = &state->cur_func->ir;
+    struct gup_match *match;
+    char label[32];
+    size_t mid;
+
+    if (!node->epilogue) {
+        if (state->match_depth >= MAX_SCOPE_DEPTH) {
+            trace_error(state, "max match nest level [%d] exceeded\n", MAX_SCOPE_DEPTH);
+            return -1;
+        }
+
+        match = &state->match_stack[state->match_depth];
+        if (cg_expr(state, node->right, GUP_TYPE_U64, &match->subject) < 0) {
+            return -1;
+        }
+
+        ++state->match_depth;
+        match->id = state->loop_count++;
+        match->start = ir->insn_count;
+        match->cases = NULL;
+        match->case_count = 0;
+        match->arm_count = 0;
+        match->has_default = false;
+        return 0;
+    }
+
+    if (state->match_depth == 0) {
+        trace_error(state, "[AST] match end outside of a match\n");
+        return -1;
+    }
+
+    match = &state->match_stack[state->match_depth - 1];
+    mid = ir->insn_count;
+    if (match_dispatch(state, match) < 0) {
+        return -1;
+    }
+
+    if (cg_hoist(ir, match->start, mid) < 0) {
+        return -1;
+    }
+
+    --state->match_depth;
+    free(match->cases);
+    match->cases = NULL;
+
+    snprintf(label, sizeof(label), "L.%zu.1", match->id);
+    return cg_ir_label(state, IR_LABEL, label, 0);
+}
+
+/*
+ * Open or close an arm of a match, every arm leaves the
+ * match at its end.
+ *
+ * @state: Compiler state
+ * @node: AST_OP_ARM node
+ */
+static int
+cg_compile_arm(struct gup_state *state, struct ast_node *node)
+{
+    struct gup_match *match;
+    struct gup_case *cases;
+    char label[32];
+
+    if (state->match_depth == 0) {
+        trace_error(state, "[AST] match arm outside of a match\n");
+        return -1;
+    }
+
+    match = &state->match_stack[state->match_depth - 1];
+    if (node->epilogue) {
+        snprintf(label, sizeof(label), "L.%zu.1", match->id);
+        return cg_ir_label(state, IR_JMP, label, 0);
+    }
+
+    if (node->left == NULL) {
+        if (match->has_default) {
+            trace_error(state, "match has more than one '_' arm\n");
+            return -1;
+        }
+
+        match->has_default = true;
+        snprintf(label, sizeof(label), "L.%zu.2", match->id);
+        return cg_ir_label(state, IR_LABEL, label, 0);
+    }
+
+    for (struct ast_node *cur = node->left; cur != NULL; cur = cur->right) {
+        for (size_t i = 0; i < match->case_count; ++i) {
+            if (match->cases[i].value == cur->v) {
+                trace_error(state, "value %zu matched more than once\n", cur->v);
+                return -1;
+            }
+        }
+
+        cases = realloc(match->cases, (match->case_count + 1) * sizeof(*cases));
+        if (cases == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        match->cases = cases;
+        match->cases[match->case_count].value = cur->v;
+        match->cases[match->case_count++].arm = match->arm_count;
+    }
+
+    snprintf(label, sizeof(label), "L.%zu.c%zu", match->id, match->arm_count++);
+    return cg_ir_label(state, IR_LABEL, label, 0);
+}
+
+/*
+ * Lower the second value of a return
+ *
+ * @state: Compiler state
+ * @node: Expression of the value
+ * @width: Type of the value
+ */
+static int
+cg_setret(struct gup_state *state, struct ast_node *node, gup_type_t width)
+{
+    struct ir_insn insn = { .op = IR_SETRET, .width = width, .off = 1 };
+
+    if (cg_expr(state, node, width, &insn.a) < 0) {
+        return -1;
+    }
+
+    if (insn.a.type == IR_VAL_IMM) {
+        insn.a.imm &= cg_type_mask(width);
+    }
+
+    return cg_ir(state, &insn);
+}
+
+/*
+ * Lower a single AST node into the IR of the
+ * function being compiled.
+ *
+ * @state: Compiler state
+ * @node: Node to lower
+ */
+static int
+cg_lower_node(struct gup_state *state, struct ast_node *node)
+{
+    struct ir_insn insn = { 0 };
+    struct symbol *symbol;
+
+    switch (node->type) {
+    case AST_OP_FUNC:
+        if ((symbol = node->symbol) == NULL) {
+            trace_error(state, "[AST] function has no symbol\n");
+            return -1;
+        }
+
+        trace_debug("[AST] detected function %s\n", symbol->name);
+        insn.op = IR_ENTRY;
+        insn.sym = symbol->name;
+        insn.flags = symbol->is_pub ? IR_F_GLOBAL : 0;
+        if (symbol->is_hot) {
+            insn.flags |= IR_F_HOT;
+        } else if (symbol->is_cold) {
+            insn.flags |= IR_F_COLD;
+        }
+
+        if (cg_ir(state, &insn) < 0) {
+            return -1;
+        }
+
+        /* Parameters are copied out of their registers first thing */
+        for (size_t i = 0; i < symbol->param_count; ++i) {
+            insn = (struct ir_insn){ .op = IR_PARAM, .width = symbol->params[i].type };
+            insn.dst = ir_vreg_new(&state->cur_func->ir);
+            insn.off = i;
+            state->cur_func->params[i] = insn.dst;
+            if (cg_ir(state, &insn) < 0) {
+                return -1;
+            }
+        }
+
+        return 0;
+    case AST_OP_ASM:
+        if (node->str == NULL) {
+            return -1;
+        }
+
+        insn.op = IR_ASM;
+        insn.sym = node->str;
+        return cg_ir(state, &insn);
+    case AST_OP_RETVOID:
+        insn.op = IR_RET;
+        insn.width = GUP_TYPE_VOID;
+        return cg_ir(state, &insn);
+    case AST_OP_RETIMM:
+        if ((symbol = state->this_func) == NULL) {
+            return -1;
+        }
+
+        insn.op = IR_RET;
+        insn.width = symbol->data_type;
+        insn.a.type = IR_VAL_IMM;
+        insn.a.imm = node->v & cg_type_mask(insn.width);
+        return cg_ir(state, &insn);
+    case AST_OP_RETVAL:
+        if ((symbol = state->this_func) == NULL) {
+            return -1;
+        }
+
+        insn.op = IR_RET;
+        insn.width = symbol->data_type;
+        if (cg_expr(state, node->right, insn.width, &insn.a) < 0) {
+            return -1;
+        }
+
+        if (insn.a.type == IR_VAL_IMM) {
+            insn.a.imm &= cg_type_mask(insn.width);
+        }
+
+        /* The second value is set ahead of returning the first */
+        if (node->left != NULL && cg_setret(state, node->left, symbol->ret_types[1]) < 0) {
+            return -1;
+        }
+
+        return cg_ir(state, &insn);
+    case AST_OP_CALL:
+        return cg_call(state, node, IR_CALL, NULL, 0);
+    case AST_OP_BECOME:
+        return cg_call(state, node->right, IR_TAIL, NULL, 0);
+    case AST_OP_UNPACK:
+        return cg_compile_unpack(state, node);
+    case AST_OP_LOOP:
+        return cg_compile_loop(state, node);
+    case AST_OP_BREAK:
+    case AST_OP_CONTINUE:
+        return cg_compile_loopjmp(state, node);
+    case AST_OP_IF:
+    case AST_OP_ELSE:
+        return cg_compile_cond(state, node);
+    case AST_OP_MATCH:
+        return cg_compile_match(state, node);
+    case AST_OP_ARM:
+        return cg_compile_arm(state, node);
+    case AST_OP_ASSIGN:
+        return cg_compile_assign(state, node);
+    default:
+        trace_error(state, "[AST]: bad node type %d\n", node->type);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Lower a single IR instruction to the machine
+ *
+ * @state: Compiler state
+ * @ir: Function the instruction belongs to
+ * @insn: Instruction to lower
+ */
+static int
+cg_emit_insn(struct gup_state *state, struct ir_func *ir, struct ir_insn *insn)
+{
+    struct ir_label *label;
+    bin_section_t section;
+
+    switch (insn->op) {
+    case IR_NOP:
+        return 0;
+    case IR_ENTRY:
+        section = SECTION_TEXT;
+        if (insn->flags & IR_F_HOT) {
+            section = SECTION_TEXT_HOT;
+        } else if (insn->flags & IR_F_COLD) {
+            section = SECTION_TEXT_UNLIKELY;
+        }
+
+        return mu_cg_funcp(state, insn->sym, insn->flags & IR_F_GLOBAL, section);
+    case IR_LABEL:
+        label = &ir->labels[insn->label];
+        if (label->flags & IR_LABEL_LOOP) {
+            return mu_cg_loopstart(state, label->name);
+        }
+
+        return mu_cg_label(state, label->name);
+    case IR_JMP:
+        return mu_cg_jmp(state, ir->labels[insn->label].name);
+    case IR_CALL:
+        return mu_cg_call(state, insn->sym, insn->flags & IR_F_EXTERN);
+    case IR_TAIL:
+        return mu_cg_jmp(state, insn->sym);
+    case IR_BR:
+        return mu_cg_br(state, insn, ir->labels[insn->label].name);
+    case IR_DECJNZ:
+        return mu_cg_decjnz(state, insn->a.vreg, ir->labels[insn->label].name);
+    case IR_BT:
+        return mu_cg_bt(state, insn, ir->labels[insn->label].name);
+    case IR_JTAB:
+        return mu_cg_jtab(state, insn->a.vreg, ir->labels[insn->label].name);
+    case IR_CASE:
+        return mu_cg_case(state, ir->labels[insn->label].name);
+    case IR_RET:
+        if (insn->a.type == IR_VAL_IMM) {
+            return mu_cg_retimm(state, dtype_to_regsize(insn->width), insn->a.imm);
+        }
+
+        if (insn->a.type == IR_VAL_VREG &&
+            mu_cg_movret(state, 0, dtype_to_regsize(insn->width), insn->a.vreg) < 0) {
+            return -1;
+        }
+
+        return mu_cg_retvoid(state);
+    case IR_SETRET:
+        if (insn->a.type == IR_VAL_VREG) {
+            return mu_cg_movret(state, insn->off, dtype_to_regsize(insn->width),
+                insn->a.vreg);
+        }
+
+        return mu_cg_setret(state, insn->off, dtype_to_regsize(insn->width), insn->a.imm);
+    case IR_PARAM:
+        return mu_cg_param(state, insn->off, insn->width, insn->dst);
+    case IR_ARG:
+        return mu_cg_arg(state, insn->off, &insn->a);
+    case IR_RESULT:
+        return mu_cg_result(state, insn->off, insn->width, insn->dst);
+    case IR_ASM:
+        return mu_cg_asm(state, insn->sym);
+    case IR_STORE:
+        if (insn->a.type == IR_VAL_VREG) {
+            return mu_cg_storereg(state, insn->width, insn->sym, insn->off, insn->a.vreg);
+        }
+
+        if (insn->a.type != IR_VAL_IMM) {
+            break;
+        }
+
+        return mu_cg_setlabel(state, insn->width, insn->sym, insn->off, insn->a.imm);
+    case IR_MOV:
+    case IR_LOAD:
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MOD:
+    case IR_AND:
+    case IR_SHL:
+    case IR_SHR:
+    case IR_MULHI:
+    case IR_CMP:
+        return mu_cg_op(state, insn);
+    default:
+        break;
+    }
+
+    trace_error(state, "[CG] cannot lower IR opcode %d\n", insn->op);
+    return -1;
+}
+
+/*
+ * Lower every instruction of a function that has not
+ * been lowered yet.
+ *
+ * @state: Compiler state
+ * @func: Function to lower
+ */
+static int
+cg_emit_func(struct gup_state *state, struct gup_func *func)
+{
+    struct ir_func *ir = &func->ir;
+
+    while (func->emitted < ir->insn_count) {
+        if (cg_emit_insn(state, ir, &ir->insns[func->emitted++]) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Begin a new function, its body is lowered into IR
+ * until cg_end_func() is called.
+ *
+ * @state: Compiler state
+ * @node: Function node
+ */
+static int
+cg_begin_func(struct gup_state *state, struct ast_node *node)
+{
+    struct gup_func *func;
+
+    if (state->cur_func != NULL) {
+        trace_error(state, "[AST] nested function\n");
+        return -1;
+    }
+
+    if ((func = calloc(1, sizeof(*func))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    func->symbol = node->symbol;
+    state->cur_func = func;
+    return 0;
+}
+
+/*
+ * Release a function and detach it from the state
+ *
+ * @state: Compiler state
+ * @func: Function to release
+ */
+static void
+cg_release_func(struct gup_state *state, struct gup_func *func)
+{
+    if (state->cur_func == func) {
+        state->cur_func = NULL;
+    }
+
+    ir_release(&func->ir);
+    free(func);
+}
+
+/*
+ * Returns the translation unit, creating it on first use
+ *
+ * @state: Compiler state
+ */
+static struct gup_unit *
+cg_unit(struct gup_state *state)
+{
+    if (state->unit == NULL) {
+        state->unit = calloc(1, sizeof(*state->unit));
+    }
+
+    return state->unit;
+}
+
+/*
+ * Compile top level assembly. Once functions are being
+ * held back it lands within .text after them, so it is
+ * held back as well to keep its place.
+ *
+ * @state: Compiler state
+ * @asm_str: Assembly to compile
+ */
+static int
+cg_compile_asm(struct gup_state *state, const char *asm_str)
+{
+    struct gup_unit *unit;
+    const char **text_asm, **top_asm;
+
+    if (state->opt_level == 0) {
+        return mu_cg_asm(state, asm_str);
+    }
+
+    if ((unit = cg_unit(state)) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /* Kept so unit passes can see what the assembly refers to */
+    top_asm = realloc(unit->top_asm, (unit->top_asm_count + 1) * sizeof(*top_asm));
+    if (top_asm == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    unit->top_asm = top_asm;
+    unit->top_asm[unit->top_asm_count++] = asm_str;
+    if (unit->func_count == 0) {
+        return mu_cg_asm(state, asm_str);
+    }
+
+    text_asm = realloc(unit->text_asm, (unit->text_asm_count + 1) * sizeof(*text_asm));
+    if (text_asm == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    unit->text_asm = text_asm;
+    unit->text_asm[unit->text_asm_count++] = asm_str;
+    return 0;
+}
+
+int
+cg_compile_node(struct gup_state *state, struct ast_node *node)
+{
+    if (state == NULL || node == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (node->type == AST_OP_FUNC && cg_begin_func(state, node) < 0) {
+        return -1;
+    }
+
+    /* Structures, initializers and top level assembly bypass the IR */
+    if (state->cur_func == NULL || node->type == AST_OP_STRUCT) {
+        switch (node->type) {
+        case AST_OP_STRUCT:
+            return cg_compile_struct(state, node);
+        case AST_OP_ASM:
+            return cg_compile_asm(state, node->str);
+        case AST_OP_ASSIGN:
+            return cg_compile_assign(state, node);
+        default:
+            trace_error(state, "[AST] node %d outside of function\n", node->type);
+            return -1;
+        }
+    }
+
+    if (cg_lower_node(state, node) < 0) {
+        return -1;
+    }
+
+    /*
+     * At -O0 instructions are emitted as soon as they are lowered,
+     * otherwise the body is held back until cg_end_func(). The arms
+     * of a match are held until its dispatch is moved ahead of them.
+     */
+    if (state->opt_level == 0 && state->match_depth == 0) {
+        return cg_emit_func(state, state->cur_func);
+    }
+
+    return 0;
+}
+
+/*
+ * Emit a finished function through the backend
+ *
+ * @state: Compiler state
+ * @func: Function to emit
+ */
+static int
+cg_flush_func(struct gup_state *state, struct gup_func *func)
+{
+    int error;
+
+    if (state->dump_flags & GUP_DUMP_IR) {
+        ir_dump(stdout, func->symbol->name, &func->ir);
+    }
+
+    error = cg_emit_func(state, func);
+    if (error == 0 && state->opt_level > 0) {
+        error = pass_run_machine(state, func);
+    }
+
+    if (mu_cg_flush(state) < 0) {
+        error = -1;
+    }
+
+    return error;
+}
+
+int
+cg_end_func(struct gup_state *state)
+{
+    struct gup_func *func, **funcs;
+    struct gup_unit *unit;
+    int error = 0;
+
+    if (state == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((func = state->cur_func) == NULL) {
+        return 0;
+    }
+
+    if (state->opt_level == 0) {
+        error = cg_flush_func(state, func);
+        cg_release_func(state, func);
+        return error;
+    }
+
+    if (pass_run(state, func) < 0) {
+        cg_release_func(state, func);
+        return -1;
+    }
+
+    /* Held back until the end of the unit */
+    if ((unit = cg_unit(state)) == NULL) {
+        cg_release_func(state, func);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    funcs = realloc(unit->funcs, (unit->func_count + 1) * sizeof(*funcs));
+    if (funcs == NULL) {
+        cg_release_func(state, func);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    func->group = unit->text_asm_count;
+    unit->funcs = funcs;
+    unit->funcs[unit->func_count++] = func;
+    state->cur_func = NULL;
+    return 0;
+}
+
+void
+cg_discard_func(struct gup_state *state)
+{
+    if (state == NULL || state->cur_func == NULL) {
+        return;
+    }
+
+    while (state->match_depth > 0) {
+        free(state->match_stack[--state->match_depth].cases);
+    }
+
+    cg_release_func(state, state->cur_func);
+}
+
+/*
+ * Returns true if an object starts out all zeroes
+ *
+ * @symbol: Instance to check
+ */
+static bool
+cg_object_zero(const struct symbol *symbol)
+{
+    if (symbol->data == NULL) {
+        return true;
+    }
+
+    for (size_t i = 0; i < symbol->layout->size; ++i) {
+        if (symbol->data[i] != 0)
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Emit the functions of the unit along with the top
+ * level assembly between them.
+ *
+ * @state: Compiler state
+ * @unit: Unit to emit
+ */
+static int
+cg_emit_text(struct gup_state *state, struct gup_unit *unit)
+{
+    for (size_t group = 0; group <= unit->text_asm_count; ++group) {
+        for (size_t i = 0; i < unit->func_count; ++i) {
+            if (unit->funcs[i]->group != group) {
+                continue;
+            }
+
+            if (cg_flush_func(state, unit->funcs[i]) < 0) {
+                return -1;
+            }
+        }
+
+        if (group < unit->text_asm_count &&
+            mu_cg_textasm(state, unit->text_asm[group]) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Release the translation unit
+ *
+ * @state: Compiler state
+ */
+static void
+cg_release_unit(struct gup_state *state)
+{
+    struct gup_unit *unit;
+
+    if ((unit = state->unit) == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < unit->func_count; ++i) {
+        cg_release_func(state, unit->funcs[i]);
+    }
+
+    free(unit->funcs);
+    free(unit->objects);
+    free(unit->text_asm);
+    free(unit->top_asm);
+    free(unit->counts);
+    free(unit);
+    state->unit = NULL;
+}
+
+int
+cg_end_unit(struct gup_state *state)
+{
+    struct symbol *symbol, **objects;
+    struct gup_unit *unit;
+    int error = 0;
+
+    if (state == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((unit = cg_unit(state)) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    TAILQ_FOREACH(symbol, &state->g_symtab.symbols, link) {
+        /* Declared once no matter how often the declaration repeats */
+        if (symbol->is_extern) {
+            if (symbol_from_name(&state->g_symtab, symbol->name) == symbol &&
+                mu_cg_extern(state, symbol->name) < 0) {
+                cg_release_unit(state);
+                return -1;
+            }
+            continue;
+        }
+
+        if (symbol->type != SYMBOL_TYPE_INSTANCE) {
+            continue;
+        }
+
+        /* Initialized to all zeroes is the same as not at all */
+        if (cg_object_zero(symbol)) {
+            symbol->data = NULL;
+        }
+
+        objects = realloc(unit->objects, (unit->object_count + 1) * sizeof(*objects));
+        if (objects == NULL) {
+            cg_release_unit(state);
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        unit->objects = objects;
+        unit->objects[unit->object_count++] = symbol;
+    }
+
+    if (pass_run_unit(state) < 0 || cg_emit_text(state, unit) < 0) {
+        error = -1;
+    }
+
+    /* Objects are emitted last so that code may still fold into them */
+    for (size_t i = 0; i < unit->object_count && error == 0; ++i) {
+        symbol = unit->objects[i];
+        if (symbol->data != NULL) {
+            error = mu_cg_object(state, symbol->name, symbol->layout, symbol->data);
+        }
+    }
+
+    for (size_t i = 0; i < unit->object_count && error == 0; ++i) {
+        symbol = unit->objects[i];
+        if (symbol->data == NULL) {
+            error = mu_cg_object(state, symbol->name, symbol->layout, NULL);
+        }
+    }
+
+    cg_release_unit(state);
+    if (mu_cg_finish(state) < 0) {
+        error = -1;
+    }
+
+    return error;
 }
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "gup/trace.h"
+#include "gup/pass.h"
+
+/*
+ * Returns the index at which every label of a function
+ * is defined, or NULL if out of memory. A label that is
+ * never defined maps to zero.
+ *
+ * @ir: Function to scan
+ */
+static size_t *
+cold_label_defs(const struct ir_func *ir)
+{
+    size_t *defs;
+
+    if ((defs = calloc(ir->label_count + 1, sizeof(*defs))) == NULL) {
+        errno = -ENOMEM;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < ir->insn_count; ++i) {
+        if (ir->insns[i].op == IR_LABEL) {
+            defs[ir->insns[i].label] = i;
+        }
+    }
+
+    return defs;
+}
+
+/*
+ * Move a cold block out of line. A block entered by
+ * falling through a branch has the branch inverted to
+ * jump to it instead, and a block that falls through
+ * at its end jumps back to where it left off.
+ *
+ * @ir: Function the block is in
+ * @start: Index of the cold label
+ * @end: Index of the label the block runs up to
+ * @out: Hot instructions being rebuilt
+ * @cold: Cold instructions being collected
+ */
+static int
+cold_move(struct ir_func *ir, size_t start, size_t end, struct ir_func *out,
+    struct ir_func *cold)
+{
+    struct ir_insn *prev = &out->insns[out->insn_count - 1];
+    struct ir_insn jmp = { .op = IR_JMP, .label = ir->insns[end].label };
+
+    if (prev->op == IR_BR) {
+        prev->flags = ir_cond_invert(prev->flags);
+        prev->label = ir->insns[start].label;
+    } else {
+        /* A jump over the block now lands right after it */
+        --out->insn_count;
+    }
+
+    for (size_t i = start; i < end; ++i) {
+        if (ir_append(cold, &ir->insns[i]) < 0) {
+            return -1;
+        }
+    }
+
+    if (ir_is_terminator(&cold->insns[cold->insn_count - 1])) {
+        return 0;
+    }
+
+    return ir_append(cold, &jmp);
+}
+
+/*
+ * Move blocks marked cold to the end of the function,
+ * leaving the likely path to fall straight through. A
+ * cold block starts at its label and runs up to the
+ * label that the branch ahead of it skips to.
+ */
+int
+pass_cold_blocks(struct gup_state *state, struct gup_func *func)
+{
+    struct ir_func *ir = &func->ir;
+    struct ir_func out = { .vreg_count = ir->vreg_count };
+    struct ir_func cold = { 0 };
+    struct ir_insn *insn, *prev;
+    size_t *defs, end, moved = 0;
+    int error = -1;
+
+    /* Cold blocks may only follow a function that never falls off its end */
+    if (ir->insn_count == 0 || !ir_is_terminator(&ir->insns[ir->insn_count - 1])) {
+        return 0;
+    }
+
+    if ((defs = cold_label_defs(ir)) == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        prev = (out.insn_count > 0) ? &out.insns[out.insn_count - 1] : NULL;
+        if (insn->op != IR_LABEL || !(ir->labels[insn->label].flags & IR_LABEL_COLD) ||
+            prev == NULL || (prev->op != IR_BR && prev->op != IR_JMP)) {
+            if (ir_append(&out, insn) < 0) {
+                goto done;
+            }
+            continue;
+        }
+
+        if ((end = defs[prev->label]) <= i) {
+            if (ir_append(&out, insn) < 0) {
+                goto done;
+            }
+            continue;
+        }
+
+        trace_debug(
+            "[cold-blocks] %s in %s\n",
+            ir->labels[insn->label].name, func->symbol->name
+        );
+
+        if (cold_move(ir, i, end, &out, &cold) < 0) {
+            goto done;
+        }
+
+        ++moved;
+        i = end - 1;
+    }
+
+    for (size_t i = 0; i < cold.insn_count; ++i) {
+        if (ir_append(&out, &cold.insns[i]) < 0) {
+            goto done;
+        }
+    }
+
+    free(ir->insns);
+    ir->insns = out.insns;
+    ir->insn_count = out.insn_count;
+    ir->insn_cap = out.insn_cap;
+    out.insns = NULL;
+    pass_stat("cold-blocks", "blocks moved out of line", moved);
+    error = 0;
+done:
+    free(out.insns);
+    free(cold.insns);
+    free(defs);
+    return error;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include "gup/callgraph.h"
+#include "gup/trace.h"
+#include "gup/pass.h"
+#include "gup/mu.h"
+
+/* Longest name looked for within assembly */
+#define DEAD_MAX_NAME 256
+
+/*
+ * Returns true if a character may appear within a
+ * name in assembly.
+ *
+ * @c: Character to check
+ */
+static inline bool
+dead_namechar(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+/*
+ * Mark a node as reachable and queue it to be walked
+ *
+ * @live: Reachable nodes
+ * @queue: Nodes left to walk
+ * @queue_len: Length of the queue
+ * @node: Node to mark
+ */
+static inline void
+dead_mark(uint8_t *live, size_t *queue, size_t *queue_len, size_t node)
+{
+    if (!live[node]) {
+        live[node] = 1;
+        queue[(*queue_len)++] = node;
+    }
+}
+
+/*
+ * Mark every function named within a string of assembly.
+ * This is conservative, any word matching the name of
+ * a function counts as a reference.
+ *
+ * @cg: Call graph of the unit
+ * @asm_str: Assembly to scan
+ * @live: Reachable nodes
+ * @queue: Nodes left to walk
+ * @queue_len: Length of the queue
+ */
+static void
+dead_scan_asm(const struct callgraph *cg, const char *asm_str, uint8_t *live,
+    size_t *queue, size_t *queue_len)
+{
+    char name[DEAD_MAX_NAME];
+    size_t len;
+    ssize_t node;
+
+    while (*asm_str != '\0') {
+        if (!dead_namechar(*asm_str)) {
+            ++asm_str;
+            continue;
+        }
+
+        for (len = 0; dead_namechar(*asm_str); ++asm_str) {
+            if (len < sizeof(name) - 1) {
+                name[len++] = *asm_str;
+            }
+        }
+
+        name[len] = '\0';
+        if ((node = callgraph_find(cg, name)) >= 0) {
+            dead_mark(live, queue, queue_len, node);
+        }
+    }
+}
+
+int
+pass_dead_func(struct gup_state *state, struct gup_func *func)
+{
+    struct gup_unit *unit = state->unit;
+    struct callgraph_node *node;
+    struct ir_insn *insn;
+    struct callgraph cg;
+    size_t *queue, queue_len = 0, count = 0;
+    size_t removed = 0, bytes = 0;
+    uint8_t *live;
+    ssize_t entry;
+
+    if (unit->func_count == 0) {
+        return 0;
+    }
+
+    if (callgraph_build(state, unit, &cg) < 0) {
+        return -1;
+    }
+
+    live = calloc(cg.node_count, sizeof(*live));
+    queue = calloc(cg.node_count, sizeof(*queue));
+    if (live == NULL || queue == NULL) {
+        free(live);
+        free(queue);
+        callgraph_release(&cg);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /* Public functions and the entry may be called from anywhere */
+    for (size_t i = 0; i < cg.node_count; ++i) {
+        if (cg.nodes[i].func->symbol->is_pub) {
+            dead_mark(live, queue, &queue_len, i);
+        }
+    }
+
+    if ((entry = callgraph_find(&cg, state->entry)) >= 0) {
+        dead_mark(live, queue, &queue_len, entry);
+    }
+
+    for (size_t i = 0; i < unit->top_asm_count; ++i) {
+        dead_scan_asm(&cg, unit->top_asm[i], live, queue, &queue_len);
+    }
+
+    while (queue_len > 0) {
+        node = &cg.nodes[queue[--queue_len]];
+        for (size_t i = 0; i < node->call_count; ++i) {
+            dead_mark(live, queue, &queue_len, node->calls[i].callee);
+        }
+
+        for (size_t i = 0; i < node->func->ir.insn_count; ++i) {
+            insn = &node->func->ir.insns[i];
+            if (insn->op == IR_ASM) {
+                dead_scan_asm(&cg, insn->sym, live, queue, &queue_len);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < cg.node_count; ++i) {
+        func = cg.nodes[i].func;
+        if (live[i]) {
+            unit->funcs[count++] = func;
+            continue;
+        }
+
+        trace_debug("[dead-func] removed %s\n", func->symbol->name);
+        for (size_t j = 0; j < func->ir.insn_count; ++j) {
+            bytes += mu_insn_size(&func->ir.insns[j]);
+        }
+
+        ir_release(&func->ir);
+        free(func);
+        ++removed;
+    }
+
+    unit->func_count = count;
+    pass_stat("dead-func", "functions removed", removed);
+    pass_stat("dead-func", "bytes removed [est]", bytes);
+
+    free(live);
+    free(queue);
+    callgraph_release(&cg);
+    return 0;
+}
@@ -11,6 +11,7 @@
 #include <time.h>
 #include "gup/state.h"
 #include "gup/parser.h"
+#include "gup/pass.h"
 
 #define GUP_VERSION "0.0.4"
 #define ELAPSED_NS(STARTP, ENDP)                            \
@@ -19,6 +20,14 @@
 
 static bool asm_only = false;
 static const char *bin_fmt = "elf64";
+static uint8_t opt_level = 0;
+static uint32_t dump_flags = 0;
+static const char *entry = "main";
+static const char *profile = NULL;
+static size_t inline_limit = PASS_INLINE_LIMIT;
+static const char *header = NULL;
+static size_t align_loops = 0;
+static size_t unroll_limit = PASS_UNROLL_LIMIT;
 
 static void
 help(void)
@@ -28,6 +37,23 @@ help(void)
         "-----------------------------\n"
         "[-h]   Display this help menu\n"
         "[-v]   Display the version\n"
+        "[-a]   Only generate assembly\n"
+        "[-e]   Entry function [default: main]\n"
+        "[-f]   Output format, or one of:\n"
+        "         -f<pass>      Force a pass on\n"
+        "         -fno-<pass>   Force a pass off\n"
+        "         -ftime-passes Report time spent per pass\n"
+        "         -fdump-ir     Dump the IR of each function\n"
+        "         -fdump-layout Dump the layout of each struct\n"
+        "         -fdump-match  Dump how each match is dispatched\n"
+        "         -fprofile-use=<file> Use call counts from <file>\n"
+        "         -finline-limit=<n> Inline functions up to <n> bytes\n"
+        "         -fheader=<file> Write a C header for the unit to <file>\n"
+        "         -falign-loops=<n> Align loop heads to <n> bytes\n"
+        "         -funroll-limit=<n> Unroll loops up to <n> bytes\n"
+        "         -fstats       Report optimization statistics\n"
+        "[-O]   Optimization level [0-%d]\n",
+        PASS_MAX_LEVEL
     );
 }
 
@@ -40,6 +66,82 @@ version(void)
         GUP_VERSION);
 }
 
+/*
+ * Handle a '-f' argument, returns zero if it was a
+ * code generation flag, one if it names an output
+ * format and -1 if it is a bad flag.
+ *
+ * @arg: Argument following '-f'
+ */
+static int
+fflag(const char *arg)
+{
+    if (strcmp(arg, "time-passes") == 0) {
+        pass_set_timing(true);
+        return 0;
+    }
+
+    if (strcmp(arg, "stats") == 0) {
+        pass_set_stats(true);
+        return 0;
+    }
+
+    if (strcmp(arg, "dump-ir") == 0) {
+        dump_flags |= GUP_DUMP_IR;
+        return 0;
+    }
+
+    if (strcmp(arg, "dump-layout") == 0) {
+        dump_flags |= GUP_DUMP_LAYOUT;
+        return 0;
+    }
+
+    if (strcmp(arg, "dump-match") == 0) {
+        dump_flags |= GUP_DUMP_MATCH;
+        return 0;
+    }
+
+    if (strncmp(arg, "profile-use=", 12) == 0) {
+        profile = arg + 12;
+        return 0;
+    }
+
+    if (strncmp(arg, "inline-limit=", 13) == 0) {
+        inline_limit = strtoul(arg + 13, NULL, 0);
+        return 0;
+    }
+
+    if (strncmp(arg, "unroll-limit=", 13) == 0) {
+        unroll_limit = strtoul(arg + 13, NULL, 0);
+        return 0;
+    }
+
+    if (strncmp(arg, "header=", 7) == 0) {
+        header = arg + 7;
+        return 0;
+    }
+
+    if (strncmp(arg, "align-loops=", 12) == 0) {
+        align_loops = strtoul(arg + 12, NULL, 0);
+        if ((align_loops & (align_loops - 1)) != 0) {
+            printf("fatal: loop alignment must be a power of two\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strncmp(arg, "no-", 3) == 0) {
+        if (pass_toggle(arg + 3, false) < 0) {
+            printf("fatal: unknown pass \"%s\"\n", arg + 3);
+            return -1;
+        }
+        return 0;
+    }
+
+    /* Anything else that is not a pass is taken as an output format */
+    return (pass_toggle(arg, true) == 0) ? 0 : 1;
+}
+
 static int
 compile(const char *path)
 {
@@ -54,10 +156,21 @@ compile(const char *path)
         return -1;
     }
 
+    state.opt_level = opt_level;
+    state.dump_flags = dump_flags;
+    state.entry = entry;
+    state.profile = profile;
+    state.inline_limit = inline_limit;
+    state.header = header;
+    state.align_loops = align_loops;
+    state.unroll_limit = unroll_limit;
     clock_gettime(CLOCK_REALTIME, &start);
     if (gup_parse(&state) < 0) {
         printf("fatal: failed to parse \"%s\"\n", path);
         gup_close(&state);
+
+        /* Do not leave the output of a partial unit behind */
+        remove("gupgen.asm");
         return -1;
     }
 
@@ -66,6 +179,7 @@ compile(const char *path)
     elapsed_ms = elapsed_ns / 1e+6;
 
     printf("compiled in %.2fms [%.2fns]\n", elapsed_ms, elapsed_ns);
+    pass_report(stdout);
     gup_close(&state);
 
     /* Generate the output if we can */
@@ -86,9 +200,9 @@ compile(const char *path)
 int
 main(int argc, char **argv)
 {
-    int opt;
+    int opt, error;
 
-    while ((opt = getopt(argc, argv, "hvaf:")) != -1) {
+    while ((opt = getopt(argc, argv, "hvae:f:O:")) != -1) {
         switch (opt) {
         case 'h':
             help();
@@ -99,15 +213,32 @@ main(int argc, char **argv)
         case 'a':
             asm_only = true;
             break;
+        case 'e':
+            entry = optarg;
+            break;
         case 'f':
+            if ((error = fflag(optarg)) < 0) {
+                return 1;
+            }
+
+            if (error == 0) {
+                break;
+            }
+
             bin_fmt = strdup(optarg);
             break;
+        case 'O':
+            opt_level = atoi(optarg);
+            if (opt_level > PASS_MAX_LEVEL) {
+                opt_level = PASS_MAX_LEVEL;
+            }
+            break;
         }
     }
 
     while (optind < argc) {
         if (compile(argv[optind++]) < 0) {
-            break;
+            return 1;
         }
     }
 
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <sys/queue.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "gup/header.h"
+#include "gup/layout.h"
+#include "gup/trace.h"
+
+/* C types of each gup type */
+static const char *ctypetab[] = {
+    [GUP_TYPE_BAD] = "void",
+    [GUP_TYPE_VOID] = "void",
+    [GUP_TYPE_U8] = "uint8_t",
+    [GUP_TYPE_U16] = "uint16_t",
+    [GUP_TYPE_U32] = "uint32_t",
+    [GUP_TYPE_U64] = "uint64_t"
+};
+
+/*
+ * Returns true if a symbol is the first of its name to
+ * be written, a function declared more than once is
+ * only written for its first public declaration.
+ *
+ * @state: Compiler state
+ * @sym: Symbol to check
+ */
+static bool
+header_first(struct gup_state *state, struct symbol *sym)
+{
+    struct symbol *cur;
+
+    TAILQ_FOREACH(cur, &state->g_symtab.symbols, link) {
+        if (cur == sym) {
+            return true;
+        }
+
+        if (cur->type == sym->type && cur->is_pub == sym->is_pub &&
+            strcmp(cur->name, sym->name) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Write the name of the include guard of a header,
+ * derived from the file name.
+ *
+ * @fp: Header being written
+ * @path: Path of the header
+ */
+static void
+header_guard(FILE *fp, const char *path)
+{
+    const char *base = strrchr(path, '/');
+
+    base = (base == NULL) ? path : base + 1;
+    for (const char *p = base; *p != '\0'; ++p) {
+        fputc(isalnum((unsigned char)*p) ? toupper((unsigned char)*p) : '_', fp);
+    }
+}
+
+/*
+ * Write a struct with its padding as explicit fields,
+ * followed by assertions that C lays it out the same.
+ *
+ * @fp: Header being written
+ * @sym: Struct symbol
+ */
+static void
+header_struct(FILE *fp, const struct symbol *sym)
+{
+    const struct layout *layout = sym->layout;
+    const struct layout_field *field;
+    const struct ast_node *node;
+    size_t off = 0, used, align, natural = 1, npad = 0;
+
+    for (size_t i = 0; i < layout->field_count; ++i) {
+        node = layout->fields[i].node;
+        if (node->type == AST_OP_STRUCT) {
+            align = node->symbol->layout->align;
+        } else {
+            align = gup_type_size(node->data_type);
+        }
+
+        if (align > natural) {
+            natural = align;
+        }
+    }
+
+    fprintf(fp, "struct %s {\n", sym->name);
+    for (size_t i = 0; i < layout->field_count; ++i) {
+        field = &layout->fields[i];
+        node = field->node;
+        if (field->off > off) {
+            fprintf(fp, "    uint8_t _pad%zu[%zu];\n", npad++, field->off - off);
+        }
+
+        fprintf(fp, "    ");
+
+        /* C only sees the alignment of the fields */
+        if (i == 0 && layout->align > natural) {
+            fprintf(fp, "alignas(%zu) ", layout->align);
+        }
+
+        if (node->type == AST_OP_STRUCT) {
+            fprintf(fp, "struct %s %s;\n", node->symbol->name, node->str);
+            used = node->symbol->layout->size;
+        } else {
+            fprintf(fp, "%s %s;\n", ctypetab[node->data_type], node->str);
+            used = gup_type_size(node->data_type);
+        }
+
+        off = field->off + used;
+    }
+
+    if (layout->size > off) {
+        fprintf(fp, "    uint8_t _pad%zu[%zu];\n", npad, layout->size - off);
+    }
+
+    fprintf(fp, "};\n\n");
+    fprintf(
+        fp,
+        "static_assert(sizeof(struct %s) == %zu, \"size of struct %s\");\n",
+        sym->name, layout->size, sym->name
+    );
+
+    fprintf(
+        fp,
+        "static_assert(alignof(struct %s) == %zu, \"alignment of struct %s\");\n",
+        sym->name, layout->align, sym->name
+    );
+
+    for (size_t i = 0; i < layout->field_count; ++i) {
+        field = &layout->fields[i];
+        fprintf(
+            fp,
+            "static_assert(offsetof(struct %s, %s) == %zu, \"offset of %s.%s\");\n",
+            sym->name, field->node->str, field->off, sym->name, field->node->str
+        );
+    }
+
+    fprintf(fp, "\n");
+}
+
+/*
+ * Write the prototype of a public function. Two return
+ * values come back as a struct with each value in its
+ * own eightbyte, which C returns within rax:rdx.
+ *
+ * @fp: Header being written
+ * @sym: Function symbol
+ */
+static void
+header_func(FILE *fp, const struct symbol *sym)
+{
+    if (sym->ret_count > 1) {
+        fprintf(fp, "struct %s_ret {\n", sym->name);
+        for (uint8_t i = 0; i < sym->ret_count; ++i) {
+            fprintf(fp, "    alignas(8) %s v%u;\n", ctypetab[sym->ret_types[i]], i);
+        }
+
+        fprintf(fp, "};\n\n");
+        fprintf(fp, "struct %s_ret %s(", sym->name, sym->name);
+    } else if (sym->ret_count == 1) {
+        fprintf(fp, "%s %s(", ctypetab[sym->ret_types[0]], sym->name);
+    } else {
+        fprintf(fp, "void %s(", sym->name);
+    }
+
+    if (sym->param_count == 0) {
+        fprintf(fp, "void");
+    }
+
+    for (uint8_t i = 0; i < sym->param_count; ++i) {
+        fprintf(
+            fp,
+            "%s%s %s",
+            (i > 0) ? ", " : "",
+            ctypetab[sym->params[i].type],
+            sym->params[i].name
+        );
+    }
+
+    fprintf(fp, ");\n");
+}
+
+int
+header_write(struct gup_state *state, const char *path)
+{
+    struct symbol *sym;
+    FILE *fp;
+
+    if (state == NULL || path == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        trace_error(state, "failed to open header \"%s\"\n", path);
+        return -1;
+    }
+
+    fprintf(fp, "/* Generated by gup, do not edit */\n\n");
+    fprintf(fp, "#ifndef ");
+    header_guard(fp, path);
+    fprintf(fp, "\n#define ");
+    header_guard(fp, path);
+    fprintf(fp, " 1\n\n");
+    fprintf(fp, "#include <stdint.h>\n");
+    fprintf(fp, "#include <stddef.h>\n");
+    fprintf(fp, "#include <assert.h>\n");
+    fprintf(fp, "#include <stdalign.h>\n\n");
+    fprintf(fp, "#ifdef __cplusplus\n");
+    fprintf(fp, "extern \"C\" {\n");
+    fprintf(fp, "#endif\n\n");
+
+    TAILQ_FOREACH(sym, &state->g_symtab.symbols, link) {
+        if (sym->type == SYMBOL_TYPE_STRUCT && sym->layout != NULL &&
+            sym->layout->size > 0 && header_first(state, sym)) {
+            header_struct(fp, sym);
+        }
+    }
+
+    TAILQ_FOREACH(sym, &state->g_symtab.symbols, link) {
+        if (sym->type == SYMBOL_TYPE_FUNC && sym->is_pub && !sym->is_extern &&
+            header_first(state, sym)) {
+            header_func(fp, sym);
+        }
+    }
+
+    fprintf(fp, "\n#ifdef __cplusplus\n");
+    fprintf(fp, "}\n");
+    fprintf(fp, "#endif\n\n");
+    fprintf(fp, "#endif  /* !");
+    header_guard(fp, path);
+    fprintf(fp, " */\n");
+    fclose(fp);
+    return 0;
+}
@@ -0,0 +1,547 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <errno.h>
+#include "gup/callgraph.h"
+#include "gup/trace.h"
+#include "gup/pass.h"
+#include "gup/mu.h"
+
+/* Estimated size of one line of inline assembly */
+#define INLINE_ASM_COST 4
+
+/* Longest word looked at within assembly */
+#define INLINE_MAX_WORD 16
+
+/*
+ * Words that make assembly depend on being within its
+ * own function, such as returning or reaching into the
+ * stack frame.
+ */
+static const char *asm_unsafe[] = {
+    "ret", "retf", "retn", "iret", "iretd", "iretq",
+    "sysret", "sysretq", "leave", "enter",
+    "rsp", "esp", "sp", "spl"
+};
+
+#define ASM_UNSAFE_COUNT (sizeof(asm_unsafe) / sizeof(asm_unsafe[0]))
+
+/*
+ * Returns true if a string of assembly may be copied
+ * into another function. Assembly that defines labels
+ * would define them twice.
+ *
+ * @asm_str: Assembly to check
+ */
+static bool
+inline_asm_safe(const char *asm_str)
+{
+    char word[INLINE_MAX_WORD];
+    size_t len;
+
+    if (strchr(asm_str, ':') != NULL) {
+        return false;
+    }
+
+    while (*asm_str != '\0') {
+        if (!isalnum((unsigned char)*asm_str)) {
+            ++asm_str;
+            continue;
+        }
+
+        for (len = 0; isalnum((unsigned char)*asm_str); ++asm_str) {
+            if (len < sizeof(word) - 1) {
+                word[len++] = tolower((unsigned char)*asm_str);
+            }
+        }
+
+        word[len] = '\0';
+        for (size_t i = 0; i < ASM_UNSAFE_COUNT; ++i) {
+            if (strcmp(word, asm_unsafe[i]) == 0)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Returns the estimated size of inline assembly
+ *
+ * @asm_str: Assembly to estimate
+ */
+static size_t
+inline_asm_size(const char *asm_str)
+{
+    size_t lines = 1;
+
+    for (; *asm_str != '\0'; ++asm_str) {
+        if (*asm_str == '\n')
+            ++lines;
+    }
+
+    return lines * INLINE_ASM_COST;
+}
+
+/*
+ * Returns the estimated size of a function body once
+ * inlined, or -1 if it cannot be inlined at all.
+ *
+ * @func: Function to estimate
+ */
+static ssize_t
+inline_cost(const struct gup_func *func)
+{
+    const struct ir_func *ir = &func->ir;
+    const struct ir_insn *insn;
+    ssize_t cost = 0;
+
+    for (size_t i = 1; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        switch (insn->op) {
+        case IR_ENTRY:
+            return -1;
+        case IR_CALL:
+        case IR_TAIL:
+            /* Recursion would never finish unrolling */
+            if (strcmp(insn->sym, func->symbol->name) == 0) {
+                return -1;
+            }
+
+            /* A tail call becomes a call, and a jump unless it comes last */
+            cost += mu_insn_size(insn);
+            if (insn->op == IR_TAIL && i + 1 < ir->insn_count) {
+                cost += mu_insn_size(&(struct ir_insn){ .op = IR_JMP });
+            }
+            break;
+        case IR_ASM:
+            if (!inline_asm_safe(insn->sym)) {
+                return -1;
+            }
+
+            /* Labels are renamed once copied, the assembly would not be */
+            for (uint32_t j = 0; j < ir->label_count; ++j) {
+                if (strstr(insn->sym, ir->labels[j].name) != NULL)
+                    return -1;
+            }
+
+            cost += inline_asm_size(insn->sym);
+            break;
+        case IR_RET:
+            /* The return becomes a jump unless it comes last */
+            cost += mu_insn_size(insn) - 1;
+            if (i + 1 < ir->insn_count) {
+                cost += mu_insn_size(&(struct ir_insn){ .op = IR_JMP });
+            }
+            break;
+        default:
+            cost += mu_insn_size(insn);
+            break;
+        }
+    }
+
+    return cost;
+}
+
+/*
+ * Returns true if calls to a function should be inlined
+ *
+ * @state: Compiler state
+ * @func: Function being called
+ * @warned: Set once the function has been warned about
+ */
+static bool
+inline_wanted(struct gup_state *state, const struct gup_func *func, uint8_t *warned)
+{
+    struct symbol *symbol = func->symbol;
+    ssize_t cost;
+
+    /* Cold code stays out of line, away from its callers */
+    if (symbol->is_noinline || symbol->is_cold || func->ir.insn_count == 0) {
+        return false;
+    }
+
+    if ((cost = inline_cost(func)) < 0) {
+        if (symbol->is_inline && !*warned) {
+            trace_warn("cannot inline \"%s\"\n", symbol->name);
+            *warned = 1;
+        }
+        return false;
+    }
+
+    return symbol->is_inline || (size_t)cost <= state->inline_limit;
+}
+
+/*
+ * Returns true if an instruction reads or writes a
+ * virtual register.
+ *
+ * @insn: Instruction to check
+ * @vreg: Virtual register
+ */
+static inline bool
+inline_mentions(const struct ir_insn *insn, ir_vreg_t vreg)
+{
+    if (insn->dst == vreg) {
+        return true;
+    }
+
+    if (insn->a.type == IR_VAL_VREG && insn->a.vreg == vreg) {
+        return true;
+    }
+
+    return insn->b.type == IR_VAL_VREG && insn->b.vreg == vreg;
+}
+
+/*
+ * Returns true if a virtual register appears both before
+ * and after an instruction, and so may be live across it.
+ *
+ * @ir: Function to scan
+ * @at: Index of the instruction
+ */
+static bool
+inline_live_across(const struct ir_func *ir, size_t at)
+{
+    const struct ir_insn *insn;
+    ir_vreg_t vregs[3];
+
+    for (size_t i = 0; i < at; ++i) {
+        insn = &ir->insns[i];
+        vregs[0] = insn->dst;
+        vregs[1] = (insn->a.type == IR_VAL_VREG) ? insn->a.vreg : IR_VREG_NONE;
+        vregs[2] = (insn->b.type == IR_VAL_VREG) ? insn->b.vreg : IR_VREG_NONE;
+        for (size_t v = 0; v < 3; ++v) {
+            if (vregs[v] == IR_VREG_NONE) {
+                continue;
+            }
+
+            for (size_t j = at + 1; j < ir->insn_count; ++j) {
+                if (inline_mentions(&ir->insns[j], vregs[v]))
+                    return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Returns true if a call site suits inlining a function
+ * that was not declared inline. Registers are spilled
+ * around inline assembly for every value live across it,
+ * and code within a cold block is better left out of line.
+ *
+ * @callee: Function being called
+ * @ir: Function the call is in
+ * @at: Index of the call
+ * @cold: Set if the call is within a cold block
+ */
+static bool
+inline_site_wanted(const struct gup_func *callee, const struct ir_func *ir, size_t at,
+    bool cold)
+{
+    const struct ir_func *body = &callee->ir;
+    bool has_asm = false;
+
+    if (callee->symbol->is_inline) {
+        return true;
+    }
+
+    if (cold) {
+        return false;
+    }
+
+    for (size_t i = 0; i < body->insn_count && !has_asm; ++i) {
+        has_asm = body->insns[i].op == IR_ASM;
+    }
+
+    return !has_asm || !inline_live_across(ir, at);
+}
+
+/*
+ * Give a copied label a name of its own. Loop labels are
+ * named 'L.<n>' with suffixes for the labels belonging to
+ * the same loop, so every 'L.<n>' of the callee maps to a
+ * fresh 'L.<k>' with the suffix kept.
+ *
+ * @state: Compiler state
+ * @name: Name of the label within the callee
+ * @map: Callee loop numbers mapped to fresh ones, -1 if not yet
+ * @map_len: Length of @map
+ */
+static const char *
+inline_label_name(struct gup_state *state, const char *name, ssize_t *map,
+    size_t map_len)
+{
+    char buf[64];
+    const char *rest = "";
+    size_t n;
+    char *end;
+
+    n = map_len;
+    if (strncmp(name, "L.", 2) == 0) {
+        n = strtoul(name + 2, &end, 10);
+        rest = end;
+    }
+
+    if (n >= map_len) {
+        snprintf(buf, sizeof(buf), "L.%zu%s", state->loop_count++, rest);
+        return ptrbox_strdup(&state->ptrbox, buf);
+    }
+
+    if (map[n] < 0) {
+        map[n] = state->loop_count++;
+    }
+
+    snprintf(buf, sizeof(buf), "L.%zd%s", map[n], rest);
+    return ptrbox_strdup(&state->ptrbox, buf);
+}
+
+/*
+ * Move the virtual registers of a copied instruction
+ * past those of the caller.
+ *
+ * @insn: Instruction to rebase
+ * @base: Number of virtual registers of the caller
+ */
+static inline void
+inline_rebase(struct ir_insn *insn, ir_vreg_t base)
+{
+    if (insn->dst != IR_VREG_NONE) {
+        insn->dst += base;
+    }
+
+    if (insn->a.type == IR_VAL_VREG) {
+        insn->a.vreg += base;
+    }
+
+    if (insn->b.type == IR_VAL_VREG) {
+        insn->b.vreg += base;
+    }
+}
+
+/*
+ * Copy the body of a function in place of a call to it
+ *
+ * @state: Compiler state
+ * @caller: Function the call is in
+ * @callee: Function being called
+ * @args: Arguments of the call, by parameter
+ * @out: Instructions of the caller being rebuilt
+ */
+static int
+inline_call(struct gup_state *state, struct ir_func *caller,
+    const struct gup_func *callee, const struct ir_val *args, struct ir_func *out)
+{
+    const struct ir_func *ir = &callee->ir;
+    struct ir_insn insn;
+    uint32_t *labels, done = IR_LABEL_NONE;
+    size_t map_len = state->loop_count;
+    ssize_t *map;
+    const char *name;
+    int error = -1;
+
+    labels = calloc(ir->label_count + 1, sizeof(*labels));
+    map = malloc((map_len + 1) * sizeof(*map));
+    if (labels == NULL || map == NULL) {
+        errno = -ENOMEM;
+        goto done;
+    }
+
+    memset(map, 0xFF, (map_len + 1) * sizeof(*map));
+    for (uint32_t i = 0; i < ir->label_count; ++i) {
+        name = inline_label_name(state, ir->labels[i].name, map, map_len);
+        if (name == NULL || (labels[i] = ir_label(caller, name)) == IR_LABEL_NONE) {
+            errno = -ENOMEM;
+            goto done;
+        }
+
+        caller->labels[labels[i]].flags = ir->labels[i].flags;
+        caller->labels[labels[i]].unroll = ir->labels[i].unroll;
+    }
+
+    for (size_t i = 1; i < ir->insn_count; ++i) {
+        insn = ir->insns[i];
+        switch (insn.op) {
+        case IR_LABEL:
+        case IR_JMP:
+        case IR_BR:
+        case IR_DECJNZ:
+        case IR_BT:
+        case IR_JTAB:
+        case IR_CASE:
+            insn.label = labels[insn.label];
+            break;
+        case IR_PARAM:
+            /* Parameters are copies of the arguments */
+            insn.op = IR_MOV;
+            insn.dst += caller->vreg_count;
+            insn.a = args[insn.off];
+            if (ir_append(out, &insn) < 0) {
+                goto done;
+            }
+            continue;
+        case IR_TAIL:
+            /* What the call returns is what the body returns */
+            insn.op = IR_CALL;
+            if (ir_append(out, &insn) < 0) {
+                goto done;
+            }
+            /* Fallthrough */
+        case IR_RET:
+            if (insn.a.type != IR_VAL_NONE) {
+                insn.op = IR_SETRET;
+                inline_rebase(&insn, caller->vreg_count);
+                if (ir_append(out, &insn) < 0) {
+                    goto done;
+                }
+            }
+
+            if (i + 1 == ir->insn_count) {
+                continue;
+            }
+
+            /* Returning jumps past the rest of the body */
+            if (done == IR_LABEL_NONE) {
+                name = inline_label_name(state, "", NULL, 0);
+                if (name == NULL || (done = ir_label(caller, name)) == IR_LABEL_NONE) {
+                    errno = -ENOMEM;
+                    goto done;
+                }
+            }
+
+            insn = (struct ir_insn){ .op = IR_JMP, .label = done };
+            break;
+        default:
+            break;
+        }
+
+        /* Virtual registers of the callee follow those of the caller */
+        inline_rebase(&insn, caller->vreg_count);
+        if (ir_append(out, &insn) < 0) {
+            goto done;
+        }
+    }
+
+    if (done != IR_LABEL_NONE) {
+        insn = (struct ir_insn){ .op = IR_LABEL, .label = done };
+        if (ir_append(out, &insn) < 0) {
+            goto done;
+        }
+    }
+
+    caller->vreg_count += ir->vreg_count;
+    error = 0;
+done:
+    free(labels);
+    free(map);
+    return error;
+}
+
+int
+pass_inline(struct gup_state *state, struct gup_func *func)
+{
+    struct ir_val args[SYMBOL_MAX_PARAMS];
+    struct gup_unit *unit = state->unit;
+    struct ir_func *ir, out;
+    struct ir_insn *insn, ret;
+    struct callgraph cg;
+    uint8_t *warned;
+    size_t inlined;
+    ssize_t callee;
+    int error = 0;
+    bool cold;
+
+    if (unit->func_count == 0) {
+        return 0;
+    }
+
+    if (callgraph_build(state, unit, &cg) < 0) {
+        return -1;
+    }
+
+    if ((warned = calloc(cg.node_count, sizeof(*warned))) == NULL) {
+        callgraph_release(&cg);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /*
+     * Callees are defined before their callers, so going in
+     * unit order inlines into callees first.
+     */
+    for (size_t i = 0; i < cg.node_count && error == 0; ++i) {
+        func = cg.nodes[i].func;
+        ir = &func->ir;
+        memset(&out, 0, sizeof(out));
+        inlined = 0;
+        cold = false;
+
+        for (size_t j = 0; j < ir->insn_count; ++j) {
+            insn = &ir->insns[j];
+            callee = -1;
+            if (insn->op == IR_CALL || insn->op == IR_TAIL) {
+                callee = callgraph_find(&cg, insn->sym);
+            } else if (insn->op == IR_LABEL) {
+                cold = (ir->labels[insn->label].flags & IR_LABEL_COLD) != 0;
+            }
+
+            if (callee < 0 || (size_t)callee == i ||
+                !inline_wanted(state, cg.nodes[callee].func, &warned[callee]) ||
+                !inline_site_wanted(cg.nodes[callee].func, ir, j, cold)) {
+                if (ir_append(&out, insn) < 0) {
+                    error = -1;
+                    break;
+                }
+                continue;
+            }
+
+            /* The arguments just before the call are taken back */
+            while (out.insn_count > 0 && out.insns[out.insn_count - 1].op == IR_ARG) {
+                --out.insn_count;
+                args[out.insns[out.insn_count].off] = out.insns[out.insn_count].a;
+            }
+
+            trace_debug("[inline] %s into %s\n", insn->sym, func->symbol->name);
+            if (inline_call(state, ir, cg.nodes[callee].func, args, &out) < 0) {
+                error = -1;
+                break;
+            }
+
+            /* The body leaves its values where a return takes them from */
+            ret = (struct ir_insn){ .op = IR_RET, .width = GUP_TYPE_VOID };
+            if (insn->op == IR_TAIL && ir_append(&out, &ret) < 0) {
+                error = -1;
+                break;
+            }
+
+            ++inlined;
+        }
+
+        if (error != 0 || inlined == 0) {
+            free(out.insns);
+            continue;
+        }
+
+        free(ir->insns);
+        ir->insns = out.insns;
+        ir->insn_count = out.insn_count;
+        ir->insn_cap = out.insn_cap;
+        pass_stat("inline", "calls inlined", inlined);
+    }
+
+    free(warned);
+    callgraph_release(&cg);
+    return error;
+}
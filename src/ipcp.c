@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "gup/callgraph.h"
+#include "gup/trace.h"
+#include "gup/pass.h"
+#include "gup/mu.h"
+
+/*
+ * What is known about the return value of a function
+ *
+ * @IPCP_UNKNOWN: Not yet seen a return
+ * @IPCP_VOID: Every return leaves the return register alone
+ * @IPCP_CONST: Every return yields the same constant
+ * @IPCP_VARYING: Anything else
+ */
+typedef enum {
+    IPCP_UNKNOWN,
+    IPCP_VOID,
+    IPCP_CONST,
+    IPCP_VARYING
+} ipcp_kind_t;
+
+/*
+ * Summary of a function
+ *
+ * @kind: What is known of the return value
+ * @width: Width of the constant [IPCP_CONST]
+ * @imm: Value of the constant [IPCP_CONST]
+ * @pure: Set if the function has no effect other than returning
+ */
+struct ipcp_summary {
+    ipcp_kind_t kind;
+    uint8_t width;
+    uint64_t imm;
+    bool pure;
+};
+
+/*
+ * Merge the value of a single return into a summary
+ *
+ * @sum: Summary to merge into
+ * @ret: Return instruction, or the SETRET just before it
+ */
+static void
+ipcp_merge(struct ipcp_summary *sum, const struct ir_insn *ret)
+{
+    ipcp_kind_t kind = IPCP_VOID;
+
+    if (ret->a.type == IR_VAL_IMM) {
+        kind = IPCP_CONST;
+    } else if (ret->a.type != IR_VAL_NONE) {
+        kind = IPCP_VARYING;
+    }
+
+    if (sum->kind == IPCP_UNKNOWN) {
+        sum->kind = kind;
+        sum->width = ret->width;
+        sum->imm = ret->a.imm;
+        return;
+    }
+
+    if (sum->kind != kind) {
+        sum->kind = IPCP_VARYING;
+        return;
+    }
+
+    if (kind == IPCP_CONST && (sum->width != ret->width || sum->imm != ret->a.imm)) {
+        sum->kind = IPCP_VARYING;
+    }
+}
+
+/*
+ * Summarize the return value and side effects of
+ * a function.
+ *
+ * @func: Function to summarize
+ * @res: Summary is written here
+ */
+static void
+ipcp_summarize(const struct gup_func *func, struct ipcp_summary *res)
+{
+    const struct ir_func *ir = &func->ir;
+    const struct ir_insn *insn, *prev = NULL;
+    bool loaded = false;
+
+    res->kind = IPCP_UNKNOWN;
+    res->pure = true;
+    for (size_t i = 1; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        switch (insn->op) {
+        case IR_NOP:
+            continue;
+        case IR_LABEL:
+        case IR_JMP:
+        case IR_PARAM:
+        case IR_MOV:
+        case IR_RESULT:
+            break;
+        case IR_SETRET:
+            /* Only the first return value is tracked */
+            if (insn->off != 0) {
+                res->kind = IPCP_VARYING;
+            }
+
+            loaded = true;
+            break;
+        case IR_RET:
+            /* A value loaded just before returning is what is returned */
+            if (insn->a.type == IR_VAL_NONE && prev != NULL &&
+                prev->op == IR_SETRET) {
+                insn = prev;
+            } else if (insn->a.type == IR_VAL_NONE && loaded) {
+                res->kind = IPCP_VARYING;
+                break;
+            }
+
+            ipcp_merge(res, insn);
+            break;
+        case IR_TAIL:
+            /* Returns whatever the callee returns */
+            res->kind = IPCP_VARYING;
+            res->pure = false;
+            break;
+        default:
+            res->pure = false;
+            break;
+        }
+
+        prev = &ir->insns[i];
+    }
+
+    /* Assembly before a plain return may have set the value */
+    if (!res->pure && res->kind == IPCP_VOID) {
+        res->kind = IPCP_VARYING;
+    }
+}
+
+/*
+ * Returns true if the return register is overwritten
+ * before anything can look at it.
+ *
+ * @ir: Function to scan
+ * @idx: Index just past the value
+ */
+static bool
+ipcp_dead_value(const struct ir_func *ir, size_t idx)
+{
+    const struct ir_insn *insn;
+
+    for (; idx < ir->insn_count; ++idx) {
+        insn = &ir->insns[idx];
+        switch (insn->op) {
+        case IR_NOP:
+        case IR_STORE:
+            continue;
+        case IR_SETRET:
+            if (insn->off != 0) {
+                continue;
+            }
+            return true;
+        case IR_RET:
+            return insn->a.type == IR_VAL_IMM;
+        default:
+            return false;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Returns true if an instruction may take an immediate
+ * in place of the virtual register it reads as its
+ * first operand.
+ *
+ * @insn: Instruction to check
+ */
+static inline bool
+ipcp_takes_imm(const struct ir_insn *insn)
+{
+    switch (insn->op) {
+    case IR_STORE:
+    case IR_RET:
+    case IR_SETRET:
+    case IR_ARG:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Hand the constant a folded call returns straight to
+ * the result that takes it, and on to the instructions
+ * that read the result where they can take a constant.
+ *
+ * @ir: Function the call is in
+ * @call: Index of the folded call
+ * @sum: Summary of the callee
+ *
+ * Returns false if no result takes the value
+ */
+static bool
+ipcp_fold_result(struct ir_func *ir, size_t call, const struct ipcp_summary *sum)
+{
+    struct ir_insn *res, *insn;
+    ir_vreg_t vreg;
+    bool used = false;
+
+    if (call + 1 >= ir->insn_count) {
+        return false;
+    }
+
+    res = &ir->insns[call + 1];
+    if (res->op != IR_RESULT || res->off != 0) {
+        return false;
+    }
+
+    vreg = res->dst;
+    *res = (struct ir_insn){ .op = IR_MOV, .width = res->width, .dst = vreg };
+    res->a.type = IR_VAL_IMM;
+    res->a.imm = sum->imm;
+
+    for (size_t i = call + 2; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        if (ipcp_takes_imm(insn) && insn->a.type == IR_VAL_VREG && insn->a.vreg == vreg) {
+            insn->a = res->a;
+        }
+
+        if ((insn->a.type == IR_VAL_VREG && insn->a.vreg == vreg) ||
+            (insn->b.type == IR_VAL_VREG && insn->b.vreg == vreg) || insn->dst == vreg) {
+            used = true;
+        }
+    }
+
+    /* Nothing reads the register any longer */
+    if (!used) {
+        res->op = IR_NOP;
+    }
+
+    return true;
+}
+
+/*
+ * Replace calls to functions with known results within
+ * a single function.
+ *
+ * @cg: Call graph of the unit
+ * @sums: Summary of each node
+ * @ir: Function to rewrite
+ *
+ * Returns the number of calls replaced
+ */
+static size_t
+ipcp_rewrite(const struct callgraph *cg, const struct ipcp_summary *sums,
+    struct ir_func *ir)
+{
+    const struct ipcp_summary *sum;
+    struct ir_insn *insn;
+    size_t n = 0, folded = 0, removed = 0;
+    ssize_t callee;
+
+    for (size_t i = 0; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        if (insn->op != IR_CALL || (callee = callgraph_find(cg, insn->sym)) < 0) {
+            continue;
+        }
+
+        sum = &sums[callee];
+        if (!sum->pure || cg->nodes[callee].func->symbol->is_noinline) {
+            continue;
+        }
+
+        switch (sum->kind) {
+        case IPCP_CONST:
+            ++folded;
+            if (ipcp_fold_result(ir, i, sum)) {
+                insn->op = IR_NOP;
+                break;
+            }
+
+            /* Nothing takes the result, the value is left where a return finds it */
+            *insn = (struct ir_insn){ .op = IR_SETRET, .width = sum->width };
+            insn->a.type = IR_VAL_IMM;
+            insn->a.imm = sum->imm;
+            break;
+        case IPCP_VOID:
+            insn->op = IR_NOP;
+            ++removed;
+            break;
+        default:
+            continue;
+        }
+
+        /* The arguments are no longer passed */
+        for (size_t j = i; j-- > 0 && ir->insns[j].op == IR_ARG;) {
+            ir->insns[j].op = IR_NOP;
+        }
+    }
+
+    /* Drop values that are never looked at, along with the NOPs */
+    for (size_t i = 0; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        if (insn->op == IR_SETRET && insn->off == 0 && ipcp_dead_value(ir, i + 1)) {
+            insn->op = IR_NOP;
+            ++removed;
+        }
+
+        if (insn->op != IR_NOP) {
+            ir->insns[n++] = *insn;
+        }
+    }
+
+    ir->insn_count = n;
+    pass_stat("ipcp", "calls folded", folded);
+    pass_stat("ipcp", "values removed", removed);
+    return folded + removed;
+}
+
+/*
+ * Replace calls to functions that have no side effects
+ * and always return the same constant with the constant,
+ * and drop calls to those that return nothing at all.
+ * Repeated as replacing calls may give a caller a known
+ * result of its own.
+ */
+int
+pass_ipcp(struct gup_state *state, struct gup_func *func)
+{
+    struct gup_unit *unit = state->unit;
+    struct ipcp_summary *sums;
+    struct callgraph cg;
+    size_t changed, consts = 0;
+
+    if (unit->func_count == 0) {
+        return 0;
+    }
+
+    if (callgraph_build(state, unit, &cg) < 0) {
+        return -1;
+    }
+
+    if ((sums = calloc(cg.node_count, sizeof(*sums))) == NULL) {
+        callgraph_release(&cg);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    do {
+        changed = 0;
+        for (size_t i = 0; i < cg.node_count; ++i) {
+            ipcp_summarize(cg.nodes[i].func, &sums[i]);
+        }
+
+        for (size_t i = 0; i < cg.node_count; ++i) {
+            changed += ipcp_rewrite(&cg, sums, &cg.nodes[i].func->ir);
+        }
+    } while (changed > 0);
+
+    for (size_t i = 0; i < cg.node_count; ++i) {
+        if (sums[i].kind == IPCP_CONST) {
+            trace_debug("[ipcp] %s returns %llu\n", cg.nodes[i].func->symbol->name,
+                (unsigned long long)sums[i].imm);
+            ++consts;
+        }
+    }
+
+    pass_stat("ipcp", "constant functions", consts);
+    free(sums);
+    callgraph_release(&cg);
+    return 0;
+}
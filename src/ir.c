@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/ir.h"
+
+/* Opcode mnemonics for dumps */
+static const char *irop[] = {
+    [IR_NOP]    = "nop",
+    [IR_ENTRY]  = "entry",
+    [IR_LABEL]  = "label",
+    [IR_JMP]    = "jmp",
+    [IR_CALL]   = "call",
+    [IR_RET]    = "ret",
+    [IR_ASM]    = "asm",
+    [IR_MOV]    = "mov",
+    [IR_STORE]  = "store",
+    [IR_SETRET] = "setret",
+    [IR_LOAD]   = "load",
+    [IR_ADD]    = "add",
+    [IR_SUB]    = "sub",
+    [IR_MUL]    = "mul",
+    [IR_DIV]    = "div",
+    [IR_MOD]    = "mod",
+    [IR_AND]    = "and",
+    [IR_SHL]    = "shl",
+    [IR_SHR]    = "shr",
+    [IR_MULHI]  = "mulhi",
+    [IR_CMP]    = "cmp",
+    [IR_PARAM]  = "param",
+    [IR_ARG]    = "arg",
+    [IR_RESULT] = "result",
+    [IR_TAIL]   = "tail",
+    [IR_BR]     = "br",
+    [IR_DECJNZ] = "decjnz",
+    [IR_BT]     = "bt",
+    [IR_JTAB]   = "jtab",
+    [IR_CASE]   = "case"
+};
+
+/* Condition suffixes for dumps */
+static const char *ircond[] = {
+    [IR_COND_EQ] = ".eq",
+    [IR_COND_LT] = ".lt",
+    [IR_COND_LE] = ".le",
+    [IR_COND_GT] = ".gt",
+    [IR_COND_GE] = ".ge",
+    [IR_COND_NE] = ".ne"
+};
+
+/* Width suffixes for dumps */
+static const char *irwidth[] = {
+    [GUP_TYPE_BAD]  = "",
+    [GUP_TYPE_VOID] = "",
+    [GUP_TYPE_U8]   = ".u8",
+    [GUP_TYPE_U16]  = ".u16",
+    [GUP_TYPE_U32]  = ".u32",
+    [GUP_TYPE_U64]  = ".u64"
+};
+
+ssize_t
+ir_append(struct ir_func *func, const struct ir_insn *insn)
+{
+    struct ir_insn *insns;
+    size_t new_cap;
+
+    if (func == NULL || insn == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (func->insn_count >= func->insn_cap) {
+        new_cap = (func->insn_cap == 0) ? 32 : func->insn_cap * 2;
+        insns = realloc(func->insns, new_cap * sizeof(*insns));
+        if (insns == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        func->insns = insns;
+        func->insn_cap = new_cap;
+    }
+
+    func->insns[func->insn_count] = *insn;
+    return func->insn_count++;
+}
+
+uint32_t
+ir_label(struct ir_func *func, const char *name)
+{
+    struct ir_label *labels;
+    uint32_t new_cap;
+
+    if (func == NULL || name == NULL) {
+        return IR_LABEL_NONE;
+    }
+
+    for (uint32_t i = 0; i < func->label_count; ++i) {
+        if (strcmp(func->labels[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    if (func->label_count >= func->label_cap) {
+        new_cap = (func->label_cap == 0) ? 8 : func->label_cap * 2;
+        labels = realloc(func->labels, new_cap * sizeof(*labels));
+        if (labels == NULL) {
+            return IR_LABEL_NONE;
+        }
+
+        func->labels = labels;
+        func->label_cap = new_cap;
+    }
+
+    func->labels[func->label_count].name = name;
+    func->labels[func->label_count].flags = 0;
+    func->labels[func->label_count].unroll = 0;
+    return func->label_count++;
+}
+
+ir_vreg_t
+ir_vreg_new(struct ir_func *func)
+{
+    if (func == NULL) {
+        return IR_VREG_NONE;
+    }
+
+    /* Register zero is reserved for IR_VREG_NONE */
+    return ++func->vreg_count;
+}
+
+bool
+ir_is_terminator(const struct ir_insn *insn)
+{
+    switch (insn->op) {
+    case IR_JMP:
+    case IR_RET:
+    case IR_TAIL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool
+ir_is_branch(const struct ir_insn *insn)
+{
+    switch (insn->op) {
+    case IR_JMP:
+    case IR_BR:
+    case IR_DECJNZ:
+    case IR_BT:
+    case IR_CASE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+ir_cond_t
+ir_cond_invert(ir_cond_t cond)
+{
+    switch (cond) {
+    case IR_COND_EQ:
+        return IR_COND_NE;
+    case IR_COND_LT:
+        return IR_COND_GE;
+    case IR_COND_LE:
+        return IR_COND_GT;
+    case IR_COND_GT:
+        return IR_COND_LE;
+    case IR_COND_GE:
+        return IR_COND_LT;
+    default:
+        return IR_COND_EQ;
+    }
+}
+
+ir_cond_t
+ir_cond_swap(ir_cond_t cond)
+{
+    switch (cond) {
+    case IR_COND_LT:
+        return IR_COND_GT;
+    case IR_COND_LE:
+        return IR_COND_GE;
+    case IR_COND_GT:
+        return IR_COND_LT;
+    case IR_COND_GE:
+        return IR_COND_LE;
+    default:
+        return cond;
+    }
+}
+
+int
+ir_split_blocks(struct ir_func *func)
+{
+    struct ir_block *blocks;
+    struct ir_insn *insn;
+    size_t count = 0;
+    size_t start = 0;
+
+    if (func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* There can never be more blocks than instructions */
+    free(func->blocks);
+    func->blocks = NULL;
+    func->block_count = 0;
+    if (func->insn_count == 0) {
+        return 0;
+    }
+
+    blocks = malloc(func->insn_count * sizeof(*blocks));
+    if (blocks == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (size_t i = 0; i < func->insn_count; ++i) {
+        insn = &func->insns[i];
+
+        /* A label always starts a new block */
+        if (insn->op == IR_LABEL && i > start) {
+            blocks[count].start = start;
+            blocks[count].end = i;
+            ++count;
+            start = i;
+        }
+
+        /* A conditional branch ends its block as well */
+        if (ir_is_terminator(insn) || ir_is_branch(insn)) {
+            blocks[count].start = start;
+            blocks[count].end = i + 1;
+            ++count;
+            start = i + 1;
+        }
+    }
+
+    if (start < func->insn_count) {
+        blocks[count].start = start;
+        blocks[count].end = func->insn_count;
+        ++count;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        insn = &func->insns[blocks[i].start];
+        blocks[i].label = (insn->op == IR_LABEL) ? insn->label : IR_LABEL_NONE;
+    }
+
+    func->blocks = blocks;
+    func->block_count = count;
+    return 0;
+}
+
+/*
+ * Write a single operand
+ *
+ * @fp: File to write to
+ * @val: Operand to write
+ */
+static void
+ir_dump_val(FILE *fp, const struct ir_val *val)
+{
+    switch (val->type) {
+    case IR_VAL_IMM:
+        fprintf(fp, "%llu", (unsigned long long)val->imm);
+        break;
+    case IR_VAL_VREG:
+        fprintf(fp, "%%%u", val->vreg);
+        break;
+    default:
+        break;
+    }
+}
+
+void
+ir_dump(FILE *fp, const char *name, const struct ir_func *func)
+{
+    const struct ir_insn *insn;
+
+    if (fp == NULL || func == NULL) {
+        return;
+    }
+
+    fprintf(fp, "fn %s {\n", name);
+    for (size_t i = 0; i < func->insn_count; ++i) {
+        insn = &func->insns[i];
+        if (insn->op == IR_LABEL) {
+            fprintf(fp, "%s:\n", func->labels[insn->label].name);
+            continue;
+        }
+
+        fprintf(fp, "    ");
+        if (insn->dst != IR_VREG_NONE) {
+            fprintf(fp, "%%%u = ", insn->dst);
+        }
+
+        fprintf(fp, "%s", irop[insn->op]);
+        if (insn->op == IR_CMP || insn->op == IR_BR) {
+            fprintf(fp, "%s", ircond[insn->flags]);
+        }
+
+        fprintf(fp, "%s", irwidth[insn->width]);
+        switch (insn->op) {
+        case IR_ENTRY:
+            fprintf(fp, " %s%s", insn->sym, (insn->flags & IR_F_GLOBAL) ? " pub" : "");
+            if (insn->flags & (IR_F_HOT | IR_F_COLD)) {
+                fprintf(fp, " %s", (insn->flags & IR_F_HOT) ? "hot" : "cold");
+            }
+            break;
+        case IR_JMP:
+        case IR_CASE:
+            fprintf(fp, " %s", func->labels[insn->label].name);
+            break;
+        case IR_JTAB:
+            fprintf(fp, " %s, ", func->labels[insn->label].name);
+            ir_dump_val(fp, &insn->a);
+            break;
+        case IR_BR:
+        case IR_BT:
+            fprintf(fp, " ");
+            ir_dump_val(fp, &insn->a);
+            fprintf(fp, ", ");
+            ir_dump_val(fp, &insn->b);
+            fprintf(fp, ", %s", func->labels[insn->label].name);
+            break;
+        case IR_DECJNZ:
+            fprintf(fp, " ");
+            ir_dump_val(fp, &insn->a);
+            fprintf(fp, ", %s", func->labels[insn->label].name);
+            break;
+        case IR_CALL:
+        case IR_TAIL:
+            fprintf(fp, " %s%s", insn->sym, (insn->flags & IR_F_EXTERN) ? " extern" : "");
+            break;
+        case IR_ASM:
+            fprintf(fp, " \"%s\"", insn->sym);
+            break;
+        case IR_STORE:
+            fprintf(fp, " [%s", insn->sym);
+            if (insn->off != 0) {
+                fprintf(fp, " + %zu", insn->off);
+            }
+
+            fprintf(fp, "], ");
+            ir_dump_val(fp, &insn->a);
+            break;
+        case IR_LOAD:
+            fprintf(fp, " [%s", insn->sym);
+            if (insn->off != 0) {
+                fprintf(fp, " + %zu", insn->off);
+            }
+
+            fprintf(fp, "]");
+            break;
+        case IR_PARAM:
+        case IR_RESULT:
+            fprintf(fp, " %zu", insn->off);
+            break;
+        case IR_ARG:
+            fprintf(fp, " %zu, ", insn->off);
+            ir_dump_val(fp, &insn->a);
+            break;
+        case IR_SETRET:
+            if (insn->off != 0) {
+                fprintf(fp, " %zu,", insn->off);
+            }
+            /* Fallthrough */
+        default:
+            if (insn->a.type != IR_VAL_NONE) {
+                fprintf(fp, " ");
+                ir_dump_val(fp, &insn->a);
+            }
+
+            if (insn->b.type != IR_VAL_NONE) {
+                fprintf(fp, ", ");
+                ir_dump_val(fp, &insn->b);
+            }
+            break;
+        }
+
+        fprintf(fp, "\n");
+    }
+
+    fprintf(fp, "}\n");
+}
+
+void
+ir_release(struct ir_func *func)
+{
+    if (func == NULL) {
+        return;
+    }
+
+    free(func->insns);
+    free(func->labels);
+    free(func->blocks);
+    memset(func, 0, sizeof(*func));
+}
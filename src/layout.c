@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/layout.h"
+#include "gup/state.h"
+#include "gup/trace.h"
+
+/* Type names for the layout dump */
+static const char *typetab[] = {
+    [GUP_TYPE_BAD] = "bad",
+    [GUP_TYPE_VOID] = "void",
+    [GUP_TYPE_U8] = "u8",
+    [GUP_TYPE_U16] = "u16",
+    [GUP_TYPE_U32] = "u32",
+    [GUP_TYPE_U64] = "u64"
+};
+
+int
+layout_struct(struct gup_state *state, struct symbol *sym, size_t align)
+{
+    struct layout *layout;
+    struct layout_field *field;
+    struct ast_node *cur;
+    size_t count = 0, off = 0, size, field_align;
+
+    if (state == NULL || sym == NULL || sym->tree == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    for (cur = sym->tree->right; cur != NULL; cur = cur->right) {
+        if (cur->str != NULL) {
+            ++count;
+        }
+    }
+
+    layout = ptrbox_alloc(
+        &state->ptrbox,
+        sizeof(*layout) + count * sizeof(*layout->fields)
+    );
+
+    if (layout == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    if (align == 0) {
+        align = 1;
+    }
+
+    layout->field_count = 0;
+    for (cur = sym->tree->right; cur != NULL; cur = cur->right) {
+        if (cur->str == NULL) {
+            continue;
+        }
+
+        /* Nested structs were laid out when they were defined */
+        if (cur->type == AST_OP_STRUCT) {
+            size = cur->symbol->layout->size;
+            field_align = cur->symbol->layout->align;
+        } else {
+            size = gup_type_size(cur->data_type);
+            field_align = size;
+        }
+
+        if (size == 0) {
+            trace_error(state, "field \"%s\" has no size\n", cur->str);
+            return -1;
+        }
+
+        /*
+         * A field with an alignment of its own gets the whole
+         * of its aligned slot, nothing else may share it.
+         */
+        if (cur->align > field_align) {
+            field_align = cur->align;
+            size = ALIGN_UP(size, field_align);
+        }
+
+        off = ALIGN_UP(off, field_align);
+        field = &layout->fields[layout->field_count++];
+        field->node = cur;
+        field->off = off;
+        field->size = size;
+
+        off += size;
+        if (field_align > align) {
+            align = field_align;
+        }
+    }
+
+    layout->align = align;
+    layout->size = ALIGN_UP(off, align);
+    sym->layout = layout;
+    return 0;
+}
+
+struct layout *
+layout_align(struct gup_state *state, const struct layout *layout, size_t align)
+{
+    struct layout *res;
+    size_t size;
+
+    if (state == NULL || layout == NULL) {
+        errno = -EINVAL;
+        return NULL;
+    }
+
+    size = sizeof(*layout) + layout->field_count * sizeof(*layout->fields);
+    if ((res = ptrbox_alloc(&state->ptrbox, size)) == NULL) {
+        errno = -ENOMEM;
+        return NULL;
+    }
+
+    memcpy(res, layout, size);
+    if (align > res->align) {
+        res->align = align;
+        res->size = ALIGN_UP(res->size, align);
+    }
+
+    return res;
+}
+
+const struct layout_field *
+layout_field(const struct layout *layout, const char *name)
+{
+    if (layout == NULL || name == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < layout->field_count; ++i) {
+        if (strcmp(layout->fields[i].node->str, name) == 0) {
+            return &layout->fields[i];
+        }
+    }
+
+    return NULL;
+}
+
+int
+layout_store(struct gup_state *state, struct symbol *sym, size_t off,
+    gup_type_t width, uint64_t v)
+{
+    size_t size = gup_type_size(width);
+
+    if (state == NULL || sym == NULL || sym->layout == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (size == 0 || off + size > sym->layout->size) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (sym->data == NULL) {
+        sym->data = ptrbox_alloc(&state->ptrbox, sym->layout->size);
+        if (sym->data == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        memset(sym->data, 0, sym->layout->size);
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+        sym->data[off + i] = (v >> (i * 8)) & 0xFF;
+    }
+
+    return 0;
+}
+
+void
+layout_dump(FILE *fp, const char *name, const struct layout *layout)
+{
+    const struct layout_field *field;
+    const char *type;
+    size_t off = 0, used;
+
+    if (fp == NULL || name == NULL || layout == NULL) {
+        return;
+    }
+
+    fprintf(fp, "struct %s: size %zu, align %zu\n", name, layout->size, layout->align);
+    for (size_t i = 0; i < layout->field_count; ++i) {
+        field = &layout->fields[i];
+        if (field->off > off) {
+            fprintf(fp, "    %-6zu %-10s %-16s [%zu]\n", off, "pad", "", field->off - off);
+        }
+
+        if (field->node->type == AST_OP_STRUCT) {
+            type = field->node->symbol->name;
+            used = field->node->symbol->layout->size;
+        } else {
+            type = typetab[field->node->data_type];
+            used = gup_type_size(field->node->data_type);
+        }
+
+        fprintf(fp, "    %-6zu %-10s %-16s [%zu]\n", field->off, type, field->node->str, used);
+        off = field->off + used;
+    }
+
+    if (layout->size > off) {
+        fprintf(fp, "    %-6zu %-10s %-16s [%zu]\n", off, "pad", "", layout->size - off);
+    }
+}
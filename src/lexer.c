@@ -123,11 +123,22 @@ lexer_scan_ident(struct gup_state *state, int lc, struct token *res)
     return 0;
 }
 
+/*
+ * Scan for a number in the source input, which must
+ * fit within 64 bits.
+ *
+ * @state: Compiler state
+ * @lc: Last character, the first digit
+ * @res: Token result
+ *
+ * Returns zero on success
+ */
 static int
 lexer_scan_digits(struct gup_state *state, int lc, struct token *res)
 {
     char buf[21];
     uint8_t buf_i = 0;
+    bool overflow = false;
     int c;
 
     if (state == NULL || res == NULL) {
@@ -152,15 +163,27 @@ lexer_scan_digits(struct gup_state *state, int lc, struct token *res)
             break;
         }
 
-        buf[buf_i++] = c;
+        /* Too many digits, still consume the rest of them */
         if (buf_i >= sizeof(buf) - 1) {
-            buf[buf_i] = '\0';
-            break;
+            overflow = true;
+            continue;
         }
+
+        buf[buf_i++] = c;
+    }
+
+    errno = 0;
+    res->v = strtoull(buf, NULL, 10);
+    if (overflow || errno == ERANGE) {
+        trace_error(
+            state, "number %s%s does not fit in 64 bits\n",
+            buf, overflow ? "..." : ""
+        );
+        errno = -ERANGE;
+        return -1;
     }
 
     res->type = TT_NUMBER;
-    res->v = atoi(buf);
     return 0;
 }
 
@@ -289,6 +312,16 @@ lexer_check_kw(struct gup_state *state, struct token *tok)
             return 0;
         }
 
+        if (strcmp(tok->s, "unroll") == 0) {
+            tok->type = TT_UNROLL;
+            return 0;
+        }
+
+        if (strcmp(tok->s, "unlikely") == 0) {
+            tok->type = TT_UNLIKELY;
+            return 0;
+        }
+
         break;
     case 'p':
         if (strcmp(tok->s, "pub") == 0) {
@@ -317,6 +350,18 @@ lexer_check_kw(struct gup_state *state, struct token *tok)
             return 0;
         }
 
+        if (strcmp(tok->s, "likely") == 0) {
+            tok->type = TT_LIKELY;
+            return 0;
+        }
+
+        break;
+    case 'm':
+        if (strcmp(tok->s, "match") == 0) {
+            tok->type = TT_MATCH;
+            return 0;
+        }
+
         break;
     case 'b':
         if (strcmp(tok->s, "break") == 0) {
@@ -324,6 +369,11 @@ lexer_check_kw(struct gup_state *state, struct token *tok)
             return 0;
         }
 
+        if (strcmp(tok->s, "become") == 0) {
+            tok->type = TT_BECOME;
+            return 0;
+        }
+
         break;
     case 'c':
         if (strcmp(tok->s, "continue") == 0) {
@@ -331,6 +381,61 @@ lexer_check_kw(struct gup_state *state, struct token *tok)
             return 0;
         }
 
+        if (strcmp(tok->s, "cacheline") == 0) {
+            tok->type = TT_CACHELINE;
+            return 0;
+        }
+
+        if (strcmp(tok->s, "cold") == 0) {
+            tok->type = TT_COLD;
+            return 0;
+        }
+
+        break;
+    case 'h':
+        if (strcmp(tok->s, "hot") == 0) {
+            tok->type = TT_HOT;
+            return 0;
+        }
+
+        break;
+    case 'i':
+        if (strcmp(tok->s, "inline") == 0) {
+            tok->type = TT_INLINE;
+            return 0;
+        }
+
+        if (strcmp(tok->s, "if") == 0) {
+            tok->type = TT_IF;
+            return 0;
+        }
+
+        break;
+    case 'n':
+        if (strcmp(tok->s, "noinline") == 0) {
+            tok->type = TT_NOINLINE;
+            return 0;
+        }
+
+        break;
+    case 'a':
+        if (strcmp(tok->s, "align") == 0) {
+            tok->type = TT_ALIGN;
+            return 0;
+        }
+
+        break;
+    case 'e':
+        if (strcmp(tok->s, "extern") == 0) {
+            tok->type = TT_EXTERN;
+            return 0;
+        }
+
+        if (strcmp(tok->s, "else") == 0) {
+            tok->type = TT_ELSE;
+            return 0;
+        }
+
         break;
     }
 
@@ -368,15 +473,33 @@ lexer_scan(struct gup_state *state, struct token *res)
         res->type = TT_STAR;
         res->c = c;
         return 0;
+    case '%':
+        res->type = TT_PERCENT;
+        res->c = c;
+        return 0;
     case '=':
         res->type = TT_EQUALS;
         res->c = c;
-        if ((c = lexer_nom(state, false)) != '=') {
+        if ((c = lexer_nom(state, false)) == '>') {
+            res->type = TT_ARROW;
+            return 0;
+        }
+
+        if (c != '=') {
             state->putback = c;
             return 0;
         }
         res->type = TT_EQUALITY;
         return 0;
+    case '!':
+        if ((c = lexer_nom(state, false)) != '=') {
+            trace_error(state, "expected '=' after '!'\n");
+            return -1;
+        }
+
+        res->type = TT_NEQ;
+        res->c = c;
+        return 0;
     case '<':
         res->type = TT_LT;
         res->c = c;
@@ -421,6 +544,23 @@ lexer_scan(struct gup_state *state, struct token *res)
         res->type = TT_DOT;
         res->c = c;
         return 0;
+    case ',':
+        res->type = TT_COMMA;
+        res->c = c;
+        return 0;
+    case ':':
+        res->type = TT_COLON;
+        res->c = c;
+        return 0;
+    case '\'':
+        /* A loop label, the name follows the quote */
+        if (lexer_scan_ident(state, lexer_nom(state, true), res) < 0) {
+            trace_error(state, "expected label name after quote\n");
+            return -1;
+        }
+
+        res->type = TT_LABEL;
+        return 0;
     default:
         /*
          * If we simply have a quote, it is assumed to be a
@@ -432,8 +572,8 @@ lexer_scan(struct gup_state *state, struct token *res)
         }
 
         /* Are these digits? */
-        if (lexer_scan_digits(state, c, res) == 0) {
-            return 0;
+        if (isdigit(c)) {
+            return lexer_scan_digits(state, c, res);
         }
 
         /* An identifier? */
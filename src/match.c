@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include "gup/match.h"
+#include "gup/trace.h"
+#include "gup/pass.h"
+
+/* Marks the default target in place of an arm */
+#define MATCH_DEFAULT ((size_t)-1)
+
+/* Dispatch names for the dump */
+static const char *kindtab[] = {
+    [MATCH_TREE] = "tree",
+    [MATCH_BITTEST] = "bittest",
+    [MATCH_TABLE] = "table"
+};
+
+/*
+ * Order cases by value for qsort()
+ */
+static int
+match_cmp(const void *a, const void *b)
+{
+    const struct gup_case *ca = a, *cb = b;
+
+    if (ca->value == cb->value) {
+        return 0;
+    }
+
+    return (ca->value < cb->value) ? -1 : 1;
+}
+
+/*
+ * Append a label, or an instruction referring to one,
+ * of a match.
+ *
+ * @state: Compiler state
+ * @insn: Instruction to append, its label is filled in
+ * @name: Label name
+ */
+static int
+match_label(struct gup_state *state, struct ir_insn *insn, const char *name)
+{
+    struct ir_func *ir = &state->cur_func->ir;
+    char *label;
+
+    if ((label = ptrbox_strdup(&state->ptrbox, name)) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    if ((insn->label = ir_label(ir, label)) == IR_LABEL_NONE) {
+        return -1;
+    }
+
+    return ir_append(ir, insn) < 0 ? -1 : 0;
+}
+
+/*
+ * Append an instruction that jumps to an arm of a match,
+ * or to its default.
+ *
+ * @state: Compiler state
+ * @match: Match being dispatched
+ * @insn: Instruction to append, its label is filled in
+ * @arm: Index of the arm [MATCH_DEFAULT for the default]
+ */
+static int
+match_branch(struct gup_state *state, const struct gup_match *match,
+    struct ir_insn *insn, size_t arm)
+{
+    char label[48];
+
+    if (arm != MATCH_DEFAULT) {
+        snprintf(label, sizeof(label), "L.%zu.c%zu", match->id, arm);
+    } else {
+        /* Without a default arm nothing is taken */
+        snprintf(label, sizeof(label), "L.%zu.%d", match->id, match->has_default ? 2 : 1);
+    }
+
+    return match_label(state, insn, label);
+}
+
+/*
+ * Returns the branches taken on the longest path through
+ * a compare tree over a number of values.
+ *
+ * @n: Number of values
+ */
+static size_t
+match_tree_cost(size_t n)
+{
+    if (n <= MATCH_TREE_LEAF) {
+        return n;
+    }
+
+    /* The upper half is never the smaller one */
+    return 1 + match_tree_cost(n - n / 2);
+}
+
+/*
+ * Compute the cost of each way of dispatching a match,
+ * SIZE_MAX where it cannot be used.
+ *
+ * @match: Match to cost, its cases are sorted
+ * @cost: Cost of each way is written here [MATCH_KIND_MAX entries]
+ */
+static void
+match_costs(const struct gup_match *match, size_t *cost)
+{
+    size_t n = match->case_count;
+    uint64_t span = 0;
+
+    if (n > 0) {
+        span = match->cases[n - 1].value - match->cases[0].value;
+    }
+
+    cost[MATCH_TREE] = match_tree_cost(n);
+    cost[MATCH_BITTEST] = SIZE_MAX;
+    cost[MATCH_TABLE] = SIZE_MAX;
+    if (n == 0) {
+        return;
+    }
+
+    /* A bound check, then a bit test per arm */
+    if (span < 64 && match->arm_count <= MATCH_BT_ARMS) {
+        cost[MATCH_BITTEST] = 1 + match->arm_count;
+    }
+
+    /* A bound check, then an indirect jump that predicts poorly */
+    if (n >= MATCH_TABLE_MIN && span < MATCH_TABLE_MAX &&
+        n * 100 >= (span + 1) * MATCH_TABLE_DENSITY) {
+        cost[MATCH_TABLE] = 3;
+    }
+}
+
+/*
+ * Choose the cheapest way of dispatching a match, ties
+ * go to the one that uses the fewest bytes.
+ *
+ * @cost: Cost of each way
+ */
+static match_kind_t
+match_choose(const size_t *cost)
+{
+    static const match_kind_t order[] = { MATCH_BITTEST, MATCH_TREE, MATCH_TABLE };
+    match_kind_t best = order[0];
+
+    for (size_t i = 1; i < MATCH_KIND_MAX; ++i) {
+        if (cost[order[i]] < cost[best]) {
+            best = order[i];
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Print how a match is dispatched
+ *
+ * @state: Compiler state
+ * @match: Match being dispatched
+ * @cost: Cost of each way
+ * @kind: Way chosen
+ */
+static void
+match_dump(struct gup_state *state, const struct gup_match *match, const size_t *cost,
+    match_kind_t kind)
+{
+    size_t n = match->case_count;
+
+    printf("match L.%zu in %s: %zu values, %zu arms", match->id,
+        state->cur_func->symbol->name, n, match->arm_count);
+    if (n > 0) {
+        printf(
+            ", %llu..%llu",
+            (unsigned long long)match->cases[0].value,
+            (unsigned long long)match->cases[n - 1].value
+        );
+    }
+
+    printf("%s\n", match->has_default ? ", default" : "");
+    for (size_t i = 0; i < MATCH_KIND_MAX; ++i) {
+        if (cost[i] == SIZE_MAX) {
+            printf("    %-8s -\n", kindtab[i]);
+        } else {
+            printf("    %-8s %zu%s\n", kindtab[i], cost[i], (i == kind) ? " [chosen]" : "");
+        }
+    }
+}
+
+/*
+ * Compare the subject against each value in turn, or
+ * split the values on the middle one and recurse.
+ *
+ * @state: Compiler state
+ * @match: Match being dispatched
+ * @cases: Values to dispatch, sorted
+ * @n: Number of values
+ * @split: Number of splits so far, names their labels
+ */
+static int
+match_tree(struct gup_state *state, const struct gup_match *match,
+    const struct gup_case *cases, size_t n, size_t *split)
+{
+    struct ir_insn insn = { .op = IR_BR, .width = GUP_TYPE_U64, .flags = IR_COND_EQ };
+    size_t mid = n / 2;
+    char label[48];
+
+    insn.a = match->subject;
+    insn.b.type = IR_VAL_IMM;
+    if (n <= MATCH_TREE_LEAF) {
+        for (size_t i = 0; i < n; ++i) {
+            insn.b.imm = cases[i].value;
+            if (match_branch(state, match, &insn, cases[i].arm) < 0) {
+                return -1;
+            }
+        }
+
+        insn = (struct ir_insn){ .op = IR_JMP };
+        return match_branch(state, match, &insn, MATCH_DEFAULT);
+    }
+
+    snprintf(label, sizeof(label), "L.%zu.s%zu", match->id, (*split)++);
+    insn.flags = IR_COND_GE;
+    insn.b.imm = cases[mid].value;
+    if (match_label(state, &insn, label) < 0) {
+        return -1;
+    }
+
+    if (match_tree(state, match, cases, mid, split) < 0) {
+        return -1;
+    }
+
+    insn = (struct ir_insn){ .op = IR_LABEL };
+    if (match_label(state, &insn, label) < 0) {
+        return -1;
+    }
+
+    return match_tree(state, match, &cases[mid], n - mid, split);
+}
+
+/*
+ * Rebase the subject to the lowest value and send
+ * anything past the highest to the default.
+ *
+ * @state: Compiler state
+ * @match: Match being dispatched
+ * @copy: Set if the index must not share the subject
+ * @res: Index is written here
+ */
+static int
+match_index(struct gup_state *state, const struct gup_match *match, bool copy,
+    struct ir_val *res)
+{
+    struct ir_func *ir = &state->cur_func->ir;
+    struct ir_insn insn = { .op = IR_SUB, .width = GUP_TYPE_U64 };
+    uint64_t lo = match->cases[0].value;
+    uint64_t hi = match->cases[match->case_count - 1].value;
+
+    *res = match->subject;
+    if (lo != 0 || copy) {
+        /* Values below the lowest wrap around past the highest */
+        insn.a = match->subject;
+        if (lo != 0) {
+            insn.b.type = IR_VAL_IMM;
+            insn.b.imm = lo;
+        } else {
+            insn.op = IR_MOV;
+        }
+
+        if ((insn.dst = ir_vreg_new(ir)) == IR_VREG_NONE) {
+            return -1;
+        }
+
+        if (ir_append(ir, &insn) < 0) {
+            return -1;
+        }
+
+        res->type = IR_VAL_VREG;
+        res->vreg = insn.dst;
+    }
+
+    insn = (struct ir_insn){ .op = IR_BR, .width = GUP_TYPE_U64, .flags = IR_COND_GT };
+    insn.a = *res;
+    insn.b.type = IR_VAL_IMM;
+    insn.b.imm = hi - lo;
+    return match_branch(state, match, &insn, MATCH_DEFAULT);
+}
+
+/*
+ * Test the bit of the rebased subject in a mask of the
+ * values of each arm.
+ *
+ * @state: Compiler state
+ * @match: Match being dispatched
+ */
+static int
+match_bittest(struct gup_state *state, const struct gup_match *match)
+{
+    struct ir_insn insn = { .op = IR_BT, .width = GUP_TYPE_U64 };
+    uint64_t lo = match->cases[0].value;
+    struct ir_val idx;
+
+    if (match_index(state, match, false, &idx) < 0) {
+        return -1;
+    }
+
+    insn.a = idx;
+    insn.b.type = IR_VAL_IMM;
+    for (size_t arm = 0; arm < match->arm_count; ++arm) {
+        insn.b.imm = 0;
+        for (size_t i = 0; i < match->case_count; ++i) {
+            if (match->cases[i].arm == arm) {
+                insn.b.imm |= (uint64_t)1 << (match->cases[i].value - lo);
+            }
+        }
+
+        if (match_branch(state, match, &insn, arm) < 0) {
+            return -1;
+        }
+    }
+
+    insn = (struct ir_insn){ .op = IR_JMP };
+    return match_branch(state, match, &insn, MATCH_DEFAULT);
+}
+
+/*
+ * Jump through a table with an entry for every value
+ * from the lowest to the highest, the gaps go to the
+ * default.
+ *
+ * @state: Compiler state
+ * @match: Match being dispatched
+ */
+static int
+match_table(struct gup_state *state, const struct gup_match *match)
+{
+    struct ir_insn insn = { .op = IR_JTAB, .width = GUP_TYPE_U64 };
+    uint64_t v = match->cases[0].value;
+    struct ir_val idx;
+    char label[48];
+
+    /* The jump clobbers its index */
+    if (match_index(state, match, true, &idx) < 0) {
+        return -1;
+    }
+
+    snprintf(label, sizeof(label), "L.%zu.3", match->id);
+    insn.a = idx;
+    insn.dst = idx.vreg;
+    if (match_label(state, &insn, label) < 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < match->case_count; ++v) {
+        insn = (struct ir_insn){ .op = IR_CASE };
+        if (match->cases[i].value == v) {
+            if (match_branch(state, match, &insn, match->cases[i++].arm) < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        if (match_branch(state, match, &insn, MATCH_DEFAULT) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+match_dispatch(struct gup_state *state, struct gup_match *match)
+{
+    struct ir_insn insn = { .op = IR_JMP };
+    size_t cost[MATCH_KIND_MAX], split = 0;
+    match_kind_t kind;
+
+    if (state == NULL || match == NULL || state->cur_func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    qsort(match->cases, match->case_count, sizeof(*match->cases), match_cmp);
+
+    /* A constant subject goes straight to its arm */
+    if (match->subject.type == IR_VAL_IMM) {
+        for (size_t i = 0; i < match->case_count; ++i) {
+            if (match->cases[i].value == match->subject.imm) {
+                return match_branch(state, match, &insn, match->cases[i].arm);
+            }
+        }
+
+        return match_branch(state, match, &insn, MATCH_DEFAULT);
+    }
+
+    match_costs(match, cost);
+    kind = match_choose(cost);
+    if (state->dump_flags & GUP_DUMP_MATCH) {
+        match_dump(state, match, cost, kind);
+    }
+
+    switch (kind) {
+    case MATCH_BITTEST:
+        pass_stat("match", "bit tests", 1);
+        return match_bittest(state, match);
+    case MATCH_TABLE:
+        pass_stat("match", "jump tables", 1);
+        return match_table(state, match);
+    default:
+        pass_stat("match", "compare trees", 1);
+        return match_tree(state, match, match->cases, match->case_count, &split);
+    }
+}
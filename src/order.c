@@ -0,0 +1,439 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/callgraph.h"
+#include "gup/layout.h"
+#include "gup/symbol.h"
+#include "gup/pass.h"
+
+/* Largest cluster of functions built, one page */
+#define ORDER_CLUSTER_MAX 4096
+
+/*
+ * Returns true if object @a should be placed before
+ * object @b within their section.
+ *
+ * @a: First object
+ * @b: Second object
+ */
+static bool
+order_before(const struct symbol *a, const struct symbol *b)
+{
+    if (a->is_hot != b->is_hot) {
+        return a->is_hot;
+    }
+
+    return a->layout->align > b->layout->align;
+}
+
+/*
+ * Returns the padding needed to place the objects of
+ * one section back to back in the given order.
+ *
+ * @objects: Objects in placement order
+ * @count: Number of objects
+ * @in_data: If true, count .data objects, otherwise .bss
+ */
+static size_t
+order_padding(struct symbol **objects, size_t count, bool in_data)
+{
+    const struct layout *layout;
+    size_t off = 0, used = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        if ((objects[i]->data != NULL) != in_data) {
+            continue;
+        }
+
+        layout = objects[i]->layout;
+        off = ALIGN_UP(off, layout->align) + layout->size;
+        used += layout->size;
+    }
+
+    return off - used;
+}
+
+/*
+ * Mark the objects that functions measured hot by the
+ * profile load from or store to as hot themselves.
+ *
+ * @state: Compiler state
+ * @unit: Unit to scan
+ *
+ * Returns the number of objects marked, or -1 on failure
+ */
+static ssize_t
+order_profile_hot(struct gup_state *state, struct gup_unit *unit)
+{
+    const struct ir_insn *insn;
+    const struct ir_func *ir;
+    struct symbol *obj;
+    struct callgraph cg;
+    ssize_t marked = 0;
+
+    if (callgraph_build(state, unit, &cg) < 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < cg.node_count; ++i) {
+        if (!callgraph_hot(&cg, i)) {
+            continue;
+        }
+
+        ir = &cg.nodes[i].func->ir;
+        for (size_t j = 0; j < ir->insn_count; ++j) {
+            insn = &ir->insns[j];
+            if (insn->op != IR_STORE && insn->op != IR_LOAD) {
+                continue;
+            }
+
+            for (size_t k = 0; k < unit->object_count; ++k) {
+                obj = unit->objects[k];
+                if (!obj->is_hot && strcmp(obj->name, insn->sym) == 0) {
+                    obj->is_hot = 1;
+                    ++marked;
+                }
+            }
+        }
+    }
+
+    callgraph_release(&cg);
+    return marked;
+}
+
+/*
+ * Order the objects of each section so that hot objects
+ * come first and padding between objects is minimal.
+ * Sizes are multiples of alignment, so placing stricter
+ * alignments first never needs padding between objects
+ * of the same temperature.
+ */
+int
+pass_data_order(struct gup_state *state, struct gup_func *func)
+{
+    struct gup_unit *unit = state->unit;
+    struct symbol *obj;
+    size_t before, after, hot = 0, j;
+    ssize_t measured;
+
+    /* With a profile, objects used by hot functions count as hot too */
+    if (state->profile != NULL && unit->func_count > 0) {
+        if ((measured = order_profile_hot(state, unit)) < 0) {
+            return -1;
+        }
+
+        pass_stat("data-order", "objects hot by profile", measured);
+    }
+
+    before = order_padding(unit->objects, unit->object_count, true) +
+        order_padding(unit->objects, unit->object_count, false);
+
+    /* Insertion sort, keeps source order among equals */
+    for (size_t i = 1; i < unit->object_count; ++i) {
+        obj = unit->objects[i];
+        for (j = i; j > 0 && order_before(obj, unit->objects[j - 1]); --j) {
+            unit->objects[j] = unit->objects[j - 1];
+        }
+
+        unit->objects[j] = obj;
+    }
+
+    for (size_t i = 0; i < unit->object_count; ++i) {
+        if (unit->objects[i]->is_hot) {
+            ++hot;
+        }
+    }
+
+    after = order_padding(unit->objects, unit->object_count, true) +
+        order_padding(unit->objects, unit->object_count, false);
+
+    pass_stat("data-order", "hot objects", hot);
+    pass_stat("data-order", "padding before [bytes]", before);
+    pass_stat("data-order", "padding after [bytes]", after);
+    pass_stat("data-order", "bytes saved", before > after ? before - after : 0);
+    return 0;
+}
+
+/*
+ * A cluster of functions that are placed together, the
+ * functions are chained through the next table of the
+ * group being ordered.
+ *
+ * @head: First node within the cluster
+ * @tail: Last node within the cluster
+ * @size: Estimated size in bytes
+ * @weight: Sum of the weights of the nodes
+ */
+struct order_cluster {
+    size_t head;
+    size_t tail;
+    size_t size;
+    uint64_t weight;
+};
+
+/*
+ * Returns the entry function of the unit, the function
+ * named by the entry option or else the first public one.
+ *
+ * @state: Compiler state
+ * @cg: Call graph of the unit
+ *
+ * Returns -1 if there is none
+ */
+static ssize_t
+order_entry(struct gup_state *state, const struct callgraph *cg)
+{
+    ssize_t entry;
+
+    if ((entry = callgraph_find(cg, state->entry)) >= 0) {
+        return entry;
+    }
+
+    for (size_t i = 0; i < cg->node_count; ++i) {
+        if (cg->nodes[i].func->symbol->is_pub) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Returns the heaviest caller of a node within the same
+ * group, or -1 if it has none.
+ *
+ * @cg: Call graph
+ * @callee: Node to find the caller of
+ */
+static ssize_t
+order_hot_caller(const struct callgraph *cg, size_t callee)
+{
+    const struct callgraph_node *node;
+    uint64_t best_weight = 0;
+    ssize_t best = -1;
+
+    for (size_t i = 0; i < cg->node_count; ++i) {
+        node = &cg->nodes[i];
+        if (i == callee || node->func->group != cg->nodes[callee].func->group) {
+            continue;
+        }
+
+        for (size_t j = 0; j < node->call_count; ++j) {
+            if (node->calls[j].callee != callee) {
+                continue;
+            }
+
+            if (node->calls[j].weight > best_weight) {
+                best_weight = node->calls[j].weight;
+                best = i;
+            }
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Returns true if cluster @a should be placed before
+ * cluster @b, denser clusters come first.
+ *
+ * @a: First cluster
+ * @b: Second cluster
+ */
+static bool
+order_denser(const struct order_cluster *a, const struct order_cluster *b)
+{
+    /* weight(a) / size(a) > weight(b) / size(b) */
+    return a->weight * (b->size + 1) > b->weight * (a->size + 1);
+}
+
+/*
+ * Order the functions of one group with call chain
+ * clustering. Hottest functions first, each function
+ * joins the end of the cluster of its heaviest caller,
+ * then the clusters are placed densest first.
+ *
+ * @cg: Call graph of the unit
+ * @first: Index of the first node of the group
+ * @count: Number of nodes within the group
+ * @entry: Node pinned first [-1 if none]
+ * @res: Order of the nodes is written here
+ *
+ * Returns the number of clusters
+ */
+static ssize_t
+order_group(struct callgraph *cg, size_t first, size_t count, ssize_t entry,
+    size_t *res)
+{
+    struct order_cluster *clusters, tmp;
+    size_t *owner, *next, *hot;
+    size_t i, j, n, c, f, nclusters = 0, nres = 0;
+    ssize_t caller;
+
+    clusters = calloc(count, sizeof(*clusters));
+    owner = calloc(count, sizeof(*owner));
+    next = calloc(count, sizeof(*next));
+    hot = calloc(count, sizeof(*hot));
+    if (clusters == NULL || owner == NULL || next == NULL || hot == NULL) {
+        free(clusters);
+        free(owner);
+        free(next);
+        free(hot);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /* Every function starts out in a cluster of its own */
+    for (i = 0; i < count; ++i) {
+        clusters[i].head = i;
+        clusters[i].tail = i;
+        clusters[i].size = cg->nodes[first + i].size;
+        clusters[i].weight = cg->nodes[first + i].weight;
+        owner[i] = i;
+        next[i] = count;
+        hot[i] = i;
+    }
+
+    /* Hottest functions first, keeping source order among equals */
+    for (i = 1; i < count; ++i) {
+        n = hot[i];
+        for (j = i; j > 0 && cg->nodes[first + n].weight >
+            cg->nodes[first + hot[j - 1]].weight; --j) {
+            hot[j] = hot[j - 1];
+        }
+
+        hot[j] = n;
+    }
+
+    for (i = 0; i < count; ++i) {
+        n = hot[i];
+        if (cg->nodes[first + n].weight == 0) {
+            break;
+        }
+
+        if ((caller = order_hot_caller(cg, first + n)) < 0) {
+            continue;
+        }
+
+        c = owner[caller - first];
+        f = owner[n];
+        if (c == f || clusters[f].head != n) {
+            continue;
+        }
+
+        if (clusters[c].size + clusters[f].size > ORDER_CLUSTER_MAX) {
+            continue;
+        }
+
+        for (j = clusters[f].head; j < count; j = next[j]) {
+            owner[j] = c;
+        }
+
+        next[clusters[c].tail] = clusters[f].head;
+        clusters[c].tail = clusters[f].tail;
+        clusters[c].size += clusters[f].size;
+        clusters[c].weight += clusters[f].weight;
+    }
+
+    /* Keep the clusters that are left, in source order */
+    for (i = 0; i < count; ++i) {
+        if (owner[clusters[i].head] == i) {
+            clusters[nclusters++] = clusters[i];
+        }
+    }
+
+    for (i = 1; i < nclusters; ++i) {
+        tmp = clusters[i];
+        for (j = i; j > 0 && order_denser(&tmp, &clusters[j - 1]); --j) {
+            clusters[j] = clusters[j - 1];
+        }
+
+        clusters[j] = tmp;
+    }
+
+    if (entry >= (ssize_t)first && entry < (ssize_t)(first + count)) {
+        res[nres++] = entry;
+    }
+
+    for (i = 0; i < nclusters; ++i) {
+        for (j = clusters[i].head; j < count; j = next[j]) {
+            if (first + j != (size_t)entry) {
+                res[nres++] = first + j;
+            }
+        }
+    }
+
+    free(clusters);
+    free(owner);
+    free(next);
+    free(hot);
+    return nclusters;
+}
+
+int
+pass_func_order(struct gup_state *state, struct gup_func *func)
+{
+    struct gup_unit *unit = state->unit;
+    struct gup_func **funcs;
+    struct callgraph cg;
+    size_t *order, first, count, moved = 0;
+    ssize_t entry, clusters;
+    int error = -1;
+
+    if (unit->func_count < 2) {
+        return 0;
+    }
+
+    if (callgraph_build(state, unit, &cg) < 0) {
+        return -1;
+    }
+
+    order = calloc(unit->func_count, sizeof(*order));
+    funcs = calloc(unit->func_count, sizeof(*funcs));
+    if (order == NULL || funcs == NULL) {
+        errno = -ENOMEM;
+        goto done;
+    }
+
+    entry = order_entry(state, &cg);
+    for (first = 0; first < cg.node_count; first += count) {
+        count = 1;
+        while (first + count < cg.node_count &&
+            cg.nodes[first + count].func->group == cg.nodes[first].func->group) {
+            ++count;
+        }
+
+        clusters = order_group(&cg, first, count, entry, &order[first]);
+        if (clusters < 0) {
+            goto done;
+        }
+
+        pass_stat("func-order", "clusters", clusters);
+    }
+
+    for (size_t i = 0; i < cg.node_count; ++i) {
+        pass_stat("func-order", "call edges", cg.nodes[i].call_count);
+        funcs[i] = cg.nodes[order[i]].func;
+        if (order[i] != i) {
+            ++moved;
+        }
+    }
+
+    memcpy(unit->funcs, funcs, unit->func_count * sizeof(*funcs));
+    pass_stat("func-order", "functions moved", moved);
+    error = 0;
+done:
+    free(order);
+    free(funcs);
+    callgraph_release(&cg);
+    return error;
+}
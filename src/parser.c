@@ -4,15 +4,19 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include "gup/codegen.h"
+#include "gup/header.h"
 #include "gup/parser.h"
 #include "gup/lexer.h"
 #include "gup/parser.h"
 #include "gup/ptrbox.h"
 #include "gup/trace.h"
 #include "gup/types.h"
+#include "gup/layout.h"
 #include "gup/ast.h"
 
 /*
@@ -25,8 +29,10 @@ static const char *toktab[] = {
     [TT_MINUS]      = "MINUS",
     [TT_SLASH]      = "SLASH",
     [TT_STAR]       = "STAR",
+    [TT_PERCENT]    = "PERCENT",
     [TT_EQUALS]     = "EQUALS",
     [TT_EQUALITY]   = "EQUALITY",
+    [TT_NEQ]        = "NOT-EQUALS",
     [TT_LT]         = "LESS-THAN",
     [TT_LTE]        = "LESS-THAN-OR-EQUALS",
     [TT_GT]         = "GREATER-THAN",
@@ -52,7 +58,26 @@ static const char *toktab[] = {
     [TT_LOOP]       = "LOOP",
     [TT_BREAK]      = "BREAK",
     [TT_CONTINUE]   = "CONTINUE",
-    [TT_DOT]        = "DOT"
+    [TT_DOT]        = "DOT",
+    [TT_COMMA]      = "COMMA",
+    [TT_ALIGN]      = "ALIGN",
+    [TT_CACHELINE]  = "CACHELINE",
+    [TT_HOT]        = "HOT",
+    [TT_COLD]       = "COLD",
+    [TT_INLINE]     = "INLINE",
+    [TT_NOINLINE]   = "NOINLINE",
+    [TT_EXTERN]     = "EXTERN",
+    [TT_BECOME]     = "BECOME",
+    [TT_COLON]      = "COLON",
+    [TT_LABEL]      = "LABEL",
+    [TT_UNROLL]     = "UNROLL",
+    [TT_IF]         = "IF",
+    [TT_ELSE]       = "ELSE",
+    [TT_LIKELY]     = "LIKELY",
+    [TT_UNLIKELY]   = "UNLIKELY",
+    [TT_MATCH]      = "MATCH",
+    [TT_ARROW]      = "ARROW",
+    [TT_ARM]        = "ARM"
 };
 
 /*
@@ -104,14 +129,29 @@ scope_pop(struct gup_state *state)
     return tok;
 }
 
-static tt_t
-scope_top(struct gup_state *state)
+/*
+ * Returns true if the current statement is within a
+ * conditional, an arm of a match or a loop, where it
+ * may be skipped or left by a break.
+ *
+ * @state: Compiler state
+ */
+static bool
+scope_in_cond(struct gup_state *state)
 {
-    if (state->scope_depth == 0) {
-        return state->scope_stack[0];
+    for (size_t i = 0; i < state->scope_depth; ++i) {
+        switch (state->scope_stack[i]) {
+        case TT_IF:
+        case TT_ELSE:
+        case TT_ARM:
+        case TT_LOOP:
+            return true;
+        default:
+            break;
+        }
     }
 
-    return state->scope_stack[state->scope_depth - 1];
+    return false;
 }
 
 /*
@@ -152,14 +192,182 @@ parse_expect(struct gup_state *state, struct token *tok, tt_t what)
     return 0;
 }
 
+/*
+ * Parse the parameter list of a function into its
+ * signature, a parameter is a type followed by a name.
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_LPAREN], left at the closing RPAREN
+ * @symbol: Function symbol
+ */
+static int
+parse_params(struct gup_state *state, struct token *tok, struct symbol *symbol)
+{
+    struct symbol_param *param;
+    gup_type_t type;
+
+    for (;;) {
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        if (tok->type == TT_RPAREN && symbol->param_count == 0) {
+            return 0;
+        }
+
+        type = token_to_type(tok->type);
+        if (type == GUP_TYPE_BAD || type == GUP_TYPE_VOID) {
+            trace_error(state, "expected TYPE in parameter list, got %s\n", toktab[tok->type]);
+            return -1;
+        }
+
+        if (symbol->param_count >= SYMBOL_MAX_PARAMS) {
+            trace_error(state, "\"%s\" takes more than %d parameters\n",
+                symbol->name, SYMBOL_MAX_PARAMS);
+            return -1;
+        }
+
+        if (parse_expect(state, tok, TT_IDENT) < 0) {
+            return -1;
+        }
+
+        for (uint8_t i = 0; i < symbol->param_count; ++i) {
+            if (strcmp(symbol->params[i].name, tok->s) == 0) {
+                trace_error(state, "duplicate parameter \"%s\"\n", tok->s);
+                return -1;
+            }
+        }
+
+        param = &symbol->params[symbol->param_count++];
+        param->type = type;
+        if ((param->name = ptrbox_strdup(&state->ptrbox, tok->s)) == NULL) {
+            return -1;
+        }
+
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        if (tok->type == TT_RPAREN) {
+            return 0;
+        }
+
+        if (tok->type != TT_COMMA) {
+            trace_error(state, "expected COMMA or RPAREN, got %s\n", toktab[tok->type]);
+            return -1;
+        }
+    }
+}
+
+/*
+ * Parse the return type of a function, several values
+ * are returned as a parenthesized list of types.
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_GT]
+ * @symbol: Function symbol
+ */
+static int
+parse_ret_types(struct gup_state *state, struct token *tok, struct symbol *symbol)
+{
+    gup_type_t type;
+    bool list;
+
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "expected TYPE after '->'\n");
+        return -1;
+    }
+
+    list = tok->type == TT_LPAREN;
+    for (;;) {
+        if (list && lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        type = token_to_type(tok->type);
+        if (type == GUP_TYPE_BAD || (type == GUP_TYPE_VOID && list)) {
+            trace_error(state, "expected TYPE after '->', got %s\n", toktab[tok->type]);
+            return -1;
+        }
+
+        if (symbol->ret_count >= SYMBOL_MAX_RETS) {
+            trace_error(state, "\"%s\" returns more than %d values\n",
+                symbol->name, SYMBOL_MAX_RETS);
+            return -1;
+        }
+
+        if (type != GUP_TYPE_VOID) {
+            symbol->ret_types[symbol->ret_count++] = type;
+        }
+
+        if (!list) {
+            break;
+        }
+
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        if (tok->type == TT_RPAREN) {
+            break;
+        }
+
+        if (tok->type != TT_COMMA) {
+            trace_error(state, "expected COMMA or RPAREN, got %s\n", toktab[tok->type]);
+            return -1;
+        }
+    }
+
+    symbol->data_type = (symbol->ret_count > 0) ? symbol->ret_types[0] : GUP_TYPE_VOID;
+    return 0;
+}
+
+/*
+ * Returns true if two functions take and return the
+ * same types.
+ *
+ * @a: First function
+ * @b: Second function
+ */
+static bool
+parse_same_sig(const struct symbol *a, const struct symbol *b)
+{
+    if (a->param_count != b->param_count || a->ret_count != b->ret_count) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < a->param_count; ++i) {
+        if (a->params[i].type != b->params[i].type)
+            return false;
+    }
+
+    for (uint8_t i = 0; i < a->ret_count; ++i) {
+        if (a->ret_types[i] != b->ret_types[i])
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Parse a function declaration or definition
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_FN]
+ * @attr: TT_INLINE, TT_NOINLINE, TT_HOT, TT_COLD or TT_EXTERN if given before 'fn',
+ *        otherwise TT_FN
+ */
 static int
-parse_function(struct gup_state *state, struct token *tok)
+parse_function(struct gup_state *state, struct token *tok, tt_t attr)
 {
     struct ast_node *root;
     struct token *last_tok;
-    struct symbol *symbol;
+    struct symbol *symbol, *prev;
     symid_t sym_id;
-    gup_type_t type;
 
     if (parse_expect(state, tok, TT_IDENT) < 0) {
         return -1;
@@ -186,7 +394,35 @@ parse_function(struct gup_state *state, struct token *tok)
         symbol->is_pub = 1;
     }
 
-    if (parse_expect(state, tok, TT_MINUS) < 0) {
+    symbol->is_inline = attr == TT_INLINE;
+    symbol->is_noinline = attr == TT_NOINLINE;
+    symbol->is_hot = attr == TT_HOT;
+    symbol->is_cold = attr == TT_COLD;
+    symbol->is_extern = attr == TT_EXTERN;
+    if (symbol->is_extern && symbol->is_pub) {
+        trace_error(state, "extern function \"%s\" cannot be pub\n", symbol->name);
+        return -1;
+    }
+
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "unexpected end of file\n");
+        return -1;
+    }
+
+    /* The parameter list is optional when there are none */
+    if (tok->type == TT_LPAREN) {
+        if (parse_params(state, tok, symbol) < 0) {
+            return -1;
+        }
+
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+    }
+
+    if (tok->type != TT_MINUS) {
+        trace_error(state, "expected MINUS, got %s instead\n", toktab[tok->type]);
         return -1;
     }
 
@@ -194,18 +430,19 @@ parse_function(struct gup_state *state, struct token *tok)
         return -1;
     }
 
-    if (lexer_scan(state, tok) < 0) {
-        trace_error(state, "expected TYPE after '->'\n");
+    if (parse_ret_types(state, tok, symbol) < 0) {
         return -1;
     }
 
-    type = token_to_type(tok->type);
-    if (type == GUP_TYPE_BAD) {
-        trace_error(
-            state,
-            "expected TYPE after '->', got %s\n",
-            toktab[tok->type]
-        );
+    /* Calls go through the first declaration, it must agree */
+    prev = symbol_from_name(&state->g_symtab, symbol->name);
+    if (prev != symbol && prev->type == SYMBOL_TYPE_FUNC && !parse_same_sig(prev, symbol)) {
+        trace_error(state, "conflicting signature for \"%s\"\n", symbol->name);
+        return -1;
+    }
+
+    if (prev != symbol && prev->type == SYMBOL_TYPE_FUNC && prev->is_extern != symbol->is_extern) {
+        trace_error(state, "conflicting extern for \"%s\"\n", symbol->name);
         return -1;
     }
 
@@ -221,6 +458,11 @@ parse_function(struct gup_state *state, struct token *tok)
     case TT_SEMI:
         return 0;
     case TT_LBRACE:
+        if (symbol->is_extern) {
+            trace_error(state, "extern function \"%s\" cannot have a body\n", symbol->name);
+            return -1;
+        }
+
         state->this_func = symbol;
         if (scope_push(state, TT_FN) < 0) {
             return -1;
@@ -231,7 +473,6 @@ parse_function(struct gup_state *state, struct token *tok)
         return -1;
     }
 
-    symbol->data_type = type;
     if (ast_node_alloc(state, AST_OP_FUNC, &root) < 0) {
         trace_error(state, "failed to allocate ast node for function\n");
         return -1;
@@ -276,102 +517,743 @@ parse_asm(struct gup_state *state, struct token *tok)
     return 0;
 }
 
+/*
+ * Parse a field access path following the DOT after an
+ * instance name, every field becomes an AST_OP_VAR node
+ * chained through its left leaf.
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_DOT], the token after the path is left here
+ * @res: First field of the path is written here
+ */
 static int
-parse_return(struct gup_state *state, struct token *tok)
+parse_field_path(struct gup_state *state, struct token *tok, struct ast_node **res)
 {
-    struct ast_node *root;
+    struct ast_node **cur = res;
 
-    if (state == NULL || tok == NULL) {
-        return -EINVAL;
+    for (;;) {
+        if (parse_expect(state, tok, TT_IDENT) < 0) {
+            return -1;
+        }
+
+        if (ast_node_alloc(state, AST_OP_VAR, cur) < 0) {
+            return -1;
+        }
+
+        (*cur)->str = ptrbox_strdup(&state->ptrbox, tok->s);
+        if ((*cur)->str == NULL) {
+            return -1;
+        }
+
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        /* Should we keep grabbing fields? */
+        if (tok->type != TT_DOT) {
+            break;
+        }
+
+        cur = &(*cur)->left;
     }
 
-    /* TODO: Parse a binary expression */
-    if (parse_expect(state, tok, TT_NUMBER) < 0) {
-        return -1;
+    return 0;
+}
+
+/*
+ * Returns the precedence of a binary operator, or zero
+ * if the token is not one.
+ *
+ * @type: Token type
+ * @op: AST operation is written here
+ */
+static int
+parse_binop(tt_t type, ast_op_t *op)
+{
+    switch (type) {
+    case TT_EQUALITY:
+        *op = AST_OP_EQ;
+        return 1;
+    case TT_NEQ:
+        *op = AST_OP_NE;
+        return 1;
+    case TT_LT:
+        *op = AST_OP_LT;
+        return 2;
+    case TT_LTE:
+        *op = AST_OP_LTE;
+        return 2;
+    case TT_GT:
+        *op = AST_OP_GT;
+        return 2;
+    case TT_GTE:
+        *op = AST_OP_GTE;
+        return 2;
+    case TT_PLUS:
+        *op = AST_OP_ADD;
+        return 3;
+    case TT_MINUS:
+        *op = AST_OP_SUB;
+        return 3;
+    case TT_STAR:
+        *op = AST_OP_MUL;
+        return 4;
+    case TT_SLASH:
+        *op = AST_OP_DIV;
+        return 4;
+    case TT_PERCENT:
+        *op = AST_OP_MOD;
+        return 4;
+    default:
+        return 0;
     }
+}
 
-    /* Allocate an ASM block AST node */
-    if (ast_node_alloc(state, AST_OP_RETIMM, &root) < 0) {
-        trace_error(state, "failed to allocate ast node for function\n");
+static int parse_expr(struct gup_state *state, struct token *tok, int prec,
+    struct ast_node **res);
+
+/*
+ * Returns the index of a parameter of the function being
+ * parsed, or -1 if it has none by that name.
+ *
+ * @state: Compiler state
+ * @name: Name to look up
+ */
+static int
+parse_param(struct gup_state *state, const char *name)
+{
+    struct symbol *func = state->this_func;
+
+    if (func == NULL) {
         return -1;
     }
 
-    root->v = tok->v;
-    cg_compile_node(state, root);
-    if (parse_expect(state, tok, TT_SEMI) < 0) {
-        return -1;
+    for (uint8_t i = 0; i < func->param_count; ++i) {
+        if (strcmp(func->params[i].name, name) == 0)
+            return i;
     }
-    return 0;
+
+    return -1;
 }
 
+/*
+ * Parse the arguments of a call, every argument becomes
+ * an AST_OP_ARG node chained through its right leaf.
+ *
+ * @state: Compiler state
+ * @symbol: Function being called
+ * @tok: Last token [TT_LPAREN], left at the closing RPAREN
+ * @res: Call node is written here
+ */
 static int
-parse_struct(struct gup_state *state, struct token *tok)
+parse_call(struct gup_state *state, struct symbol *symbol, struct token *tok,
+    struct ast_node **res)
 {
-    struct symbol *symbol;
-    struct ast_node *sfield = NULL;
-    struct symbol *instance = NULL;
-    struct ast_node *root, *cur;
-    symid_t sym_id;
-    ast_op_t ast_op;
-    gup_type_t type;
-    char *struct_name;
-    char *instance_name = "none";
+    struct ast_node *root, **cur;
+    size_t argc = 0;
 
-    if (state == NULL || tok == NULL) {
-        return -EINVAL;
+    if (symbol->type != SYMBOL_TYPE_FUNC) {
+        trace_error(state, "\"%s\" is not a function\n", symbol->name);
+        return -1;
     }
 
-    if (parse_expect(state, tok, TT_IDENT) < 0) {
+    if (ast_node_alloc(state, AST_OP_CALL, &root) < 0) {
         return -1;
     }
 
-    struct_name = tok->s;
-
+    root->symbol = symbol;
+    cur = &root->right;
     if (lexer_scan(state, tok) < 0) {
         trace_error(state, "unexpected end of file\n");
         return -1;
     }
 
-    /*
-     * If this is an identifier, we are creating an instance
-     * of the struct.
-     */
-    if (tok->type == TT_IDENT) {
-        instance_name = tok->s;
-        if (lexer_scan(state, tok) < 0) {
-            trace_error(state, "unexpected end of file\n");
+    while (tok->type != TT_RPAREN) {
+        if (argc > 0 && tok->type != TT_COMMA) {
+            trace_error(state, "expected COMMA or RPAREN, got %s\n", toktab[tok->type]);
             return -1;
         }
-    }
 
-    switch (tok->type) {
-    case TT_SEMI:
-        symbol = symbol_from_name(&state->g_symtab, struct_name);
-        if (symbol == NULL) {
+        if (argc > 0 && lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
             return -1;
         }
 
-        if (ast_node_alloc(state, AST_OP_STRUCT, &root) < 0){
+        if (ast_node_alloc(state, AST_OP_ARG, cur) < 0) {
             return -1;
         }
 
-        /* Create a symbol for the instance */
-        sym_id = symbol_new(
-            &state->g_symtab,
-            instance_name,
-            SYMBOL_TYPE_STRUCT,
-            NULL
-        );
-
-        if (sym_id < 0) {
+        if (parse_expr(state, tok, 1, &(*cur)->left) < 0) {
             return -1;
         }
 
-        root->right = symbol->tree;
-        root->str = instance_name;
-        cg_compile_node(state, root);
-        return 0;
-    case TT_LBRACE:
+        cur = &(*cur)->right;
+        ++argc;
+    }
+
+    if (argc != symbol->param_count) {
+        trace_error(
+            state,
+            "\"%s\" takes %u arguments, got %zu\n",
+            symbol->name,
+            symbol->param_count,
+            argc
+        );
+        return -1;
+    }
+
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse a number, a parameter, a call, a field of an
+ * instance, a negation or a parenthesized expression.
+ *
+ * @state: Compiler state
+ * @tok: Current token, the token after the operand is left here
+ * @res: Operand is written here
+ */
+static int
+parse_operand(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root;
+    struct symbol *symbol;
+    int param;
+
+    switch (tok->type) {
+    case TT_NUMBER:
+        if (ast_node_alloc(state, AST_OP_NUMBER, &root) < 0) {
+            return -1;
+        }
+
+        root->v = tok->v;
+        break;
+    case TT_LPAREN:
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        if (parse_expr(state, tok, 1, &root) < 0) {
+            return -1;
+        }
+
+        if (tok->type != TT_RPAREN) {
+            trace_error(state, "expected RPAREN, got %s\n", toktab[tok->type]);
+            return -1;
+        }
+        break;
+    case TT_MINUS:
+        /* Negation wraps, -x is 0 - x */
+        if (ast_node_alloc(state, AST_OP_SUB, &root) < 0) {
+            return -1;
+        }
+
+        if (ast_node_alloc(state, AST_OP_NUMBER, &root->left) < 0) {
+            return -1;
+        }
+
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        root->left->v = 0;
+        if (parse_operand(state, tok, &root->right) < 0) {
+            return -1;
+        }
+
+        *res = root;
+        return 0;
+    case TT_IDENT:
+        /* Parameters hide symbols of the same name */
+        if ((param = parse_param(state, tok->s)) >= 0) {
+            if (ast_node_alloc(state, AST_OP_PARAM, &root) < 0) {
+                return -1;
+            }
+
+            root->v = param;
+            break;
+        }
+
+        symbol = symbol_from_name(&state->g_symtab, tok->s);
+        if (symbol != NULL && symbol->type == SYMBOL_TYPE_FUNC) {
+            if (parse_expect(state, tok, TT_LPAREN) < 0) {
+                return -1;
+            }
+
+            if (parse_call(state, symbol, tok, &root) < 0) {
+                return -1;
+            }
+
+            if (symbol->ret_count != 1) {
+                trace_error(state, "\"%s\" does not return a single value\n", symbol->name);
+                return -1;
+            }
+            break;
+        }
+
+        if (symbol == NULL || symbol->type != SYMBOL_TYPE_INSTANCE) {
+            trace_error(state, "\"%s\" is not a struct instance\n", tok->s);
+            return -1;
+        }
+
+        if (parse_expect(state, tok, TT_DOT) < 0) {
+            return -1;
+        }
+
+        if (ast_node_alloc(state, AST_OP_FIELD, &root) < 0) {
+            return -1;
+        }
+
+        root->symbol = symbol;
+        if (parse_field_path(state, tok, &root->left) < 0) {
+            return -1;
+        }
+
+        *res = root;
+        return 0;
+    default:
+        trace_error(state, "expected expression, got %s\n", toktab[tok->type]);
+        return -1;
+    }
+
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "unexpected end of file\n");
+        return -1;
+    }
+
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse an expression by precedence climbing, operators
+ * of the same precedence group to the left.
+ *
+ * @state: Compiler state
+ * @tok: Current token, the token after the expression is left here
+ * @prec: Lowest precedence of operator to take
+ * @res: Expression is written here
+ */
+static int
+parse_expr(struct gup_state *state, struct token *tok, int prec,
+    struct ast_node **res)
+{
+    struct ast_node *lhs, *root;
+    ast_op_t op;
+    int op_prec;
+
+    if (parse_operand(state, tok, &lhs) < 0) {
+        return -1;
+    }
+
+    while ((op_prec = parse_binop(tok->type, &op)) >= prec && op_prec > 0) {
+        if (ast_node_alloc(state, op, &root) < 0) {
+            return -1;
+        }
+
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        root->left = lhs;
+        if (parse_expr(state, tok, op_prec + 1, &root->right) < 0) {
+            return -1;
+        }
+
+        lhs = root;
+    }
+
+    *res = lhs;
+    return 0;
+}
+
+static int
+parse_return(struct gup_state *state, struct token *tok)
+{
+    struct ast_node *root, *expr, *second;
+    struct symbol *func;
+
+    if (state == NULL || tok == NULL) {
+        return -EINVAL;
+    }
+
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "unexpected end of file\n");
+        return -1;
+    }
+
+    if (parse_expr(state, tok, 1, &expr) < 0) {
+        return -1;
+    }
+
+    /* A second value lands in the second return register */
+    second = NULL;
+    if (tok->type == TT_COMMA) {
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        if (parse_expr(state, tok, 1, &second) < 0) {
+            return -1;
+        }
+    }
+
+    if (tok->type != TT_SEMI) {
+        trace_error(state, "expected SEMICOLON, got %s instead\n", toktab[tok->type]);
+        return -1;
+    }
+
+    func = state->this_func;
+    if (func != NULL && func->ret_count == 0) {
+        trace_error(state, "\"%s\" returns void\n", func->name);
+        return -1;
+    }
+
+    if (func != NULL && (second != NULL) != (func->ret_count == SYMBOL_MAX_RETS)) {
+        trace_error(state, "\"%s\" returns %u values\n", func->name, func->ret_count);
+        return -1;
+    }
+
+    /* Bare numbers need no expression, they still wrap at the return width */
+    if (expr->type == AST_OP_NUMBER && second == NULL) {
+        if (ast_node_alloc(state, AST_OP_RETIMM, &root) < 0) {
+            trace_error(state, "failed to allocate ast node for function\n");
+            return -1;
+        }
+
+        root->v = expr->v;
+    } else {
+        if (ast_node_alloc(state, AST_OP_RETVAL, &root) < 0) {
+            trace_error(state, "failed to allocate ast node for function\n");
+            return -1;
+        }
+
+        root->right = expr;
+        root->left = second;
+    }
+
+    return cg_compile_node(state, root);
+}
+
+/*
+ * Parse the field an assignment is made to, the value
+ * of the assignment is left for the caller.
+ *
+ * @state: Compiler state
+ * @parent: Instance being assigned to
+ * @tok: Last token [TT_DOT], the token after the field is left here
+ * @res: Assignment node is written here
+ */
+static int
+parse_field_target(struct gup_state *state, struct symbol *parent,
+    struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root, *cur;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (parent->type != SYMBOL_TYPE_INSTANCE) {
+        trace_error(state, "\"%s\" is not a struct instance\n", parent->name);
+        return -1;
+    }
+
+    if (ast_node_alloc(state, AST_OP_ASSIGN, &root) < 0) {
+        return -1;
+    }
+
+    root->symbol = parent;
+    if (ast_node_alloc(state, AST_OP_VAR, &root->left) < 0) {
+        return -1;
+    }
+
+    cur = root->left;
+    cur->str = ptrbox_strdup(&state->ptrbox, parent->name);
+    if (cur->str == NULL) {
+        return -1;
+    }
+
+    if (parse_field_path(state, tok, &cur->left) < 0) {
+        return -1;
+    }
+
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse an assignment to a field of a struct instance,
+ * the token following the instance name is a DOT.
+ *
+ * @state: Compiler state
+ * @parent: Instance being assigned to
+ * @tok: Last token
+ * @res: Assignment node is written here
+ */
+static int
+parse_field_assign(struct gup_state *state, struct symbol *parent,
+    struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root;
+
+    if (parse_field_target(state, parent, tok, &root) < 0) {
+        return -1;
+    }
+
+    if (tok->type != TT_EQUALS) {
+        trace_error(state, "expected EQUALS, got %s\n", toktab[tok->type]);
+        return -1;
+    }
+
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "unexpected end of file\n");
+        return -1;
+    }
+
+    if (parse_expr(state, tok, 1, &root->right) < 0) {
+        return -1;
+    }
+
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse the initializer of a struct instance
+ *
+ * { .field = <EXPR>, .nested.field = <EXPR>, ... };
+ *
+ * @state: Compiler state
+ * @instance: Instance being initialized
+ * @tok: Last token
+ */
+static int
+parse_initializer(struct gup_state *state, struct symbol *instance, struct token *tok)
+{
+    struct ast_node *root;
+
+    if (parse_expect(state, tok, TT_LBRACE) < 0) {
+        return -1;
+    }
+
+    for (;;) {
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        if (tok->type == TT_RBRACE) {
+            break;
+        }
+
+        if (tok->type != TT_DOT) {
+            trace_error(state, "expected DOT, got %s\n", toktab[tok->type]);
+            return -1;
+        }
+
+        if (parse_field_assign(state, instance, tok, &root) < 0) {
+            return -1;
+        }
+
+        /* Outside of a function this sets the initial value */
+        if (cg_compile_node(state, root) < 0) {
+            return -1;
+        }
+
+        if (tok->type == TT_RBRACE) {
+            break;
+        }
+
+        if (tok->type != TT_COMMA) {
+            trace_error(state, "expected COMMA, got %s\n", toktab[tok->type]);
+            return -1;
+        }
+    }
+
+    return parse_expect(state, tok, TT_SEMI);
+}
+
+/*
+ * Parse any attributes starting at the current token,
+ * the strictest alignment seen is kept.
+ *
+ * align(<NUMBER>) | cacheline | hot
+ *
+ * @state: Compiler state
+ * @tok: Current token, first token after the attributes on return
+ * @align: Alignment is written here [left alone if none]
+ * @hot: Set if marked hot [NULL if not allowed]
+ */
+static int
+parse_attrs(struct gup_state *state, struct token *tok, size_t *align, bool *hot)
+{
+    size_t v;
+
+    for (;;) {
+        switch (tok->type) {
+        case TT_ALIGN:
+            if (parse_expect(state, tok, TT_LPAREN) < 0)
+                return -1;
+            if (parse_expect(state, tok, TT_NUMBER) < 0)
+                return -1;
+
+            v = tok->v;
+            if (v == 0 || (v & (v - 1)) != 0) {
+                trace_error(state, "alignment %zu is not a power of two\n", v);
+                return -1;
+            }
+
+            if (parse_expect(state, tok, TT_RPAREN) < 0)
+                return -1;
+            break;
+        case TT_CACHELINE:
+            v = LAYOUT_CACHELINE;
+            break;
+        case TT_HOT:
+            if (hot == NULL) {
+                trace_error(state, "hot is not allowed here\n");
+                return -1;
+            }
+
+            v = 0;
+            *hot = true;
+            break;
+        default:
+            return 0;
+        }
+
+        if (v > *align) {
+            *align = v;
+        }
+
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+    }
+}
+
+/*
+ * Dump a layout if requested
+ *
+ * @state: Compiler state
+ * @name: Name to dump the layout under
+ * @layout: Layout to dump
+ */
+static inline void
+parse_dump_layout(struct gup_state *state, const char *name, const struct layout *layout)
+{
+    if (state->dump_flags & GUP_DUMP_LAYOUT) {
+        layout_dump(stdout, name, layout);
+    }
+}
+
+static int
+parse_struct(struct gup_state *state, struct token *tok)
+{
+    struct symbol *symbol;
+    struct ast_node *sfield = NULL;
+    struct symbol *instance = NULL;
+    struct ast_node *root, *cur;
+    symid_t sym_id;
+    ast_op_t ast_op;
+    gup_type_t type;
+    char *struct_name;
+    char *instance_name = "none";
+    size_t align = 0;
+    bool hot = false;
+
+    if (state == NULL || tok == NULL) {
+        return -EINVAL;
+    }
+
+    if (parse_expect(state, tok, TT_IDENT) < 0) {
+        return -1;
+    }
+
+    struct_name = tok->s;
+
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "unexpected end of file\n");
+        return -1;
+    }
+
+    if (parse_attrs(state, tok, &align, NULL) < 0) {
+        return -1;
+    }
+
+    /*
+     * If this is an identifier, we are creating an instance
+     * of the struct.
+     */
+    if (tok->type == TT_IDENT) {
+        instance_name = tok->s;
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        if (parse_attrs(state, tok, &align, &hot) < 0) {
+            return -1;
+        }
+    }
+
+    switch (tok->type) {
+    case TT_SEMI:
+    case TT_EQUALS:
+        symbol = symbol_from_name(&state->g_symtab, struct_name);
+        if (symbol == NULL) {
+            return -1;
+        }
+
+        if (symbol->type != SYMBOL_TYPE_STRUCT) {
+            trace_error(state, "\"%s\" is not a struct\n", struct_name);
+            return -1;
+        }
+
+        if (ast_node_alloc(state, AST_OP_STRUCT, &root) < 0){
+            return -1;
+        }
+
+        /* Create a symbol for the instance */
+        sym_id = symbol_new(
+            &state->g_symtab,
+            instance_name,
+            SYMBOL_TYPE_INSTANCE,
+            &instance
+        );
+
+        if (sym_id < 0) {
+            return -1;
+        }
+
+        instance->tree = symbol->tree;
+        instance->layout = symbol->layout;
+        instance->is_hot = hot;
+        if (align > symbol->layout->align) {
+            instance->layout = layout_align(state, symbol->layout, align);
+            if (instance->layout == NULL)
+                return -1;
+
+            parse_dump_layout(state, instance_name, instance->layout);
+        }
+
+        root->right = symbol->tree;
+        root->str = instance_name;
+        root->symbol = instance;
+        cg_compile_node(state, root);
+        if (tok->type == TT_EQUALS) {
+            return parse_initializer(state, instance, tok);
+        }
+        return 0;
+    case TT_LBRACE:
         if (scope_push(state, TT_STRUCT) < 0) {
             return -1;
         }
@@ -416,6 +1298,11 @@ parse_struct(struct gup_state *state, struct token *tok)
             if (instance == NULL)
                 return -1;
 
+            if (instance->type != SYMBOL_TYPE_STRUCT) {
+                trace_error(state, "\"%s\" is not a struct\n", tok->s);
+                return -1;
+            }
+
             sfield = instance->tree;
             break;
         default:
@@ -431,148 +1318,570 @@ parse_struct(struct gup_state *state, struct token *tok)
             break;
         }
 
-        if (ast_node_alloc(state, ast_op, &cur->right) < 0) {
+        if (ast_node_alloc(state, ast_op, &cur->right) < 0) {
+            return -1;
+        }
+
+        if (parse_expect(state, tok, TT_IDENT) < 0) {
+            return -1;
+        }
+
+        cur = cur->right;
+        cur->data_type = type;
+        cur->str = ptrbox_strdup(&state->ptrbox, tok->s);
+        cur->left = sfield;
+        cur->symbol = (ast_op == AST_OP_STRUCT) ? instance : NULL;
+
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        if (parse_attrs(state, tok, &cur->align, NULL) < 0) {
+            return -1;
+        }
+
+        if (tok->type != TT_SEMI) {
+            trace_error(state, "expected SEMICOLON, got %s instead\n", toktab[tok->type]);
+            return -1;
+        }
+    }
+
+    if (root != NULL) {
+        if (symbol != NULL)
+            symbol->tree = root;
+    }
+
+    if (layout_struct(state, symbol, align) < 0) {
+        return -1;
+    }
+
+    parse_dump_layout(state, struct_name, symbol->layout);
+    return 0;
+}
+
+/*
+ * Parse an end of scope
+ *
+ * @state: Compiler state
+ * @scope_tok: Token
+ */
+static int
+parse_endscope(struct gup_state *state, tt_t scope_tok)
+{
+    struct ast_node *root;
+
+    if (state == NULL) {
+        return -EINVAL;
+    }
+
+    switch (scope_tok) {
+    case TT_LOOP:
+        if (ast_node_alloc(state, AST_OP_LOOP, &root) < 0) {
+            trace_warn("[PARSER] retvoid failure\n");
+            return -1;
+        }
+
+        root->epilogue = 1;
+        cg_compile_node(state, root);
+        break;
+    case TT_ELSE:
+        if (ast_node_alloc(state, AST_OP_IF, &root) < 0) {
+            trace_warn("[PARSER] else end failure\n");
+            return -1;
+        }
+
+        root->epilogue = 1;
+        cg_compile_node(state, root);
+        break;
+    case TT_ARM:
+    case TT_MATCH:
+        if (ast_node_alloc(state, (scope_tok == TT_ARM) ? AST_OP_ARM : AST_OP_MATCH,
+            &root) < 0) {
+            trace_warn("[PARSER] match end failure\n");
+            return -1;
+        }
+
+        root->epilogue = 1;
+        cg_compile_node(state, root);
+        break;
+    default:
+        return -1;
+    }
+
+    return -1;
+}
+
+static int
+parse_func_call(struct gup_state *state, struct symbol *symbol, struct token *tok)
+{
+    struct ast_node *root;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (parse_call(state, symbol, tok, &root) < 0) {
+        return -1;
+    }
+
+    cg_compile_node(state, root);
+    return 0;
+}
+
+/*
+ * Parse a call that takes the place of returning, such
+ * as 'become f(x);'. The call is always made as a jump
+ * so it must return what this function returns.
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_BECOME]
+ */
+static int
+parse_become(struct gup_state *state, struct token *tok)
+{
+    struct ast_node *root, *call;
+    struct symbol *symbol;
+
+    if (state->this_func == NULL) {
+        trace_error(state, "unexpected 'become'\n");
+        return -1;
+    }
+
+    if (parse_expect(state, tok, TT_IDENT) < 0) {
+        return -1;
+    }
+
+    if ((symbol = symbol_from_name(&state->g_symtab, tok->s)) == NULL) {
+        trace_error(state, "implicit declaration of symbol \"%s\"\n", tok->s);
+        return -1;
+    }
+
+    if (parse_expect(state, tok, TT_LPAREN) < 0) {
+        return -1;
+    }
+
+    if (parse_call(state, symbol, tok, &call) < 0) {
+        return -1;
+    }
+
+    if (parse_expect(state, tok, TT_SEMI) < 0) {
+        return -1;
+    }
+
+    if (symbol->is_extern) {
+        trace_error(state, "cannot become extern function \"%s\"\n", symbol->name);
+        return -1;
+    }
+
+    if (!symbol_can_tail(state->this_func, symbol)) {
+        trace_error(
+            state,
+            "cannot become \"%s\", it does not return what \"%s\" does\n",
+            symbol->name, state->this_func->name
+        );
+        return -1;
+    }
+
+    if (ast_node_alloc(state, AST_OP_BECOME, &root) < 0) {
+        return -1;
+    }
+
+    root->right = call;
+    cg_compile_node(state, root);
+    return 0;
+}
+
+/*
+ * Parse an unroll hint, such as 'unroll(4)'
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_UNROLL], the token after the hint is left here
+ * @res: Unroll factor is written here
+ */
+static int
+parse_unroll(struct gup_state *state, struct token *tok, uint32_t *res)
+{
+    if (parse_expect(state, tok, TT_LPAREN) < 0) {
+        return -1;
+    }
+
+    if (parse_expect(state, tok, TT_NUMBER) < 0) {
+        return -1;
+    }
+
+    if (tok->v == 0 || tok->v > UINT32_MAX) {
+        trace_error(state, "bad unroll factor %zu\n", tok->v);
+        return -1;
+    }
+
+    *res = tok->v;
+    if (parse_expect(state, tok, TT_RPAREN) < 0) {
+        return -1;
+    }
+
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "got unexpected end of file, expected LBRACE\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Parse the opening of a loop, such as 'loop {' or
+ * '\'outer: loop {'. A loop may be given a number of
+ * iterations to run, along with an unroll hint, as in
+ * 'loop 16 unroll(4) {'.
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_LOOP]
+ * @label: Label of the loop [NULL if none]
+ */
+static int
+parse_loop(struct gup_state *state, struct token *tok, char *label)
+{
+    struct ast_node *root, *count = NULL;
+    uint32_t unroll = 0;
+
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "got unexpected end of file, expected LBRACE\n");
+        return -1;
+    }
+
+    if (tok->type != TT_LBRACE && parse_expr(state, tok, 1, &count) < 0) {
+        return -1;
+    }
+
+    if (count != NULL && tok->type == TT_UNROLL) {
+        if (parse_unroll(state, tok, &unroll) < 0) {
+            return -1;
+        }
+    }
+
+    if (tok->type != TT_LBRACE) {
+        trace_error(state, "expected LBRACE, got %s instead\n", toktab[tok->type]);
+        return -1;
+    }
+
+    if (scope_push(state, TT_LOOP) < 0) {
+        return -1;
+    }
+
+    if (ast_node_alloc(state, AST_OP_LOOP, &root) < 0) {
+        trace_error(state, "[PARSER] failed to allocate ast node\n");
+        return -1;
+    }
+
+    root->str = label;
+    root->right = count;
+    root->unroll = unroll;
+    return cg_compile_node(state, root);
+}
+
+static int begin_parse(struct gup_state *state, struct token *tok);
+
+/*
+ * Parse the condition of an arm of a conditional, with
+ * an optional hint ahead of it, such as 'unlikely x > 4',
+ * up to the opening brace of its block.
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_IF]
+ * @root: AST_OP_IF or AST_OP_ELSE node to fill in
+ */
+static int
+parse_cond(struct gup_state *state, struct token *tok, struct ast_node *root)
+{
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "got unexpected end of file, expected condition\n");
+        return -1;
+    }
+
+    root->v = AST_HINT_NONE;
+    if (tok->type == TT_LIKELY || tok->type == TT_UNLIKELY) {
+        root->v = (tok->type == TT_LIKELY) ? AST_HINT_LIKELY : AST_HINT_UNLIKELY;
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "got unexpected end of file, expected condition\n");
+            return -1;
+        }
+    }
+
+    if (parse_expr(state, tok, 1, &root->right) < 0) {
+        return -1;
+    }
+
+    if (tok->type != TT_LBRACE) {
+        trace_error(state, "expected LBRACE, got %s instead\n", toktab[tok->type]);
+        return -1;
+    }
+
+    return scope_push(state, TT_IF);
+}
+
+/*
+ * Parse the opening of a conditional, such as 'if x == 2 {'
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_IF]
+ */
+static int
+parse_if(struct gup_state *state, struct token *tok)
+{
+    struct ast_node *root;
+
+    if (ast_node_alloc(state, AST_OP_IF, &root) < 0) {
+        trace_error(state, "[PARSER] failed to allocate ast node\n");
+        return -1;
+    }
+
+    if (parse_cond(state, tok, root) < 0) {
+        return -1;
+    }
+
+    return cg_compile_node(state, root);
+}
+
+/*
+ * Parse what follows the closing brace of an arm of a
+ * conditional. An 'else' or 'else if' opens the next
+ * arm, anything else ends the conditional and is parsed
+ * as usual.
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_RBRACE]
+ */
+static int
+parse_endif(struct gup_state *state, struct token *tok)
+{
+    struct ast_node *root;
+    bool more;
+
+    more = lexer_scan(state, tok) == 0;
+    if (!more || tok->type != TT_ELSE) {
+        if (ast_node_alloc(state, AST_OP_IF, &root) < 0) {
+            trace_error(state, "[PARSER] failed to allocate ast node\n");
             return -1;
         }
 
-        if (parse_expect(state, tok, TT_IDENT) < 0) {
+        root->epilogue = 1;
+        if (cg_compile_node(state, root) < 0) {
             return -1;
         }
 
-        cur = cur->right;
-        cur->data_type = type;
-        cur->str = ptrbox_strdup(&state->ptrbox, tok->s);
-        cur->left = sfield;
+        return more ? begin_parse(state, tok) : 0;
+    }
 
-        if (parse_expect(state, tok, TT_SEMI) < 0) {
+    if (ast_node_alloc(state, AST_OP_ELSE, &root) < 0) {
+        trace_error(state, "[PARSER] failed to allocate ast node\n");
+        return -1;
+    }
+
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "got unexpected end of file, expected LBRACE\n");
+        return -1;
+    }
+
+    if (tok->type == TT_IF) {
+        if (parse_cond(state, tok, root) < 0) {
             return -1;
         }
+    } else if (tok->type != TT_LBRACE) {
+        trace_error(state, "expected LBRACE, got %s instead\n", toktab[tok->type]);
+        return -1;
+    } else if (scope_push(state, TT_ELSE) < 0) {
+        return -1;
     }
 
-    if (root != NULL) {
-        if (symbol != NULL)
-            symbol->tree = root;
-    }
-    return 0;
+    return cg_compile_node(state, root);
 }
 
 /*
- * Parse an end of scope
+ * Parse the opening of a match, such as 'match x & 7 {'
  *
  * @state: Compiler state
- * @scope_tok: Token
+ * @tok: Last token [TT_MATCH]
  */
 static int
-parse_endscope(struct gup_state *state, tt_t scope_tok)
+parse_match(struct gup_state *state, struct token *tok)
 {
     struct ast_node *root;
 
-    if (state == NULL) {
-        return -EINVAL;
+    if (ast_node_alloc(state, AST_OP_MATCH, &root) < 0) {
+        trace_error(state, "[PARSER] failed to allocate ast node\n");
+        return -1;
     }
 
-    switch (scope_tok) {
-    case TT_LOOP:
-        if (ast_node_alloc(state, AST_OP_LOOP, &root) < 0) {
-            trace_warn("[PARSER] retvoid failure\n");
-            return -1;
-        }
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "got unexpected end of file, expected expression\n");
+        return -1;
+    }
 
-        root->epilogue = 1;
-        cg_compile_node(state, root);
-        break;
-    default:
+    if (parse_expr(state, tok, 1, &root->right) < 0) {
         return -1;
     }
 
-    return -1;
+    if (tok->type != TT_LBRACE) {
+        trace_error(state, "expected LBRACE, got %s instead\n", toktab[tok->type]);
+        return -1;
+    }
+
+    if (scope_push(state, TT_MATCH) < 0) {
+        return -1;
+    }
+
+    return cg_compile_node(state, root);
 }
 
+/*
+ * Parse the opening of an arm of a match, the values it
+ * is taken for or '_' for any other value, such as
+ * '1, 2 => {'.
+ *
+ * @state: Compiler state
+ * @tok: First token of the arm
+ */
 static int
-parse_func_call(struct gup_state *state, struct symbol *symbol, struct token *tok)
+parse_arm(struct gup_state *state, struct token *tok)
 {
-    struct ast_node *root;
+    struct ast_node *root, **tail;
 
-    if (state == NULL || tok == NULL) {
+    if (ast_node_alloc(state, AST_OP_ARM, &root) < 0) {
+        trace_error(state, "[PARSER] failed to allocate ast node\n");
         return -1;
     }
 
-    /* Expect () if we see '(' */
-    if (tok->type == TT_LPAREN) {
-        if (parse_expect(state, tok, TT_RPAREN) < 0)
+    root->left = NULL;
+    tail = &root->left;
+    if (tok->type == TT_IDENT && strcmp(tok->s, "_") == 0) {
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "got unexpected end of file, expected ARROW\n");
             return -1;
+        }
+    } else {
+        for (;;) {
+            if (tok->type != TT_NUMBER) {
+                trace_error(state, "expected NUMBER, got %s instead\n", toktab[tok->type]);
+                return -1;
+            }
+
+            if (ast_node_alloc(state, AST_OP_NUMBER, tail) < 0) {
+                return -1;
+            }
+
+            (*tail)->v = tok->v;
+            tail = &(*tail)->right;
+            if (lexer_scan(state, tok) < 0) {
+                trace_error(state, "got unexpected end of file, expected ARROW\n");
+                return -1;
+            }
+
+            if (tok->type != TT_COMMA) {
+                break;
+            }
+
+            if (lexer_scan(state, tok) < 0) {
+                trace_error(state, "got unexpected end of file, expected NUMBER\n");
+                return -1;
+            }
+        }
     }
 
-    if (ast_node_alloc(state, AST_OP_CALL, &root) < 0) {
-        trace_warn("[PARSER] retvoid failure\n");
+    if (tok->type != TT_ARROW) {
+        trace_error(state, "expected ARROW, got %s instead\n", toktab[tok->type]);
         return -1;
     }
 
-    root->symbol = symbol;
-    cg_compile_node(state, root);
-    return 0;
+    if (parse_expect(state, tok, TT_LBRACE) < 0) {
+        return -1;
+    }
+
+    if (scope_push(state, TT_ARM) < 0) {
+        return -1;
+    }
+
+    return cg_compile_node(state, root);
 }
 
+/*
+ * Parse a 'break' or 'continue', optionally naming the
+ * enclosing loop it applies to, such as 'break \'outer;'.
+ *
+ * @state: Compiler state
+ * @tok: Last token [TT_BREAK or TT_CONTINUE]
+ */
 static int
-parse_struct_access(struct gup_state *state, struct symbol *parent, struct token *tok)
+parse_loopjmp(struct gup_state *state, struct token *tok)
 {
-    struct ast_node *root, *cur;
+    struct ast_node *root;
+    const char *what = (tok->type == TT_BREAK) ? "break" : "continue";
+    ast_op_t op = (tok->type == TT_BREAK) ? AST_OP_BREAK : AST_OP_CONTINUE;
 
-    if (state == NULL || tok == NULL) {
+    if (state->loop_depth == 0) {
+        trace_error(state, "unexpected '%s'\n", what);
         return -1;
     }
 
-    if (ast_node_alloc(state, AST_OP_ASSIGN, &root) < 0) {
+    if (ast_node_alloc(state, op, &root) < 0) {
+        trace_warn("[PARSER] %s node creation failure\n", what);
         return -1;
     }
 
-    if (ast_node_alloc(state, AST_OP_VAR, &root->left) < 0) {
+    if (lexer_scan(state, tok) < 0) {
+        trace_error(state, "got unexpected end of file, expected SEMICOLON\n");
         return -1;
     }
 
-    cur = root->left;
-    cur->str = ptrbox_strdup(&state->ptrbox, parent->name);
-    if (cur->str == NULL) {
+    if (tok->type == TT_LABEL) {
+        root->str = tok->s;
+        if (parse_expect(state, tok, TT_SEMI) < 0) {
+            return -1;
+        }
+    } else if (tok->type != TT_SEMI) {
+        trace_error(state, "expected SEMICOLON, got %s instead\n", toktab[tok->type]);
         return -1;
     }
 
-    if (ast_node_alloc(state, AST_OP_VAR, &cur->left) < 0) {
-        return -1;
-    }
+    return cg_compile_node(state, root);
+}
 
-    cur = cur->left;
-    for (;;) {
+/*
+ * Parse the rest of an assignment that takes every value
+ * a call returns, such as 'a.x, a.y = f();'.
+ *
+ * @state: Compiler state
+ * @first: Assignment to the first field
+ * @tok: Current token [TT_COMMA], the token after the call is left here
+ * @res: AST_OP_UNPACK node is written here
+ */
+static int
+parse_unpack(struct gup_state *state, struct ast_node *first, struct token *tok,
+    struct ast_node **res)
+{
+    struct ast_node *root, *call, *last = first;
+    struct symbol *symbol;
+    size_t n = 1;
+
+    while (tok->type == TT_COMMA) {
         if (parse_expect(state, tok, TT_IDENT) < 0) {
             return -1;
         }
 
-        cur->str = ptrbox_strdup(&state->ptrbox, tok->s);
-        if (cur->str == NULL) {
+        if ((symbol = symbol_from_name(&state->g_symtab, tok->s)) == NULL) {
+            trace_error(state, "\"%s\" is not a struct instance\n", tok->s);
             return -1;
         }
 
-        if (lexer_scan(state, tok) < 0) {
-            trace_error(state, "unexpected end of file\n");
+        if (parse_expect(state, tok, TT_DOT) < 0) {
             return -1;
         }
 
-        /* Should we keep grabbing fields? */
-        if (tok->type == TT_DOT) {
-            if (lexer_scan(state, tok) < 0) {
-                trace_error(state, "unexpected end of file\n");
-                return -1;
-            }
-
-            if (ast_node_alloc(state, AST_OP_VAR, &cur->left) < 0) {
-                return -1;
-            }
-
-            cur = cur->left;
+        if (parse_field_target(state, symbol, tok, &last->right) < 0) {
+            return -1;
         }
 
-        if (tok->type != TT_DOT) {
-            break;
-        }
+        last = last->right;
+        ++n;
     }
 
     if (tok->type != TT_EQUALS) {
@@ -580,26 +1889,85 @@ parse_struct_access(struct gup_state *state, struct symbol *parent, struct token
         return -1;
     }
 
+    if (parse_expect(state, tok, TT_IDENT) < 0) {
+        return -1;
+    }
+
+    symbol = symbol_from_name(&state->g_symtab, tok->s);
+    if (symbol == NULL || symbol->type != SYMBOL_TYPE_FUNC) {
+        trace_error(state, "expected call after EQUALS\n");
+        return -1;
+    }
+
+    if (parse_expect(state, tok, TT_LPAREN) < 0) {
+        return -1;
+    }
+
+    if (parse_call(state, symbol, tok, &call) < 0) {
+        return -1;
+    }
+
+    if (symbol->ret_count != n) {
+        trace_error(
+            state,
+            "\"%s\" returns %u values, %zu are assigned\n",
+            symbol->name,
+            symbol->ret_count,
+            n
+        );
+        return -1;
+    }
+
     if (lexer_scan(state, tok) < 0) {
         trace_error(state, "unexpected end of file\n");
         return -1;
     }
 
-    switch (tok->type) {
-    case TT_NUMBER:
-        if (ast_node_alloc(state, AST_OP_NUMBER, &root->right) < 0) {
+    if (ast_node_alloc(state, AST_OP_UNPACK, &root) < 0) {
+        return -1;
+    }
+
+    root->left = first;
+    root->right = call;
+    *res = root;
+    return 0;
+}
+
+static int
+parse_struct_access(struct gup_state *state, struct symbol *parent, struct token *tok)
+{
+    struct ast_node *root;
+
+    if (state->this_func == NULL) {
+        trace_error(state, "assignment outside of function\n");
+        return -1;
+    }
+
+    if (parse_field_target(state, parent, tok, &root) < 0) {
+        return -1;
+    }
+
+    /* Several fields take the values of a single call */
+    if (tok->type == TT_COMMA) {
+        if (parse_unpack(state, root, tok, &root) < 0) {
             return -1;
         }
-
-        cur = root->right;
-        cur->v = tok->v;
-        break;
-    default:
-        trace_error(state, "got unexpected token %s\n", toktab[tok->type]);
+    } else if (tok->type != TT_EQUALS) {
+        trace_error(state, "expected EQUALS, got %s\n", toktab[tok->type]);
         return -1;
+    } else {
+        if (lexer_scan(state, tok) < 0) {
+            trace_error(state, "unexpected end of file\n");
+            return -1;
+        }
+
+        if (parse_expr(state, tok, 1, &root->right) < 0) {
+            return -1;
+        }
     }
 
-    if (parse_expect(state, tok, TT_SEMI) < 0) {
+    if (tok->type != TT_SEMI) {
+        trace_error(state, "expected SEMICOLON, got %s\n", toktab[tok->type]);
         return -1;
     }
 
@@ -655,16 +2023,42 @@ static int
 begin_parse(struct gup_state *state, struct token *tok)
 {
     struct ast_node *root;
-    tt_t scope_tok;
+    tt_t scope_tok, attr;
+    char *label;
 
     if (state == NULL || tok == NULL) {
         errno = -EINVAL;
         return -1;
     }
 
+    /* Only arms live directly within a match */
+    if (state->scope_depth > 0 && tok->type != TT_RBRACE &&
+        state->scope_stack[state->scope_depth - 1] == TT_MATCH) {
+        if (parse_arm(state, tok) < 0) {
+            return -1;
+        }
+
+        state->last_token = *tok;
+        return 0;
+    }
+
     switch (tok->type) {
     case TT_FN:
-        if (parse_function(state, tok) < 0) {
+        if (parse_function(state, tok, TT_FN) < 0) {
+            return -1;
+        }
+        break;
+    case TT_INLINE:
+    case TT_NOINLINE:
+    case TT_HOT:
+    case TT_COLD:
+    case TT_EXTERN:
+        attr = tok->type;
+        if (parse_expect(state, tok, TT_FN) < 0) {
+            return -1;
+        }
+
+        if (parse_function(state, tok, attr) < 0) {
             return -1;
         }
         break;
@@ -678,7 +2072,14 @@ begin_parse(struct gup_state *state, struct token *tok)
             return -1;
         }
 
-        state->have_return = 1;
+        state->have_return |= !scope_in_cond(state);
+        break;
+    case TT_BECOME:
+        if (parse_become(state, tok) < 0) {
+            return -1;
+        }
+
+        state->have_return |= !scope_in_cond(state);
         break;
     case TT_STRUCT:
         if (parse_struct(state, tok) < 0) {
@@ -689,38 +2090,10 @@ begin_parse(struct gup_state *state, struct token *tok)
     case TT_PUB:
         break;
     case TT_BREAK:
-        if (scope_top(state) != TT_LOOP) {
-            trace_error(state, "unexpected 'break'\n");
-            return -1;
-        }
-
-        if (parse_expect(state, tok, TT_SEMI) < 0) {
-            return -1;
-        }
-
-        if (ast_node_alloc(state, AST_OP_BREAK, &root) < 0) {
-            trace_warn("[PARSER] break node creation failure\n");
-            return -1;
-        }
-
-        cg_compile_node(state, root);
-        break;
     case TT_CONTINUE:
-        if (scope_top(state) != TT_LOOP) {
-            trace_error(state, "unexpected 'continue'\n");
-            return -1;
-        }
-
-        if (parse_expect(state, tok, TT_SEMI) < 0) {
+        if (parse_loopjmp(state, tok) < 0) {
             return -1;
         }
-
-        if (ast_node_alloc(state, AST_OP_CONTINUE, &root) < 0) {
-            trace_warn("[PARSER] continue node creation failure\n");
-            return -1;
-        }
-
-        cg_compile_node(state, root);
         break;
     case TT_RBRACE:
         if (state->this_func == NULL) {
@@ -729,6 +2102,10 @@ begin_parse(struct gup_state *state, struct token *tok)
         }
 
         scope_tok = scope_pop(state);
+        if (scope_tok == TT_IF) {
+            return parse_endif(state, tok);
+        }
+
         parse_endscope(state, scope_tok);
 
         if (state->scope_depth == 0) {
@@ -741,7 +2118,7 @@ begin_parse(struct gup_state *state, struct token *tok)
 
         if (state->have_return) {
             state->have_return = 0;
-            return 0;
+            return cg_end_func(state);
         };
 
         if (ast_node_alloc(state, AST_OP_RETVOID, &root) < 0) {
@@ -750,22 +2127,56 @@ begin_parse(struct gup_state *state, struct token *tok)
         }
 
         cg_compile_node(state, root);
+        if (cg_end_func(state) < 0) {
+            return -1;
+        }
         break;
     case TT_LOOP:
-        if (parse_expect(state, tok, TT_LBRACE) < 0) {
+        if (parse_loop(state, tok, NULL) < 0) {
+            return -1;
+        }
+        break;
+    case TT_IF:
+        if (state->this_func == NULL) {
+            trace_error(state, "unexpected 'if'\n");
             return -1;
         }
 
-        if (scope_push(state, TT_LOOP) < 0) {
+        if (parse_if(state, tok) < 0) {
+            return -1;
+        }
+        break;
+    case TT_ELSE:
+        trace_error(state, "unexpected 'else'\n");
+        return -1;
+    case TT_MATCH:
+        if (state->this_func == NULL) {
+            trace_error(state, "unexpected 'match'\n");
             return -1;
         }
 
-        if (ast_node_alloc(state, AST_OP_LOOP, &root) < 0) {
-            trace_error(state, "[PARSER] failed to allocate ast node\n");
+        if (parse_match(state, tok) < 0) {
+            return -1;
+        }
+        break;
+    case TT_LABEL:
+        if (state->this_func == NULL) {
+            trace_error(state, "unexpected label '%s\n", tok->s);
             return -1;
         }
 
-        cg_compile_node(state, root);
+        label = tok->s;
+        if (parse_expect(state, tok, TT_COLON) < 0) {
+            return -1;
+        }
+
+        if (parse_expect(state, tok, TT_LOOP) < 0) {
+            return -1;
+        }
+
+        if (parse_loop(state, tok, label) < 0) {
+            return -1;
+        }
         break;
     case TT_IDENT:
         if (parse_ident(state, tok) < 0) {
@@ -810,6 +2221,9 @@ gup_parse(struct gup_state *state)
         trace_debug("got token: %s\n", toktab[token.type]);
         if (begin_parse(state, &token) < 0) {
             state->scope_depth = 0;
+            state->loop_depth = 0;
+            state->cond_depth = 0;
+            error = -1;
             break;
         }
     }
@@ -819,6 +2233,17 @@ gup_parse(struct gup_state *state)
         error = -1;
     }
 
+    /* Drop a function that never saw its closing brace */
+    cg_discard_func(state);
+    if (cg_end_unit(state) < 0) {
+        error = -1;
+    }
+
+    /* The symbols are gone once the unit is done with */
+    if (error == 0 && state->header != NULL && header_write(state, state->header) < 0) {
+        error = -1;
+    }
+
     symbol_table_destroy(&state->g_symtab);
     ptrbox_destroy(&state->ast_ptrbox);
     ptrbox_destroy(&state->ptrbox);
@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "gup/pass.h"
+#include "gup/trace.h"
+#include "gup/mu.h"
+
+#define ELAPSED_NS(STARTP, ENDP)                            \
+    (double)((ENDP)->tv_sec - (STARTP)->tv_sec) * 1.0e9 +    \
+        (double)((ENDP)->tv_nsec - (STARTP)->tv_nsec)
+
+/*
+ * Command line override for a pass
+ */
+typedef enum {
+    PASS_DEFAULT,
+    PASS_FORCE_ON,
+    PASS_FORCE_OFF
+} pass_override_t;
+
+static int pass_funcinfo(struct gup_state *state, struct gup_func *func);
+
+/*
+ * The pass pipeline, passes run in the order they
+ * appear here.
+ */
+static const struct gup_pass passtab[] = {
+    { "funcinfo", PASS_ANALYSIS, 1, pass_funcinfo },
+    { "cold-blocks", PASS_TRANSFORM, 1, pass_cold_blocks },
+    { "unreachable", PASS_TRANSFORM, 1, pass_unreachable },
+    { "unroll", PASS_TRANSFORM, 1, pass_unroll },
+    { "strength", PASS_TRANSFORM, 1, pass_strength },
+    { "static-init", PASS_TRANSFORM, 1, pass_static_init },
+    { "store-merge", PASS_TRANSFORM, 1, pass_store_merge },
+    { "peephole", PASS_MACHINE, 1, mu_pass_peephole },
+    { "ipcp", PASS_UNIT, 1, pass_ipcp },
+    { "inline", PASS_UNIT, 1, pass_inline },
+    { "tail-call", PASS_UNIT, 1, pass_tail_call },
+    { "dead-func", PASS_UNIT, 1, pass_dead_func },
+    { "func-split", PASS_UNIT, 1, pass_func_split },
+    { "data-order", PASS_UNIT, 1, pass_data_order },
+    { "func-order", PASS_UNIT, 2, pass_func_order },
+};
+
+#define PASS_COUNT (sizeof(passtab) / sizeof(passtab[0]))
+
+static pass_override_t overrides[PASS_COUNT];
+static pass_override_t verify_override = PASS_DEFAULT;
+static double pass_time_ns[PASS_COUNT];
+static size_t pass_runs[PASS_COUNT];
+static double verify_time_ns;
+static bool timing = false;
+static bool stats = false;
+
+/*
+ * A named statistic
+ *
+ * @pass: Pass the statistic belongs to
+ * @what: Description of the statistic
+ * @value: Accumulated value
+ */
+struct pass_statent {
+    const char *pass;
+    const char *what;
+    size_t value;
+};
+
+static struct pass_statent *stattab;
+static size_t stat_count;
+
+/*
+ * Summarize what a function does so later passes
+ * need not walk it again.
+ */
+static int
+pass_funcinfo(struct gup_state *state, struct gup_func *func)
+{
+    struct ir_insn *insn;
+    struct ir_label *label;
+
+    func->flags = 0;
+    for (size_t i = 0; i < func->ir.insn_count; ++i) {
+        insn = &func->ir.insns[i];
+        switch (insn->op) {
+        case IR_CALL:
+        case IR_TAIL:
+            func->flags |= FUNC_HAS_CALL;
+            break;
+        case IR_ASM:
+            func->flags |= FUNC_HAS_ASM;
+            break;
+        case IR_LABEL:
+            label = &func->ir.labels[insn->label];
+            if (label->flags & IR_LABEL_LOOP) {
+                func->flags |= FUNC_HAS_LOOP;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Check the structural invariants of a retained function,
+ * ran after every transform pass.
+ *
+ * @state: Compiler state
+ * @func: Function to verify
+ * @after: Name of the pass that last ran
+ */
+static int
+pass_verify(struct gup_state *state, struct gup_func *func, const char *after)
+{
+    struct ir_func *ir = &func->ir;
+    struct ir_insn *insn;
+    uint8_t *defined;
+    int error = -1;
+
+    if (ir->insn_count == 0 || ir->insns[0].op != IR_ENTRY) {
+        trace_error(state, "[verify] %s: function lost its entry\n", after);
+        return -1;
+    }
+
+    if ((defined = calloc(ir->label_count + 1, 1)) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (size_t i = 0; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        if (insn->op >= IR_OP_MAX) {
+            trace_error(state, "[verify] %s: bad opcode %d\n", after, insn->op);
+            goto done;
+        }
+
+        if (insn->op == IR_ENTRY && i > 0) {
+            trace_error(state, "[verify] %s: stray function entry\n", after);
+            goto done;
+        }
+
+        if (insn->dst > ir->vreg_count ||
+            (insn->a.type == IR_VAL_VREG && insn->a.vreg > ir->vreg_count) ||
+            (insn->b.type == IR_VAL_VREG && insn->b.vreg > ir->vreg_count)) {
+            trace_error(state, "[verify] %s: unknown virtual register\n", after);
+            goto done;
+        }
+
+        switch (insn->op) {
+        case IR_LABEL:
+        case IR_JMP:
+        case IR_BR:
+        case IR_DECJNZ:
+        case IR_BT:
+        case IR_JTAB:
+        case IR_CASE:
+            if (insn->label >= ir->label_count) {
+                trace_error(state, "[verify] %s: unknown label\n", after);
+                goto done;
+            }
+
+            if (insn->op != IR_LABEL) {
+                break;
+            }
+
+            if (defined[insn->label]) {
+                trace_error(
+                    state,
+                    "[verify] %s: label %s defined twice\n",
+                    after, ir->labels[insn->label].name
+                );
+                goto done;
+            }
+
+            defined[insn->label] = 1;
+            break;
+        case IR_ENTRY:
+        case IR_CALL:
+        case IR_TAIL:
+        case IR_ASM:
+        case IR_STORE:
+            if (insn->sym == NULL) {
+                trace_error(state, "[verify] %s: missing symbol\n", after);
+                goto done;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* Every jump must land on a label within this function */
+    for (size_t i = 0; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        if (ir_is_branch(insn) && !defined[insn->label]) {
+            trace_error(
+                state,
+                "[verify] %s: jump to undefined label %s\n",
+                after, ir->labels[insn->label].name
+            );
+            goto done;
+        }
+    }
+
+    error = 0;
+done:
+    free(defined);
+    return error;
+}
+
+/*
+ * Returns true if a pass should run at the current
+ * optimization level.
+ *
+ * @state: Compiler state
+ * @idx: Index of pass within the pass table
+ */
+static inline bool
+pass_enabled(struct gup_state *state, size_t idx)
+{
+    switch (overrides[idx]) {
+    case PASS_FORCE_ON:
+        return true;
+    case PASS_FORCE_OFF:
+        return false;
+    default:
+        return state->opt_level >= passtab[idx].level;
+    }
+}
+
+int
+pass_run(struct gup_state *state, struct gup_func *func)
+{
+    const struct gup_pass *pass;
+    struct timespec start, end;
+    bool verify;
+
+    if (state == NULL || func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    verify = verify_override != PASS_FORCE_OFF;
+    if (verify) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (pass_verify(state, func, "parser") < 0) {
+            return -1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        verify_time_ns += ELAPSED_NS(&start, &end);
+    }
+
+    for (size_t i = 0; i < PASS_COUNT; ++i) {
+        pass = &passtab[i];
+        if (pass->kind == PASS_MACHINE || pass->kind == PASS_UNIT) {
+            continue;
+        }
+
+        if (!pass_enabled(state, i)) {
+            continue;
+        }
+
+        trace_debug("[PASS] running %s\n", pass->name);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (pass->run(state, func) < 0) {
+            trace_error(state, "[PASS] %s failed\n", pass->name);
+            return -1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        pass_time_ns[i] += ELAPSED_NS(&start, &end);
+        ++pass_runs[i];
+
+        if (!verify || pass->kind == PASS_ANALYSIS) {
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (pass_verify(state, func, pass->name) < 0) {
+            return -1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        verify_time_ns += ELAPSED_NS(&start, &end);
+    }
+
+    return 0;
+}
+
+/*
+ * Run every enabled pass of a single kind
+ *
+ * @state: Compiler state
+ * @func: Function to run over [NULL for unit passes]
+ * @kind: Kind of pass to run
+ */
+static int
+pass_run_kind(struct gup_state *state, struct gup_func *func, pass_kind_t kind)
+{
+    const struct gup_pass *pass;
+    struct timespec start, end;
+
+    for (size_t i = 0; i < PASS_COUNT; ++i) {
+        if (passtab[i].kind != kind || !pass_enabled(state, i)) {
+            continue;
+        }
+
+        pass = &passtab[i];
+        trace_debug("[PASS] running %s\n", pass->name);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (pass->run(state, func) < 0) {
+            trace_error(state, "[PASS] %s failed\n", pass->name);
+            return -1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        pass_time_ns[i] += ELAPSED_NS(&start, &end);
+        ++pass_runs[i];
+    }
+
+    return 0;
+}
+
+int
+pass_run_machine(struct gup_state *state, struct gup_func *func)
+{
+    if (state == NULL || func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    return pass_run_kind(state, func, PASS_MACHINE);
+}
+
+int
+pass_run_unit(struct gup_state *state)
+{
+    if (state == NULL || state->unit == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    return pass_run_kind(state, NULL, PASS_UNIT);
+}
+
+int
+pass_toggle(const char *name, bool enable)
+{
+    if (name == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (strcmp(name, "verify") == 0) {
+        verify_override = enable ? PASS_FORCE_ON : PASS_FORCE_OFF;
+        return 0;
+    }
+
+    for (size_t i = 0; i < PASS_COUNT; ++i) {
+        if (strcmp(passtab[i].name, name) == 0) {
+            overrides[i] = enable ? PASS_FORCE_ON : PASS_FORCE_OFF;
+            return 0;
+        }
+    }
+
+    errno = -ENOENT;
+    return -1;
+}
+
+void
+pass_set_timing(bool enable)
+{
+    timing = enable;
+}
+
+void
+pass_set_stats(bool enable)
+{
+    stats = enable;
+}
+
+void
+pass_stat(const char *pass, const char *what, size_t v)
+{
+    struct pass_statent *ent;
+
+    if (pass == NULL || what == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < stat_count; ++i) {
+        ent = &stattab[i];
+        if (strcmp(ent->pass, pass) == 0 && strcmp(ent->what, what) == 0) {
+            ent->value += v;
+            return;
+        }
+    }
+
+    ent = realloc(stattab, (stat_count + 1) * sizeof(*stattab));
+    if (ent == NULL) {
+        return;
+    }
+
+    stattab = ent;
+    stattab[stat_count].pass = pass;
+    stattab[stat_count].what = what;
+    stattab[stat_count].value = v;
+    ++stat_count;
+}
+
+void
+pass_report(FILE *fp)
+{
+    if (fp == NULL) {
+        return;
+    }
+
+    if (timing) {
+        fprintf(fp, "%-16s %8s %14s\n", "pass", "runs", "time [ns]");
+        for (size_t i = 0; i < PASS_COUNT; ++i) {
+            fprintf(
+                fp,
+                "%-16s %8zu %14.2f\n",
+                passtab[i].name,
+                pass_runs[i],
+                pass_time_ns[i]
+            );
+        }
+
+        fprintf(fp, "%-16s %8s %14.2f\n", "verify", "-", verify_time_ns);
+    }
+
+    if (stats) {
+        for (size_t i = 0; i < stat_count; ++i) {
+            fprintf(
+                fp,
+                "%-16s %-32s %zu\n",
+                stattab[i].pass,
+                stattab[i].what,
+                stattab[i].value
+            );
+        }
+    }
+}
@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/callgraph.h"
+#include "gup/trace.h"
+#include "gup/pass.h"
+
+/* A function is hot with at least 1/n of the calls of the hottest one */
+#define SPLIT_HOT_SHARE 10
+
+/*
+ * Temperature of a function
+ *
+ * @SPLIT_WARM: Placed within .text
+ * @SPLIT_HOT: Placed within .text.hot
+ * @SPLIT_COLD: Placed within .text.unlikely
+ */
+typedef enum {
+    SPLIT_WARM,
+    SPLIT_HOT,
+    SPLIT_COLD
+} split_temp_t;
+
+/*
+ * Returns true if a function may only be reached through
+ * the calls within the unit, so that where it is called
+ * from says how often it runs.
+ *
+ * @state: Compiler state
+ * @unit: Unit the function belongs to
+ * @func: Function to check
+ */
+static bool
+split_private(struct gup_state *state, const struct gup_unit *unit,
+    const struct gup_func *func)
+{
+    const char *name = func->symbol->name;
+    const struct ir_func *ir;
+
+    if (func->symbol->is_pub) {
+        return false;
+    }
+
+    if (state->entry != NULL && strcmp(name, state->entry) == 0) {
+        return false;
+    }
+
+    /* Conservative, any mention within assembly counts as a call */
+    for (size_t i = 0; i < unit->top_asm_count; ++i) {
+        if (strstr(unit->top_asm[i], name) != NULL) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < unit->func_count; ++i) {
+        ir = &unit->funcs[i]->ir;
+        for (size_t j = 0; j < ir->insn_count; ++j) {
+            if (ir->insns[j].op == IR_ASM && strstr(ir->insns[j].sym, name) != NULL) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Find the functions that are called from somewhere
+ * other than a cold block or a cold function.
+ *
+ * @cg: Call graph of the unit
+ * @temp: Temperature of each node
+ * @called: Set for each node that is called at all
+ * @warm: Set for each node that is called from warm code
+ */
+static void
+split_callers(const struct callgraph *cg, const split_temp_t *temp, uint8_t *called,
+    uint8_t *warm)
+{
+    const struct ir_insn *insn;
+    const struct ir_func *ir;
+    ssize_t callee;
+    bool cold;
+
+    for (size_t i = 0; i < cg->node_count; ++i) {
+        ir = &cg->nodes[i].func->ir;
+        cold = false;
+        for (size_t j = 0; j < ir->insn_count; ++j) {
+            insn = &ir->insns[j];
+
+            /* A block runs as often as the label it starts at */
+            if (insn->op == IR_LABEL) {
+                cold = (ir->labels[insn->label].flags & IR_LABEL_COLD) != 0;
+                continue;
+            }
+
+            if (insn->op != IR_CALL && insn->op != IR_TAIL) {
+                continue;
+            }
+
+            if ((callee = callgraph_find(cg, insn->sym)) < 0) {
+                continue;
+            }
+
+            called[callee] = 1;
+            if (!cold && temp[i] != SPLIT_COLD) {
+                warm[callee] = 1;
+            }
+        }
+    }
+}
+
+/*
+ * Mark the functions that are only ever called from
+ * cold blocks or from other cold functions as cold,
+ * until no more are found.
+ *
+ * @cg: Call graph of the unit
+ * @temp: Temperature of each node
+ * @fixed: Set for each node whose temperature is known
+ */
+static int
+split_static(const struct callgraph *cg, split_temp_t *temp, const uint8_t *fixed)
+{
+    uint8_t *called, *warm;
+    bool changed = true;
+
+    called = calloc(cg->node_count, sizeof(*called));
+    warm = calloc(cg->node_count, sizeof(*warm));
+    if (called == NULL || warm == NULL) {
+        free(called);
+        free(warm);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    while (changed) {
+        changed = false;
+        memset(called, 0, cg->node_count * sizeof(*called));
+        memset(warm, 0, cg->node_count * sizeof(*warm));
+        split_callers(cg, temp, called, warm);
+        for (size_t i = 0; i < cg->node_count; ++i) {
+            if (fixed[i] || temp[i] != SPLIT_WARM || !called[i] || warm[i]) {
+                continue;
+            }
+
+            temp[i] = SPLIT_COLD;
+            changed = true;
+        }
+    }
+
+    free(called);
+    free(warm);
+    return 0;
+}
+
+/*
+ * Classify functions by the measured call counts. A
+ * function is hot when it is called at least 1/n as
+ * often as the hottest one [SPLIT_HOT_SHARE], and cold
+ * when every call to it was counted zero times.
+ *
+ * @cg: Call graph of the unit, weighted by the profile
+ * @temp: Temperature of each node
+ * @fixed: Set for each node whose temperature is known
+ * @private: Set for each node only called within the unit
+ */
+static void
+split_profile(const struct callgraph *cg, split_temp_t *temp, uint8_t *fixed,
+    const uint8_t *private)
+{
+    const struct callgraph_node *node;
+    uint64_t max = 0;
+
+    for (size_t i = 0; i < cg->node_count; ++i) {
+        if (cg->nodes[i].weight > max) {
+            max = cg->nodes[i].weight;
+        }
+    }
+
+    for (size_t i = 0; i < cg->node_count; ++i) {
+        node = &cg->nodes[i];
+        if (fixed[i]) {
+            continue;
+        }
+
+        if (node->weight > 0 && node->weight * SPLIT_HOT_SHARE >= max) {
+            temp[i] = SPLIT_HOT;
+            fixed[i] = 1;
+        }
+    }
+
+    /* Only a function with calls, all of them never made, is known to be cold */
+    for (size_t i = 0; i < cg->node_count; ++i) {
+        node = &cg->nodes[i];
+        for (size_t j = 0; j < node->call_count; ++j) {
+            if (!fixed[node->calls[j].callee] && private[node->calls[j].callee] &&
+                cg->nodes[node->calls[j].callee].weight == 0) {
+                temp[node->calls[j].callee] = SPLIT_COLD;
+            }
+        }
+    }
+}
+
+/*
+ * Place each function within a text section of its
+ * temperature. 'hot fn' and 'cold fn' are kept as they
+ * are. Otherwise a function is cold if it is only called
+ * from cold blocks or from other cold functions, and
+ * with a profile, hot or cold by its call count. Calls
+ * to a cold function stay off the paths that run often,
+ * so the hot code packs into fewer pages.
+ */
+int
+pass_func_split(struct gup_state *state, struct gup_func *func)
+{
+    struct gup_unit *unit = state->unit;
+    struct ir_insn *entry;
+    struct callgraph cg;
+    split_temp_t *temp;
+    uint8_t *fixed, *private;
+    size_t hot = 0, cold = 0;
+    int error = -1;
+
+    if (unit->func_count == 0) {
+        return 0;
+    }
+
+    if (callgraph_build(state, unit, &cg) < 0) {
+        return -1;
+    }
+
+    temp = calloc(cg.node_count, sizeof(*temp));
+    fixed = calloc(cg.node_count, sizeof(*fixed));
+    private = calloc(cg.node_count, sizeof(*private));
+    if (temp == NULL || fixed == NULL || private == NULL) {
+        errno = -ENOMEM;
+        goto done;
+    }
+
+    for (size_t i = 0; i < cg.node_count; ++i) {
+        func = cg.nodes[i].func;
+        if (func->symbol->is_hot || func->symbol->is_cold) {
+            temp[i] = func->symbol->is_hot ? SPLIT_HOT : SPLIT_COLD;
+            fixed[i] = 1;
+        }
+
+        private[i] = split_private(state, unit, func);
+    }
+
+    if (state->profile != NULL) {
+        split_profile(&cg, temp, fixed, private);
+    }
+
+    /* Functions that may be called from elsewhere are never found cold */
+    for (size_t i = 0; i < cg.node_count; ++i) {
+        fixed[i] |= !private[i];
+    }
+
+    if (split_static(&cg, temp, fixed) < 0) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < cg.node_count; ++i) {
+        func = cg.nodes[i].func;
+        entry = &func->ir.insns[0];
+        entry->flags &= ~(IR_F_HOT | IR_F_COLD);
+        switch (temp[i]) {
+        case SPLIT_HOT:
+            entry->flags |= IR_F_HOT;
+            ++hot;
+            break;
+        case SPLIT_COLD:
+            entry->flags |= IR_F_COLD;
+            ++cold;
+            break;
+        default:
+            continue;
+        }
+
+        trace_debug(
+            "[func-split] %s is %s\n",
+            func->symbol->name, (temp[i] == SPLIT_HOT) ? "hot" : "cold"
+        );
+    }
+
+    pass_stat("func-split", "hot functions", hot);
+    pass_stat("func-split", "cold functions", cold);
+    error = 0;
+done:
+    free(temp);
+    free(fixed);
+    free(private);
+    callgraph_release(&cg);
+    return error;
+}
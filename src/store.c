@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "gup/layout.h"
+#include "gup/symbol.h"
+#include "gup/pass.h"
+#include "gup/mu.h"
+
+/* Widest span of bytes a single run may cover */
+#define MERGE_MAX_SPAN 64
+
+/* Most stores a single run may be rewritten into */
+#define MERGE_MAX_STORES MERGE_MAX_SPAN
+
+/*
+ * Returns true if an instruction is a constant store
+ * that may take part in a merge.
+ *
+ * @insn: Instruction to check
+ */
+static inline bool
+store_mergeable(const struct ir_insn *insn)
+{
+    if (insn->op != IR_STORE || insn->a.type != IR_VAL_IMM) {
+        return false;
+    }
+
+    return gup_type_size(insn->width) > 0;
+}
+
+/*
+ * Returns the type of a store of a given size
+ *
+ * @size: Size in bytes
+ */
+static inline gup_type_t
+store_type(size_t size)
+{
+    switch (size) {
+    case 1:
+        return GUP_TYPE_U8;
+    case 2:
+        return GUP_TYPE_U16;
+    case 4:
+        return GUP_TYPE_U32;
+    default:
+        return GUP_TYPE_U64;
+    }
+}
+
+/*
+ * Plan the fewest naturally aligned stores that write the
+ * covered bytes of a span, returns the number of stores.
+ *
+ * @bytes: Byte image of the span
+ * @covered: Set for every byte that may be written
+ * @lo: Offset of the span within the object
+ * @span: Length of the span
+ * @max: Widest store the alignment of the object allows
+ * @sym: Object being written
+ * @res: Planned stores are written here
+ */
+static size_t
+store_plan(const uint8_t *bytes, const bool *covered, size_t lo, size_t span,
+    size_t max, const char *sym, struct ir_insn *res)
+{
+    size_t count = 0, w;
+    uint64_t v;
+
+    for (size_t i = 0; i < span; i += w) {
+        if (!covered[i]) {
+            w = 1;
+            continue;
+        }
+
+        for (w = max; w > 1; w >>= 1) {
+            if ((lo + i) % w != 0 || i + w > span) {
+                continue;
+            }
+
+            if (memchr(&covered[i], false, w) != NULL) {
+                continue;
+            }
+
+            /* qword stores only take a sign extended imm32 */
+            if (w == sizeof(uint64_t)) {
+                memcpy(&v, &bytes[i], w);
+                if ((int64_t)v != (int32_t)v) {
+                    continue;
+                }
+            }
+            break;
+        }
+
+        v = 0;
+        memcpy(&v, &bytes[i], w);
+        res[count] = (struct ir_insn) {
+            .op = IR_STORE,
+            .width = store_type(w),
+            .sym = sym,
+            .off = lo + i,
+            .a = { .type = IR_VAL_IMM, .imm = v }
+        };
+        ++count;
+    }
+
+    return count;
+}
+
+/*
+ * Returns the widest store that stays naturally aligned
+ * within an object.
+ *
+ * @state: Compiler state
+ * @sym: Object name
+ */
+static size_t
+store_max_width(struct gup_state *state, const char *sym)
+{
+    struct symbol *symbol;
+
+    symbol = symbol_from_name(&state->g_symtab, sym);
+    if (symbol == NULL || symbol->layout == NULL) {
+        return 1;
+    }
+
+    if (symbol->layout->align > sizeof(uint64_t)) {
+        return sizeof(uint64_t);
+    }
+
+    return symbol->layout->align;
+}
+
+/*
+ * Coalesce runs of constant stores into the same object
+ * into the fewest naturally aligned stores. A run ends at
+ * any instruction that is not such a store, so nothing may
+ * observe the object between the merged stores.
+ */
+int
+pass_store_merge(struct gup_state *state, struct gup_func *func)
+{
+    struct ir_func *ir = &func->ir;
+    struct ir_insn plan[MERGE_MAX_STORES];
+    struct ir_insn *insn;
+    uint8_t bytes[MERGE_MAX_SPAN];
+    bool covered[MERGE_MAX_SPAN];
+    size_t i, j, n, lo, hi, size, nplan;
+    size_t removed = 0, bytes_saved = 0, before, after;
+
+    for (i = 0; i < ir->insn_count; i = j) {
+        j = i + 1;
+        if (!store_mergeable(&ir->insns[i])) {
+            continue;
+        }
+
+        lo = ir->insns[i].off;
+        hi = lo + gup_type_size(ir->insns[i].width);
+        while (j < ir->insn_count && store_mergeable(&ir->insns[j])) {
+            insn = &ir->insns[j];
+            if (strcmp(insn->sym, ir->insns[i].sym) != 0) {
+                break;
+            }
+
+            size = gup_type_size(insn->width);
+            if (insn->off < lo) {
+                lo = insn->off;
+            }
+            if (insn->off + size > hi) {
+                hi = insn->off + size;
+            }
+            ++j;
+        }
+
+        if (j - i < 2 || hi - lo > MERGE_MAX_SPAN) {
+            continue;
+        }
+
+        /* Replay the run into a byte image, later stores win */
+        memset(bytes, 0, sizeof(bytes));
+        memset(covered, 0, sizeof(covered));
+        for (n = i; n < j; ++n) {
+            insn = &ir->insns[n];
+            size = gup_type_size(insn->width);
+            for (size_t b = 0; b < size; ++b) {
+                bytes[insn->off - lo + b] = (insn->a.imm >> (b * 8)) & 0xFF;
+                covered[insn->off - lo + b] = true;
+            }
+        }
+
+        nplan = store_plan(
+            bytes, covered, lo, hi - lo,
+            store_max_width(state, ir->insns[i].sym),
+            ir->insns[i].sym, plan
+        );
+        before = after = 0;
+        for (n = i; n < j; ++n) {
+            before += mu_insn_size(&ir->insns[n]);
+        }
+        for (n = 0; n < nplan; ++n) {
+            after += mu_insn_size(&plan[n]);
+        }
+
+        if (nplan >= j - i || after > before) {
+            continue;
+        }
+
+        memcpy(&ir->insns[i], plan, nplan * sizeof(*plan));
+        for (n = i + nplan; n < j; ++n) {
+            ir->insns[n].op = IR_NOP;
+        }
+
+        removed += (j - i) - nplan;
+        bytes_saved += before - after;
+    }
+
+    /* Squeeze out what the merges left behind */
+    for (i = 0, n = 0; i < ir->insn_count; ++i) {
+        if (ir->insns[i].op != IR_NOP) {
+            ir->insns[n++] = ir->insns[i];
+        }
+    }
+
+    ir->insn_count = n;
+    pass_stat("store-merge", "stores removed", removed);
+    pass_stat("store-merge", "bytes removed [est]", bytes_saved);
+    return 0;
+}
+
+/*
+ * Fold constant stores that open the entry function into
+ * the initial contents of the objects they write to. The
+ * entry function is the first code to run, and runs once,
+ * so nothing can observe the objects before those stores.
+ */
+int
+pass_static_init(struct gup_state *state, struct gup_func *func)
+{
+    struct ir_func *ir = &func->ir;
+    struct ir_insn *insn;
+    struct symbol *symbol;
+    size_t i, n, folded = 0, bytes = 0;
+
+    if (state->entry == NULL || strcmp(func->symbol->name, state->entry) != 0) {
+        return 0;
+    }
+
+    for (i = 0; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        if (insn->op == IR_ENTRY || insn->op == IR_NOP) {
+            continue;
+        }
+
+        if (insn->op != IR_STORE || insn->a.type != IR_VAL_IMM) {
+            break;
+        }
+
+        symbol = symbol_from_name(&state->g_symtab, insn->sym);
+        if (symbol == NULL || symbol->type != SYMBOL_TYPE_INSTANCE) {
+            break;
+        }
+
+        if (layout_store(state, symbol, insn->off, insn->width, insn->a.imm) < 0) {
+            return -1;
+        }
+
+        bytes += mu_insn_size(insn);
+        insn->op = IR_NOP;
+        ++folded;
+    }
+
+    for (i = 0, n = 0; i < ir->insn_count; ++i) {
+        if (ir->insns[i].op != IR_NOP) {
+            ir->insns[n++] = ir->insns[i];
+        }
+    }
+
+    ir->insn_count = n;
+    pass_stat("static-init", "stores folded", folded);
+    pass_stat("static-init", "bytes removed [est]", bytes);
+    return 0;
+}
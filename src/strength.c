@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gup/trace.h"
+#include "gup/pass.h"
+
+/*
+ * Magic number for unsigned division by a constant
+ *
+ * @mul: Multiplier, the high half of n * mul is used
+ * @shift: Shift applied after the multiply
+ * @add: Set if the multiplier needed a 65th bit
+ */
+struct strength_magic {
+    uint64_t mul;
+    uint8_t shift;
+    bool add;
+};
+
+/*
+ * Returns the log2 of a power of two, or -1 if the
+ * value is not one.
+ *
+ * @v: Value to check
+ */
+static inline int
+strength_log2(uint64_t v)
+{
+    if (v == 0 || (v & (v - 1)) != 0) {
+        return -1;
+    }
+
+    return __builtin_ctzll(v);
+}
+
+/*
+ * Compute the magic number that divides any 64-bit
+ * value by @d through a multiply, after "Hacker's
+ * Delight" [magicu2].
+ *
+ * @d: Divisor [not zero, not a power of two]
+ * @res: Magic number is written here
+ */
+static void
+strength_magic(uint64_t d, struct strength_magic *res)
+{
+    const uint64_t two63 = 1ULL << 63;
+    uint64_t nc, delta, q1, r1, q2, r2;
+    unsigned int p = 63;
+
+    res->add = false;
+    nc = UINT64_MAX - (0 - d) % d;
+    q1 = two63 / nc;
+    r1 = two63 - q1 * nc;
+    q2 = (two63 - 1) / d;
+    r2 = (two63 - 1) - q2 * d;
+
+    do {
+        ++p;
+        if (r1 >= nc - r1) {
+            q1 = 2 * q1 + 1;
+            r1 = 2 * r1 - nc;
+        } else {
+            q1 = 2 * q1;
+            r1 = 2 * r1;
+        }
+
+        if (r2 + 1 >= d - r2) {
+            if (q2 >= two63 - 1) {
+                res->add = true;
+            }
+
+            q2 = 2 * q2 + 1;
+            r2 = 2 * r2 + 1 - d;
+        } else {
+            if (q2 >= two63) {
+                res->add = true;
+            }
+
+            q2 = 2 * q2;
+            r2 = 2 * r2 + 1;
+        }
+
+        delta = d - 1 - r2;
+    } while (p < 128 && (q1 < delta || (q1 == delta && r1 == 0)));
+
+    res->mul = q2 + 1;
+    res->shift = p - 64;
+}
+
+/*
+ * Append an instruction computing into a fresh virtual
+ * register, returns the register or IR_VREG_NONE on
+ * failure.
+ *
+ * @ir: Function being rewritten
+ * @out: Instructions being rebuilt
+ * @op: Opcode
+ * @width: Operation width
+ * @a: First operand
+ * @b: Second operand
+ */
+static ir_vreg_t
+strength_emit(struct ir_func *ir, struct ir_func *out, ir_op_t op,
+    gup_type_t width, struct ir_val a, struct ir_val b)
+{
+    struct ir_insn insn = { .op = op, .width = width, .a = a, .b = b };
+
+    insn.dst = ir_vreg_new(ir);
+    if (ir_append(out, &insn) < 0) {
+        return IR_VREG_NONE;
+    }
+
+    return insn.dst;
+}
+
+/*
+ * Append a division of @insn->a by a constant that is
+ * not a power of two as a multiply by its magic number,
+ * the quotient lands in @dst.
+ *
+ * @ir: Function being rewritten
+ * @out: Instructions being rebuilt
+ * @insn: Division or modulo being replaced
+ * @dst: Register the quotient is written to
+ */
+static int
+strength_div_magic(struct ir_func *ir, struct ir_func *out,
+    const struct ir_insn *insn, ir_vreg_t dst)
+{
+    struct ir_insn tail = { .dst = dst, .width = insn->width };
+    struct strength_magic magic;
+    struct ir_val t = { .type = IR_VAL_VREG }, u = { .type = IR_VAL_VREG };
+    struct ir_val imm = { .type = IR_VAL_IMM };
+
+    strength_magic(insn->b.imm, &magic);
+    imm.imm = magic.mul;
+    t.vreg = strength_emit(ir, out, IR_MULHI, GUP_TYPE_U64, insn->a, imm);
+    if (t.vreg == IR_VREG_NONE) {
+        return -1;
+    }
+
+    /* q = (((n - t) >> 1) + t) >> (s - 1) */
+    if (magic.add) {
+        u.vreg = strength_emit(ir, out, IR_SUB, GUP_TYPE_U64, insn->a, t);
+        if (u.vreg == IR_VREG_NONE) {
+            return -1;
+        }
+
+        imm.imm = 1;
+        u.vreg = strength_emit(ir, out, IR_SHR, GUP_TYPE_U64, u, imm);
+        if (u.vreg == IR_VREG_NONE) {
+            return -1;
+        }
+
+        t.vreg = strength_emit(ir, out, IR_ADD, GUP_TYPE_U64, u, t);
+        if (t.vreg == IR_VREG_NONE) {
+            return -1;
+        }
+
+        --magic.shift;
+    }
+
+    /* q = t >> s, the quotient never exceeds the dividend */
+    tail.a = t;
+    if (magic.shift == 0) {
+        tail.op = IR_MOV;
+    } else {
+        tail.op = IR_SHR;
+        tail.b.type = IR_VAL_IMM;
+        tail.b.imm = magic.shift;
+    }
+
+    return ir_append(out, &tail) < 0 ? -1 : 0;
+}
+
+/*
+ * Append a modulo by a constant that is not a power
+ * of two as n - (n / d) * d.
+ *
+ * @ir: Function being rewritten
+ * @out: Instructions being rebuilt
+ * @insn: Modulo being replaced
+ */
+static int
+strength_mod_magic(struct ir_func *ir, struct ir_func *out, const struct ir_insn *insn)
+{
+    struct ir_insn tail = { .op = IR_SUB, .dst = insn->dst, .width = insn->width };
+    struct ir_val q = { .type = IR_VAL_VREG }, p = { .type = IR_VAL_VREG };
+
+    if ((q.vreg = ir_vreg_new(ir)) == IR_VREG_NONE) {
+        return -1;
+    }
+
+    if (strength_div_magic(ir, out, insn, q.vreg) < 0) {
+        return -1;
+    }
+
+    p.vreg = strength_emit(ir, out, IR_MUL, GUP_TYPE_U64, q, insn->b);
+    if (p.vreg == IR_VREG_NONE) {
+        return -1;
+    }
+
+    tail.a = insn->a;
+    tail.b = p;
+    return ir_append(out, &tail) < 0 ? -1 : 0;
+}
+
+/*
+ * Reduce a single instruction in place where it becomes
+ * a single cheaper instruction.
+ *
+ * @insn: Instruction to reduce
+ *
+ * Returns true if the instruction was reduced
+ */
+static bool
+strength_reduce(struct ir_insn *insn)
+{
+    struct ir_val tmp;
+    int k;
+
+    /* Constants go on the right of commutative operations */
+    switch (insn->op) {
+    case IR_ADD:
+    case IR_MUL:
+    case IR_AND:
+        if (insn->a.type != IR_VAL_IMM) {
+            break;
+        }
+
+        tmp = insn->a;
+        insn->a = insn->b;
+        insn->b = tmp;
+        break;
+    default:
+        break;
+    }
+
+    if (insn->b.type != IR_VAL_IMM) {
+        return false;
+    }
+
+    k = strength_log2(insn->b.imm);
+    switch (insn->op) {
+    case IR_MUL:
+        if (insn->b.imm == 0) {
+            insn->op = IR_MOV;
+            insn->a = insn->b;
+        } else if (k == 0) {
+            insn->op = IR_MOV;
+        } else if (k > 0) {
+            insn->op = IR_SHL;
+            insn->b.imm = k;
+        } else {
+            return false;
+        }
+        break;
+    case IR_DIV:
+        if (k == 0) {
+            insn->op = IR_MOV;
+        } else if (k > 0) {
+            insn->op = IR_SHR;
+            insn->b.imm = k;
+        } else {
+            return false;
+        }
+        break;
+    case IR_MOD:
+        if (k == 0) {
+            insn->op = IR_MOV;
+            insn->a.type = IR_VAL_IMM;
+            insn->a.imm = 0;
+        } else if (k > 0) {
+            insn->op = IR_AND;
+            insn->b.imm -= 1;
+        } else {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    if (insn->op == IR_MOV) {
+        insn->b.type = IR_VAL_NONE;
+    }
+
+    return true;
+}
+
+/*
+ * Replace multiplies, divides and modulos by constants
+ * with shifts, masks, and multiplies by the magic number
+ * of the divisor.
+ */
+int
+pass_strength(struct gup_state *state, struct gup_func *func)
+{
+    struct ir_func *ir = &func->ir;
+    struct ir_func out;
+    struct ir_insn *insn;
+    size_t reduced = 0, magic = 0;
+    int error = 0;
+
+    memset(&out, 0, sizeof(out));
+    for (size_t i = 0; i < ir->insn_count && error == 0; ++i) {
+        insn = &ir->insns[i];
+        if (strength_reduce(insn)) {
+            ++reduced;
+        }
+
+        if ((insn->op != IR_DIV && insn->op != IR_MOD) ||
+            insn->b.type != IR_VAL_IMM) {
+            if (ir_append(&out, insn) < 0) {
+                error = -1;
+            }
+            continue;
+        }
+
+        if (insn->op == IR_DIV) {
+            error = strength_div_magic(ir, &out, insn, insn->dst);
+        } else {
+            error = strength_mod_magic(ir, &out, insn);
+        }
+
+        ++magic;
+    }
+
+    if (error != 0 || magic == 0) {
+        free(out.insns);
+        pass_stat("strength", "operations reduced", reduced);
+        return error;
+    }
+
+    free(ir->insns);
+    ir->insns = out.insns;
+    ir->insn_count = out.insn_count;
+    ir->insn_cap = out.insn_cap;
+    pass_stat("strength", "operations reduced", reduced);
+    pass_stat("strength", "divisions by multiply", magic);
+    return 0;
+}
@@ -42,6 +42,15 @@ symid_t symbol_new(struct symbol_table *tbl, const char *name, symtype_t type,
     symbol->data_type = GUP_TYPE_VOID;
     symbol->id = tbl->symbol_count++;
     symbol->is_pub = 0;
+    symbol->is_hot = 0;
+    symbol->is_inline = 0;
+    symbol->is_noinline = 0;
+    symbol->is_extern = 0;
+    symbol->tree = NULL;
+    symbol->layout = NULL;
+    symbol->data = NULL;
+    symbol->param_count = 0;
+    symbol->ret_count = 0;
     TAILQ_INSERT_TAIL(&tbl->symbols, symbol, link);
     if (res != NULL) {
         *res = symbol;
@@ -111,3 +120,27 @@ symbol_from_name(struct symbol_table *tbl, const char *name)
 
     return NULL;
 }
+
+bool
+symbol_can_tail(const struct symbol *caller, const struct symbol *callee)
+{
+    if (caller == NULL || callee == NULL || callee->is_extern) {
+        return false;
+    }
+
+    /* Whatever the callee leaves behind is never looked at */
+    if (caller->ret_count == 0) {
+        return true;
+    }
+
+    if (caller->ret_count != callee->ret_count) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < caller->ret_count; ++i) {
+        if (caller->ret_types[i] != callee->ret_types[i])
+            return false;
+    }
+
+    return true;
+}
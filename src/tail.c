@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gup/trace.h"
+#include "gup/pass.h"
+
+/*
+ * Returns the index of the return that hands back the
+ * results of the call at @idx unchanged, or zero if the
+ * call is not in tail position.
+ *
+ * @ir: Function to scan
+ * @idx: Index of the call
+ * @nret: Number of values the function returns
+ */
+static size_t
+tail_return(const struct ir_func *ir, size_t idx, uint8_t nret)
+{
+    ir_vreg_t res[SYMBOL_MAX_RETS] = { IR_VREG_NONE, IR_VREG_NONE };
+    const struct ir_insn *insn;
+    size_t i = idx + 1;
+
+    for (; i < ir->insn_count && ir->insns[i].op == IR_RESULT; ++i) {
+        if (ir->insns[i].off < SYMBOL_MAX_RETS) {
+            res[ir->insns[i].off] = ir->insns[i].dst;
+        }
+    }
+
+    for (; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        switch (insn->op) {
+        case IR_NOP:
+            continue;
+        case IR_SETRET:
+            if (insn->off != 1 || insn->a.type != IR_VAL_VREG || insn->a.vreg != res[1]) {
+                return 0;
+            }
+            continue;
+        case IR_RET:
+            /* Nothing set since the call, the registers still hold its results */
+            if (nret == 0 || insn->a.type == IR_VAL_NONE) {
+                return i;
+            }
+
+            if (insn->a.type == IR_VAL_VREG && insn->a.vreg == res[0]) {
+                return i;
+            }
+            return 0;
+        default:
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Turn calls directly followed by a return of their
+ * results into tail calls, which jump to the callee
+ * and leave it to return to the caller.
+ */
+int
+pass_tail_call(struct gup_state *state, struct gup_func *func)
+{
+    struct gup_unit *unit = state->unit;
+    struct symbol *callee;
+    struct ir_func *ir;
+    struct ir_insn *insn;
+    size_t ret, n, calls = 0;
+
+    for (size_t i = 0; i < unit->func_count; ++i) {
+        func = unit->funcs[i];
+        ir = &func->ir;
+        n = 0;
+
+        for (size_t j = 0; j < ir->insn_count; ++j) {
+            insn = &ir->insns[j];
+            if (insn->op != IR_CALL || (insn->flags & IR_F_EXTERN)) {
+                continue;
+            }
+
+            callee = symbol_from_name(&state->g_symtab, insn->sym);
+            if (!symbol_can_tail(func->symbol, callee)) {
+                continue;
+            }
+
+            if ((ret = tail_return(ir, j, func->symbol->ret_count)) == 0) {
+                continue;
+            }
+
+            trace_debug("[tail-call] %s in %s\n", insn->sym, func->symbol->name);
+            insn->op = IR_TAIL;
+            for (size_t k = j + 1; k <= ret; ++k) {
+                ir->insns[k].op = IR_NOP;
+            }
+
+            ++n;
+        }
+
+        if (n == 0) {
+            continue;
+        }
+
+        calls += n;
+        n = 0;
+        for (size_t j = 0; j < ir->insn_count; ++j) {
+            if (ir->insns[j].op != IR_NOP) {
+                ir->insns[n++] = ir->insns[j];
+            }
+        }
+
+        ir->insn_count = n;
+    }
+
+    pass_stat("tail-call", "calls turned into jumps", calls);
+    return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/trace.h"
+#include "gup/pass.h"
+#include "gup/mu.h"
+
+/* Most copies of a body made for an unroll hint */
+#define UNROLL_MAX 64
+
+/*
+ * A counted loop that may be unrolled
+ *
+ * @mov: Index of the move that sets the counter
+ * @head: Index of the loop head label
+ * @latch: Index of the DECJNZ closing the loop
+ * @trips: Number of iterations
+ * @size: Estimated size of the body [bytes, zero only if empty]
+ */
+struct unroll_loop {
+    size_t mov;
+    size_t head;
+    size_t latch;
+    uint64_t trips;
+    size_t size;
+};
+
+/*
+ * Returns true if nothing but the closing DECJNZ jumps
+ * to a loop head, or names it within inline assembly.
+ *
+ * @ir: Function to scan
+ * @loop: Loop to check
+ */
+static bool
+unroll_head_private(const struct ir_func *ir, const struct unroll_loop *loop)
+{
+    const struct ir_insn *insn;
+    uint32_t label = ir->insns[loop->head].label;
+
+    for (size_t i = 0; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        if (i != loop->latch && ir_is_branch(insn) && insn->label == label) {
+            return false;
+        }
+
+        if (insn->op == IR_ASM && strstr(insn->sym, ir->labels[label].name) != NULL) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Match a counted loop with a constant number of
+ * iterations and a straight line body at a loop head.
+ *
+ * @ir: Function to scan
+ * @head: Index of the loop head label
+ * @res: Loop is written here
+ *
+ * Returns true if the loop may be unrolled
+ */
+static bool
+unroll_match(const struct ir_func *ir, size_t head, struct unroll_loop *res)
+{
+    const struct ir_insn *insn, *mov;
+    uint32_t label = ir->insns[head].label;
+    size_t size;
+
+    if (head == 0 || !(ir->labels[label].flags & IR_LABEL_LOOP)) {
+        return false;
+    }
+
+    res->head = head;
+    res->latch = 0;
+    res->size = 0;
+    for (size_t i = head + 1; i < ir->insn_count; ++i) {
+        insn = &ir->insns[i];
+        switch (insn->op) {
+        case IR_DECJNZ:
+            if (insn->label != label) {
+                return false;
+            }
+
+            res->latch = i;
+            break;
+        case IR_LABEL:
+        case IR_JMP:
+        case IR_BR:
+        case IR_BT:
+        case IR_JTAB:
+        case IR_CASE:
+        case IR_RET:
+        case IR_TAIL:
+        case IR_ASM:
+            /* Control flow within the body is left alone */
+            return false;
+        case IR_NOP:
+            continue;
+        default:
+            /* Anything that stays counts, so only an empty body has no size */
+            size = mu_insn_size(insn);
+            res->size += (size > 0) ? size : 1;
+            continue;
+        }
+
+        break;
+    }
+
+    if (ir->insns[res->latch].op != IR_DECJNZ) {
+        return false;
+    }
+
+    /* The counter must be set to a constant just before the head */
+    res->mov = head - 1;
+    mov = &ir->insns[res->mov];
+    if (mov->op != IR_MOV || mov->a.type != IR_VAL_IMM || mov->a.imm == 0 ||
+        mov->dst != ir->insns[res->latch].a.vreg) {
+        return false;
+    }
+
+    res->trips = mov->a.imm;
+    return unroll_head_private(ir, res);
+}
+
+/*
+ * Choose how many copies of the body each iteration of
+ * an unrolled loop runs, the trip count if the loop is
+ * to be unrolled fully.
+ *
+ * @state: Compiler state
+ * @ir: Function the loop is in
+ * @loop: Loop to unroll
+ *
+ * Returns zero if the loop is left alone
+ */
+static uint64_t
+unroll_factor(struct gup_state *state, const struct ir_func *ir,
+    const struct unroll_loop *loop)
+{
+    uint32_t hint = ir->labels[ir->insns[loop->head].label].unroll;
+    uint64_t factor;
+
+    /* An empty body is dropped however many times it runs */
+    if (loop->size == 0) {
+        return loop->trips;
+    }
+
+    if (hint == 1) {
+        return 0;
+    }
+
+    if (hint > 0) {
+        factor = (hint > UNROLL_MAX) ? UNROLL_MAX : hint;
+        return (factor > loop->trips) ? loop->trips : factor;
+    }
+
+    if (loop->trips <= state->unroll_limit / loop->size) {
+        return loop->trips;
+    }
+
+    for (factor = 8; factor > 1; factor /= 2) {
+        if (factor * 2 <= loop->trips && factor * loop->size <= state->unroll_limit) {
+            return factor;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Append a copy of the body of a loop, giving every
+ * value it computes a virtual register of its own.
+ *
+ * @ir: Function the loop is in
+ * @loop: Loop to copy the body of
+ * @map: Virtual register map, reset for each copy
+ * @out: Instructions being rebuilt
+ */
+static int
+unroll_copy(struct ir_func *ir, const struct unroll_loop *loop, ir_vreg_t *map,
+    struct ir_func *out)
+{
+    struct ir_insn insn;
+
+    for (ir_vreg_t v = 0; v <= ir->vreg_count; ++v) {
+        map[v] = v;
+    }
+
+    for (size_t i = loop->head + 1; i < loop->latch; ++i) {
+        insn = ir->insns[i];
+        if (insn.op == IR_NOP) {
+            continue;
+        }
+
+        if (insn.a.type == IR_VAL_VREG) {
+            insn.a.vreg = map[insn.a.vreg];
+        }
+
+        if (insn.b.type == IR_VAL_VREG) {
+            insn.b.vreg = map[insn.b.vreg];
+        }
+
+        if (insn.dst != IR_VREG_NONE) {
+            if ((map[insn.dst] = ir_vreg_new(out)) == IR_VREG_NONE) {
+                return -1;
+            }
+            insn.dst = map[insn.dst];
+        }
+
+        if (ir_append(out, &insn) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Unroll a single loop. A partially unrolled loop runs
+ * the leftover iterations ahead of the loop.
+ *
+ * @ir: Function the loop is in
+ * @loop: Loop to unroll
+ * @factor: Copies of the body per iteration
+ */
+static int
+unroll_loop(struct ir_func *ir, const struct unroll_loop *loop, uint64_t factor)
+{
+    struct ir_func out = { .vreg_count = ir->vreg_count };
+    uint64_t iters = loop->trips / factor;
+    uint64_t copies = loop->trips % factor;
+    struct ir_insn mov = ir->insns[loop->mov];
+    ir_vreg_t *map;
+    int error = -1;
+
+    /* A single pass through the unrolled body needs no loop */
+    if (iters <= 1) {
+        copies = loop->trips;
+        iters = 0;
+    }
+
+    if ((map = malloc((ir->vreg_count + 1) * sizeof(*map))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (size_t i = 0; i < loop->mov; ++i) {
+        if (ir_append(&out, &ir->insns[i]) < 0) {
+            goto done;
+        }
+    }
+
+    for (uint64_t c = 0; c < copies && loop->size > 0; ++c) {
+        if (unroll_copy(ir, loop, map, &out) < 0) {
+            goto done;
+        }
+    }
+
+    if (iters > 0) {
+        /* Never unrolled again on the next scan */
+        ir->labels[ir->insns[loop->head].label].unroll = 1;
+        mov.a.imm = iters;
+        if (ir_append(&out, &mov) < 0 || ir_append(&out, &ir->insns[loop->head]) < 0) {
+            goto done;
+        }
+
+        for (uint64_t c = 0; c < factor; ++c) {
+            if (unroll_copy(ir, loop, map, &out) < 0) {
+                goto done;
+            }
+        }
+
+        if (ir_append(&out, &ir->insns[loop->latch]) < 0) {
+            goto done;
+        }
+    }
+
+    for (size_t i = loop->latch + 1; i < ir->insn_count; ++i) {
+        if (ir_append(&out, &ir->insns[i]) < 0) {
+            goto done;
+        }
+    }
+
+    free(ir->insns);
+    ir->insns = out.insns;
+    ir->insn_count = out.insn_count;
+    ir->insn_cap = out.insn_cap;
+    ir->vreg_count = out.vreg_count;
+    out.insns = NULL;
+    error = 0;
+done:
+    free(out.insns);
+    free(map);
+    return error;
+}
+
+/*
+ * Unroll counted loops with a constant number of
+ * iterations. Loops that fit the size budget are
+ * unrolled fully, larger ones by the largest factor
+ * that does, and 'unroll(k)' asks for k copies of the
+ * body regardless of size. Inner loops are unrolled
+ * first, which may leave the outer body straight.
+ */
+int
+pass_unroll(struct gup_state *state, struct gup_func *func)
+{
+    struct ir_func *ir = &func->ir;
+    struct unroll_loop loop;
+    size_t full = 0, partial = 0;
+    uint64_t factor;
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < ir->insn_count; ++i) {
+            if (ir->insns[i].op != IR_LABEL || !unroll_match(ir, i, &loop)) {
+                continue;
+            }
+
+            if ((factor = unroll_factor(state, ir, &loop)) < 2 && factor != loop.trips) {
+                continue;
+            }
+
+            trace_debug(
+                "[unroll] %s: %llu iterations by %llu\n",
+                ir->labels[ir->insns[i].label].name,
+                (unsigned long long)loop.trips,
+                (unsigned long long)factor
+            );
+
+            if (unroll_loop(ir, &loop, factor) < 0) {
+                return -1;
+            }
+
+            if (factor == loop.trips || loop.trips / factor <= 1) {
+                ++full;
+            } else {
+                ++partial;
+            }
+
+            changed = true;
+            break;
+        }
+    }
+
+    pass_stat("unroll", "loops unrolled fully", full);
+    pass_stat("unroll", "loops unrolled partially", partial);
+    return 0;
+}